@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#include "concurrency.h"
+#include "ui_element.h"
+#include "IO/import_layout.h"
+#include "IO/import_preprocessor.h"
+#include "utilities.h"
+
+// Compares importing files one after another with import_layouts().
+// Usage: import_bench [-j <threads>] [-r <repeats>] <file>...
+// Run it from the repository root so clay/clay.h is found.
+
+static double now_seconds(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double) count.QuadPart / (double) frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void remove_all(ui_element_t** roots, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (roots[i]) {
+            ui_element_remove(roots[i]);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t threads = 0;
+    size_t repeats = 1;
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-'; ++first) {
+        if (first + 1 == argc) break;
+        if (!strcmp(argv[first], "-j")) {
+            threads = (size_t) strtoul(argv[++first], NULL, 10);
+        } else if (!strcmp(argv[first], "-r")) {
+            repeats = (size_t) strtoul(argv[++first], NULL, 10);
+        } else {
+            break;
+        }
+    }
+    if (first == argc || repeats == 0) {
+        fprintf(stderr, "Usage: import_bench [-j <threads>] [-r <repeats>] <file>...\n");
+        return EXIT_FAILURE;
+    }
+    if (threads == 0) {
+        threads = processor_count();
+    }
+
+    // Each file is listed `repeats` times, to stand in for a page made of many components
+    size_t n = (size_t) (argc - first) * repeats;
+    const char** files = (const char**) malloc_assert(sizeof(*files) * n);
+    for (size_t i = 0; i < n; ++i) {
+        files[i] = argv[first + i % (size_t) (argc - first)];
+    }
+    ui_element_t** roots = (ui_element_t**) malloc_assert(sizeof(*roots) * n);
+
+    // Warm up, this also loads the clay.h macros so neither run pays for it
+    roots[0] = import_layout(files[0]);
+    remove_all(roots, 1);
+
+    double start = now_seconds();
+    for (size_t i = 0; i < n; ++i) {
+        roots[i] = import_layout(files[i]);
+    }
+    double serial = now_seconds() - start;
+    remove_all(roots, n);
+
+    start = now_seconds();
+    size_t imported = import_layouts(files, n, NULL, roots, threads);
+    double parallel = now_seconds() - start;
+    remove_all(roots, n);
+
+    printf("%zu files, %zu imported\n", n, imported);
+    printf("serial:    %8.3f ms\n", serial * 1e3);
+    printf("%2zu threads: %8.3f ms (%.2fx)\n", threads, parallel * 1e3, serial / parallel);
+
+    free(roots);
+    free(files);
+    free_clay_h_macros();
+    return imported == n ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "clay.h"
+#include "clay_renderer_raylib.h"
+
+// Times Raylib_MeasureText over paragraph text, both a paragraph at a time and a word at a time the
+// way Clay measures wrapped text. Configure with -DCMAKE_C_FLAGS=-DCLAY_DISABLE_SIMD to compare
+// against the scalar loop, or -mavx2 for the gather kernel.
+// Usage: measure_bench [-r <repeats>] [font file]
+// Run it from the repository root so the default font is found.
+
+static const char* paragraph
+    = "Clayouter lays out a user interface with Clay and draws it with raylib. Each element "
+      "can be resized by dragging its edges, moved when it floats, and edited in the properties "
+      "window, where every field of the declaration is shown as a text box.\n"
+      "Layouts are imported from C source files that use the CLAY() macro, and exported back "
+      "to the same form, so a designer's changes can be pasted straight into the application. "
+      "Text elements keep their font, size, colour and wrap mode; the font IDs are assigned in "
+      "the order fonts are loaded, which is unlikely to match yours.\n"
+      "Na\xc3\xafve caf\xc3\xa9 menus \xe2\x80\x94 with the occasional non-ASCII character \xe2\x80\x94 "
+      "still measure correctly, at the cost of decoding UTF-8 for those runs only.\n";
+
+static double now_seconds(void)
+{
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char** argv)
+{
+    size_t repeats = 20000;
+    const char* font_path = "resources/Roboto-Regular.ttf";
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            repeats = (size_t) strtoul(argv[++i], NULL, 10);
+        } else {
+            font_path = argv[i];
+        }
+    }
+
+    // Only the glyph metrics are needed, so the atlas is never uploaded and no window is opened
+    SetTraceLogLevel(LOG_WARNING);
+    int data_size = 0;
+    unsigned char* data = LoadFileData(font_path, &data_size);
+    if (data == NULL) {
+        fprintf(stderr, "Couldn't load font %s\n", font_path);
+        return EXIT_FAILURE;
+    }
+    Font font = { .baseSize = 24, .glyphCount = 400, .glyphPadding = 4 };
+    font.glyphs = LoadFontData(data, data_size, font.baseSize, NULL, font.glyphCount, FONT_DEFAULT);
+    UnloadFileData(data);
+    UnloadImage(GenImageFontAtlas(font.glyphs, &font.recs, font.glyphCount, font.baseSize,
+        font.glyphPadding, 0));
+    Raylib_Font fonts[] = { Raylib_WrapFont(font) };
+
+    Clay_TextElementConfig config = { .fontId = 0, .fontSize = 24 };
+    Clay_StringSlice text = { .length = (int32_t) strlen(paragraph), .chars = paragraph };
+    float checksum = 0;
+
+    double start = now_seconds();
+    for (size_t r = 0; r < repeats; ++r) {
+        checksum += Raylib_MeasureText(text, &config, fonts).width;
+    }
+    double whole = now_seconds() - start;
+
+    start = now_seconds();
+    for (size_t r = 0; r < repeats; ++r) {
+        int32_t word_start = 0;
+        for (int32_t i = 0; i <= text.length; ++i) {
+            if (i == text.length || paragraph[i] == ' ' || paragraph[i] == '\n') {
+                Clay_StringSlice word
+                    = { .length = i - word_start, .chars = paragraph + word_start };
+                checksum += Raylib_MeasureText(word, &config, fonts).width;
+                word_start = i + 1;
+            }
+        }
+    }
+    double words = now_seconds() - start;
+
+    double bytes = (double) text.length * (double) repeats;
+    printf("%zu x %d bytes (checksum %g)\n", repeats, text.length, checksum);
+    printf("paragraphs: %8.3f ms, %6.3f ns/byte\n", whole * 1e3, whole * 1e9 / bytes);
+    printf("words:      %8.3f ms, %6.3f ns/byte\n", words * 1e3, words * 1e9 / bytes);
+
+    // Raylib_UnloadFont() would also unload the texture, which needs a window
+    UnloadFontData(font.glyphs, font.glyphCount);
+    MemFree(font.recs);
+    free(fonts[0].glyphIndices);
+    free(fonts[0].advances);
+    return EXIT_SUCCESS;
+}
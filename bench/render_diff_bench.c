@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "clay.h"
+#include "clay_render_diff.h"
+
+// Times Clay_RenderDiff_Update over a grid of 5000 cells where one cell changes colour each frame,
+// the way a hover highlight does, and checks that it's the only change found.
+// Usage: render_diff_bench [-r <repeats>]
+
+#define ROWS 100
+#define COLUMNS 50
+
+static double now_seconds(void)
+{
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static void clay_error(Clay_ErrorData error)
+{
+    fprintf(stderr, "%.*s\n", (int) error.errorText.length, error.errorText.chars);
+}
+
+static Clay_RenderCommandArray layout(int highlighted)
+{
+    Clay_BeginLayout();
+    CLAY({ .id = CLAY_ID("grid"),
+           .layout = { .sizing = { CLAY_SIZING_GROW(0), CLAY_SIZING_GROW(0) },
+                       .layoutDirection = CLAY_TOP_TO_BOTTOM } })
+    {
+        for (int row = 0; row < ROWS; ++row) {
+            CLAY({ .id = CLAY_IDI("row", row),
+                   .layout = { .sizing = { CLAY_SIZING_GROW(0), CLAY_SIZING_GROW(0) } } })
+            {
+                for (int column = 0; column < COLUMNS; ++column) {
+                    int cell = row * COLUMNS + column;
+                    Clay_Color color = cell == highlighted ? (Clay_Color) { 200, 120, 40, 255 }
+                                                           : (Clay_Color) { 40, 40, 40, 255 };
+                    CLAY({ .id = CLAY_IDI("cell", cell),
+                           .layout = { .sizing = { CLAY_SIZING_GROW(0), CLAY_SIZING_GROW(0) } },
+                           .backgroundColor = color,
+                           .cornerRadius = CLAY_CORNER_RADIUS(2) }) { }
+                }
+            }
+        }
+    }
+    return Clay_EndLayout();
+}
+
+int main(int argc, char** argv)
+{
+    size_t repeats = 1000;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            repeats = (size_t) strtoul(argv[++i], NULL, 10);
+        }
+    }
+
+    uint32_t memory_size = Clay_MinMemorySize();
+    void* memory = malloc(memory_size);
+    Clay_Arena arena = Clay_CreateArenaWithCapacityAndMemory(memory_size, memory);
+    Clay_Initialize(arena, (Clay_Dimensions) { 1920, 1080 },
+        (Clay_ErrorHandler) { .errorHandlerFunction = clay_error });
+
+    Clay_RenderDiff diff = { 0 };
+    Clay_RenderCommandArray commands = layout(-1);
+    Clay_RenderDiff_Update(&diff, commands);
+
+    double layout_time = 0, diff_time = 0;
+    size_t wrong = 0;
+    for (size_t r = 0; r < repeats; ++r) {
+        double start = now_seconds();
+        commands = layout((int) (r % (ROWS * COLUMNS)));
+        double laid_out = now_seconds();
+        Clay_RenderDiff_Update(&diff, commands);
+        double diffed = now_seconds();
+        layout_time += laid_out - start;
+        diff_time += diffed - laid_out;
+        // The newly highlighted cell, and the one highlighted last frame
+        int32_t expected = r == 0 ? 1 : 2;
+        if (diff.addedCount || diff.removedCount || diff.changedCount != expected) {
+            wrong++;
+        }
+    }
+
+    printf("%zu frames of %d commands\n", repeats, commands.length);
+    printf("layout: %8.3f us/frame\n", layout_time * 1e6 / (double) repeats);
+    printf("diff:   %8.3f us/frame\n", diff_time * 1e6 / (double) repeats);
+    if (wrong) {
+        printf("%zu frames found other changes than the highlighted cells\n", wrong);
+    }
+
+    Clay_RenderDiff_Free(&diff);
+    free(memory);
+    return wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#include "concurrency.h"
+#include "ui_element.h"
+#include "IO/export_layout.h"
+#include "IO/import_layout.h"
+#include "IO/import_preprocessor.h"
+#include "IO/snapshot.h"
+#include "utilities.h"
+
+// Builds a page of about <elements> elements, then compares opening it from exported C code with
+// opening it from a snapshot, and checks both give the same layout.
+// Usage: snapshot_bench [-n <elements>]
+// Run it from the repository root so clay/clay.h is found. Writes snapshot_bench.c.out,
+// snapshot_bench.snapshot and snapshot_bench.check.out to the working directory.
+
+static double now_seconds(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double) count.QuadPart / (double) frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#endif
+}
+
+static Clay_String copy_string(const char* s)
+{
+    size_t length = strlen(s);
+    char* chars = (char*) malloc_assert(length + 1);
+    memcpy(chars, s, length + 1);
+    return (Clay_String) { .length = (int32_t) length, .chars = chars };
+}
+
+// A card with a hover colour and a line of text, three elements in all
+static void add_card(ui_element_t* parent, size_t index)
+{
+    char text[64];
+    ui_element_t* card = ui_element_create(UI_ELEMENT_DECLARATION);
+    snprintf(text, sizeof(text), "card%zu", index);
+    card->ptr->id.stringId = copy_string(text);
+    card->ptr->layout.padding = (Clay_Padding) CLAY_PADDING_ALL(8);
+    card->ptr->layout.childGap = 4;
+    card->ptr->backgroundColor = (Clay_Color) { 40, 40, 40, 255 };
+    card->ptr->cornerRadius = (Clay_CornerRadius) CLAY_CORNER_RADIUS(4);
+    card->on_hover.enabled = true;
+    card->on_hover.ptr = ui_element_alloc_declaration();
+    memcpy(card->on_hover.ptr, card->ptr, sizeof(*card->ptr));
+    card->on_hover.ptr->backgroundColor = (Clay_Color) { 60, 60, 60, 255 };
+    ui_element_append_child(parent, card);
+
+    ui_element_t* label = ui_element_create(UI_ELEMENT_DECLARATION);
+    label->ptr->layout.sizing.width = (Clay_SizingAxis) CLAY_SIZING_GROW(0);
+    ui_element_append_child(card, label);
+
+    ui_element_t* line = ui_element_create(UI_ELEMENT_TEXT);
+    snprintf(text, sizeof(text), "Item %zu", index % 100);
+    line->text.s = copy_string(text);
+    line->text.capacity = line->text.s.length;
+    line->text_config->textColor = (Clay_Color) { 255, 255, 255, 255 };
+    line->text_config->fontSize = 16;
+    ui_element_append_child(label, line);
+}
+
+static ui_element_t* build_page(size_t elements)
+{
+    ui_element_t* root = ui_element_create(UI_ELEMENT_DECLARATION);
+    root->ptr->id.stringId = copy_string("root");
+    root->ptr->layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+    for (size_t i = 0; i * 3 + 1 < elements; ++i) {
+        add_card(root, i);
+    }
+    return root;
+}
+
+static bool same_file(const char* a, const char* b)
+{
+    FILE* fa = fopen(a, "rb");
+    FILE* fb = fopen(b, "rb");
+    bool same = fa && fb;
+    while (same) {
+        int ca = fgetc(fa);
+        same = ca == fgetc(fb);
+        if (ca == EOF) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+int main(int argc, char** argv)
+{
+    size_t elements = 50000;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            elements = (size_t) strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: snapshot_bench [-n <elements>]\n");
+            return EXIT_FAILURE;
+        }
+    }
+    const char* source = "snapshot_bench.c.out";
+    const char* snapshot = "snapshot_bench.snapshot";
+    const char* check = "snapshot_bench.check.out";
+
+    ui_element_t* page = build_page(elements);
+    double start = now_seconds();
+    bool ok = export_layout(source, page);
+    double exported = now_seconds() - start;
+    start = now_seconds();
+    ok = snapshot_save(snapshot, page, NULL) && ok;
+    double saved = now_seconds() - start;
+    ui_element_remove(page);
+    if (!ok) return EXIT_FAILURE;
+
+    start = now_seconds();
+    ui_element_t* imported = import_layout(source);
+    double import_time = now_seconds() - start;
+    start = now_seconds();
+    ui_element_t* loaded = snapshot_load(snapshot, NULL);
+    double load_time = now_seconds() - start;
+    if (!imported || !loaded) return EXIT_FAILURE;
+
+    // Exporting what the snapshot loaded must give back the file it was saved alongside
+    ok = export_layout(check, loaded) && same_file(source, check);
+
+    printf("%zu elements\n", elements);
+    printf("export:   %8.3f ms\n", exported * 1e3);
+    printf("save:     %8.3f ms\n", saved * 1e3);
+    printf("import:   %8.3f ms\n", import_time * 1e3);
+    printf("load:     %8.3f ms (%.0fx)\n", load_time * 1e3, import_time / load_time);
+    if (!ok) {
+        printf("the loaded snapshot exports differently from the page\n");
+    }
+
+    ui_element_remove(imported);
+    ui_element_remove(loaded);
+    free_clay_h_macros();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
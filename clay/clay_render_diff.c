@@ -0,0 +1,203 @@
+#include "clay_render_diff.h"
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+static uint64_t Clay_RenderDiff_HashBytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i])*1099511628211ull;
+    }
+    return hash;
+}
+
+#define CLAY_RENDER_DIFF_HASH_FIELD(hash, field) Clay_RenderDiff_HashBytes(hash, &(field), sizeof(field))
+
+// Hashed field by field, padding in the render data isn't guaranteed to be zeroed
+static uint64_t Clay_RenderDiff_HashCommand(const Clay_RenderDiff *diff, const Clay_RenderCommand *command, uint64_t previousKey) {
+    uint64_t hash = CLAY_RENDER_DIFF_HASH_FIELD(14695981039346656037ull, previousKey);
+    const Clay_RenderData *data = &command->renderData;
+    switch (command->commandType) {
+        case CLAY_RENDER_COMMAND_TYPE_RECTANGLE:
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->rectangle.backgroundColor);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->rectangle.cornerRadius);
+            break;
+        case CLAY_RENDER_COMMAND_TYPE_BORDER:
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->border.color);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->border.cornerRadius);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->border.width);
+            break;
+        case CLAY_RENDER_COMMAND_TYPE_TEXT: {
+            const Clay_TextRenderData *text = &data->text;
+            hash = Clay_RenderDiff_HashBytes(hash, text->stringContents.chars, (size_t)text->stringContents.length);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, text->textColor);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, text->fontId);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, text->fontSize);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, text->letterSpacing);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, text->lineHeight);
+            break;
+        }
+        case CLAY_RENDER_COMMAND_TYPE_IMAGE:
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->image.backgroundColor);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->image.cornerRadius);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->image.imageData);
+            break;
+        case CLAY_RENDER_COMMAND_TYPE_CUSTOM:
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->custom.backgroundColor);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->custom.cornerRadius);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->custom.customData);
+            break;
+        case CLAY_RENDER_COMMAND_TYPE_SCISSOR_START:
+        case CLAY_RENDER_COMMAND_TYPE_SCISSOR_END:
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->scroll.horizontal);
+            hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, data->scroll.vertical);
+            break;
+        default:
+            break;
+    }
+    if (diff->hashFunction) {
+        uint64_t extra = diff->hashFunction(command, diff->hashUserData);
+        hash = CLAY_RENDER_DIFF_HASH_FIELD(hash, extra);
+    }
+    return hash;
+}
+
+static void Clay_RenderDiff_Sign(Clay_RenderDiff *diff, Clay_RenderCommandArray commands, Clay_RenderCommandSignature *signatures) {
+    uint64_t previousKey = 0;
+    for (int32_t i = 0; i < commands.length; i++) {
+        Clay_RenderCommand *command = Clay_RenderCommandArray_Get(&commands, i);
+        Clay_RenderCommandSignature *signature = &signatures[i];
+        signature->key = ((uint64_t)command->id << 8) | (uint64_t)command->commandType;
+        signature->boundingBox = command->boundingBox;
+        signature->hash = Clay_RenderDiff_HashCommand(diff, command, previousKey);
+        previousKey = signature->key;
+    }
+}
+
+// Grows every array to hold `count` commands, kept the same size so previous and current can swap
+static bool Clay_RenderDiff_Reserve(Clay_RenderDiff *diff, int32_t count) {
+    if (count <= diff->capacity) return true;
+    int32_t capacity = diff->capacity ? diff->capacity : 256;
+    while (capacity < count) capacity *= 2;
+    bool ok = true;
+#define CLAY_RENDER_DIFF_GROW(field, size) do { \
+        void *grown = realloc(diff->field, (size_t)(size)*sizeof(*diff->field)); \
+        if (grown) diff->field = grown; else ok = false; \
+    } while (0)
+    CLAY_RENDER_DIFF_GROW(added, capacity);
+    // Both the previous and the current commands may all be removed or changed
+    CLAY_RENDER_DIFF_GROW(removed, capacity);
+    CLAY_RENDER_DIFF_GROW(changed, capacity);
+    CLAY_RENDER_DIFF_GROW(previous, capacity);
+    CLAY_RENDER_DIFF_GROW(current, capacity);
+    CLAY_RENDER_DIFF_GROW(matched, capacity);
+    // Kept at most half full
+    CLAY_RENDER_DIFF_GROW(index, 2*capacity);
+#undef CLAY_RENDER_DIFF_GROW
+    if (!ok) {
+        fprintf(stderr, "Couldn't allocate render command diff for %d commands\n", (int)count);
+        return false;
+    }
+    diff->capacity = capacity;
+    diff->indexSize = 2*capacity;
+    return true;
+}
+
+static uint32_t Clay_RenderDiff_Slot(const Clay_RenderDiff *diff, uint64_t key) {
+    return (uint32_t)((key*11400714819323198485ull) >> 32) & (uint32_t)(diff->indexSize - 1);
+}
+
+// Commands sharing a key are chained in order, so they're matched in order
+static void Clay_RenderDiff_Insert(Clay_RenderDiff *diff, int32_t previousIndex) {
+    uint32_t mask = (uint32_t)diff->indexSize - 1;
+    uint32_t slot = Clay_RenderDiff_Slot(diff, diff->previous[previousIndex].key);
+    while (diff->index[slot]) slot = (slot + 1) & mask;
+    diff->index[slot] = previousIndex + 1;
+}
+
+// The slot holding the first unmatched previous command with `key`, or the empty slot ending its chain
+static int32_t *Clay_RenderDiff_Find(Clay_RenderDiff *diff, uint64_t key) {
+    uint32_t mask = (uint32_t)diff->indexSize - 1;
+    uint32_t slot = Clay_RenderDiff_Slot(diff, key);
+    while (diff->index[slot]) {
+        int32_t i = diff->index[slot] - 1;
+        if (diff->previous[i].key == key && !diff->matched[i]) break;
+        slot = (slot + 1) & mask;
+    }
+    return &diff->index[slot];
+}
+
+static void Clay_RenderDiff_Match(Clay_RenderDiff *diff) {
+    diff->addedCount = diff->removedCount = diff->changedCount = 0;
+    memset(diff->index, 0, (size_t)diff->indexSize*sizeof(*diff->index));
+    memset(diff->matched, 0, (size_t)diff->previousCount*sizeof(*diff->matched));
+    for (int32_t i = 0; i < diff->previousCount; i++) {
+        Clay_RenderDiff_Insert(diff, i);
+    }
+    for (int32_t i = 0; i < diff->currentCount; i++) {
+        Clay_RenderCommandSignature *signature = &diff->current[i];
+        int32_t found = *Clay_RenderDiff_Find(diff, signature->key);
+        if (!found) {
+            diff->added[diff->addedCount++] = i;
+            continue;
+        }
+        Clay_RenderCommandSignature *before = &diff->previous[found - 1];
+        diff->matched[found - 1] = true;
+        if (before->hash != signature->hash || memcmp(&before->boundingBox, &signature->boundingBox, sizeof(signature->boundingBox)) != 0) {
+            diff->changed[diff->changedCount++] = (Clay_RenderCommandChange) { found - 1, i };
+        }
+    }
+    for (int32_t i = 0; i < diff->previousCount; i++) {
+        if (!diff->matched[i]) diff->removed[diff->removedCount++] = i;
+    }
+}
+
+static bool Clay_RenderDiff_Fail(Clay_RenderDiff *diff) {
+    diff->addedCount = diff->removedCount = diff->changedCount = 0;
+    diff->previousCount = diff->currentCount = 0;
+    return false;
+}
+
+bool Clay_RenderDiff_Update(Clay_RenderDiff *diff, Clay_RenderCommandArray current) {
+    if (!Clay_RenderDiff_Reserve(diff, current.length)) return Clay_RenderDiff_Fail(diff);
+    Clay_RenderCommandSignature *swap = diff->previous;
+    diff->previous = diff->current;
+    diff->previousCount = diff->currentCount;
+    diff->current = swap;
+    diff->currentCount = current.length;
+    Clay_RenderDiff_Sign(diff, current, diff->current);
+    Clay_RenderDiff_Match(diff);
+    return true;
+}
+
+bool Clay_RenderDiff_Compare(Clay_RenderDiff *diff, Clay_RenderCommandArray previous, Clay_RenderCommandArray current) {
+    if (!Clay_RenderDiff_Reserve(diff, previous.length > current.length ? previous.length : current.length)) {
+        return Clay_RenderDiff_Fail(diff);
+    }
+    diff->previousCount = previous.length;
+    Clay_RenderDiff_Sign(diff, previous, diff->previous);
+    diff->currentCount = current.length;
+    Clay_RenderDiff_Sign(diff, current, diff->current);
+    Clay_RenderDiff_Match(diff);
+    return true;
+}
+
+void Clay_RenderDiff_Reset(Clay_RenderDiff *diff) {
+    diff->currentCount = 0;
+}
+
+void Clay_RenderDiff_Free(Clay_RenderDiff *diff) {
+    free(diff->added);
+    free(diff->removed);
+    free(diff->changed);
+    free(diff->previous);
+    free(diff->current);
+    free(diff->matched);
+    free(diff->index);
+    Clay_RenderDiffHashFunction hashFunction = diff->hashFunction;
+    void *hashUserData = diff->hashUserData;
+    memset(diff, 0, sizeof(*diff));
+    diff->hashFunction = hashFunction;
+    diff->hashUserData = hashUserData;
+}
@@ -0,0 +1,78 @@
+#ifndef CLAY_RENDER_DIFF_H
+#define CLAY_RENDER_DIFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "clay.h"
+
+// Compares render commands between frames, so a backend can update only what changed instead of
+// repainting everything. Commands are matched by id and type. When several commands share both,
+// they're matched in order. A command counts as changed when its bounding box moves, or anything
+// it draws changes, or the command drawn before it is a different one, since it may then overlap
+// differently.
+
+// What a render command looked like, kept after Clay reuses its memory for the next layout
+typedef struct {
+    uint64_t key; // id and command type
+    Clay_BoundingBox boundingBox;
+    uint64_t hash; // the render data, and the key of the command drawn before
+} Clay_RenderCommandSignature;
+
+typedef struct {
+    int32_t previousIndex;
+    int32_t currentIndex;
+} Clay_RenderCommandChange;
+
+// Hashes whatever else affects how a backend draws a command, e.g. which texture its font uses
+typedef uint64_t (*Clay_RenderDiffHashFunction)(const Clay_RenderCommand *command, void *userData);
+
+typedef struct {
+    Clay_RenderDiffHashFunction hashFunction; // optional
+    void *hashUserData;
+
+    // Results of the last comparison. Indices of added commands are into the current array, those
+    // of removed commands into the previous one. Valid until the next comparison.
+    int32_t *added;
+    int32_t addedCount;
+    int32_t *removed;
+    int32_t removedCount;
+    Clay_RenderCommandChange *changed;
+    int32_t changedCount;
+
+    // Signatures of the commands last compared, indexed like them. The next update compares
+    // against `current`.
+    Clay_RenderCommandSignature *previous;
+    int32_t previousCount;
+    Clay_RenderCommandSignature *current;
+    int32_t currentCount;
+    bool *matched; // by previous index
+    int32_t capacity;
+    // Open addressing over `previous` by key, holding index + 1 or 0 for an empty slot
+    int32_t *index;
+    int32_t indexSize;
+} Clay_RenderDiff;
+
+/**
+ * @brief Compares commands with those passed to the last call, or treats them all as added on the
+ * first call
+ *
+ * @return `bool` False if memory ran out, the results are then empty and the next call treats
+ * every command as added
+ */
+bool Clay_RenderDiff_Update(Clay_RenderDiff *diff, Clay_RenderCommandArray current);
+
+/**
+ * @brief Compares two arrays of commands that are both still valid
+ *
+ * The next Clay_RenderDiff_Update() compares against `current`.
+ */
+bool Clay_RenderDiff_Compare(Clay_RenderDiff *diff, Clay_RenderCommandArray previous, Clay_RenderCommandArray current);
+
+/**
+ * @brief Forgets the previous commands, so the next update treats every command as added
+ */
+void Clay_RenderDiff_Reset(Clay_RenderDiff *diff);
+
+void Clay_RenderDiff_Free(Clay_RenderDiff *diff);
+
+#endif // CLAY_RENDER_DIFF_H
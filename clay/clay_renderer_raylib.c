@@ -1,14 +1,22 @@
 #define CLAY_IMPLEMENTATION
 #include "clay.h"
 #include "clay_renderer_raylib.h"
+#include "clay_render_diff.h"
+#include "clay_utf8.h"
 
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
 #include "stdint.h"
 #include "string.h"
 #include "stdio.h"
 #include "stdlib.h"
 
+// clay.h includes the SSE2 or NEON headers under the same conditions
+#if !defined(CLAY_DISABLE_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 Camera Raylib_camera;
 
 typedef enum
@@ -82,34 +90,192 @@ Ray GetScreenToWorldPointWithZDistance(Vector2 position, Camera camera, int scre
 }
 
 
+// Codepoints past the lookup table are rare enough to look up the slow way
+#define RAYLIB_GLYPH_TABLE_MAX 0x10000
+
+Raylib_Font Raylib_WrapFont(Font font) {
+    Raylib_Font wrapped = { .font = font };
+    if (!font.glyphs || font.glyphCount == 0) return wrapped;
+    int tableSize = 128;
+    for (int i = 0; i < font.glyphCount; i++) {
+        if (font.glyphs[i].value >= tableSize) tableSize = font.glyphs[i].value + 1;
+    }
+    if (tableSize > RAYLIB_GLYPH_TABLE_MAX) tableSize = RAYLIB_GLYPH_TABLE_MAX;
+    wrapped.glyphIndices = (int *)malloc(sizeof(int) * tableSize);
+    wrapped.advances = (int *)malloc(sizeof(int) * tableSize);
+    if (!wrapped.glyphIndices || !wrapped.advances) {
+        free(wrapped.glyphIndices);
+        free(wrapped.advances);
+        wrapped.glyphIndices = NULL;
+        wrapped.advances = NULL;
+        return wrapped;
+    }
+    // Codepoints the font doesn't have are drawn as '?', or the first glyph, like GetGlyphIndex
+    int fallbackIndex = GetGlyphIndex(font, '?');
+    for (int codepoint = 0; codepoint < tableSize; codepoint++) {
+        wrapped.glyphIndices[codepoint] = fallbackIndex;
+    }
+    for (int i = font.glyphCount - 1; i >= 0; i--) {
+        if (font.glyphs[i].value >= 0 && font.glyphs[i].value < tableSize) wrapped.glyphIndices[font.glyphs[i].value] = i;
+    }
+    for (int codepoint = 0; codepoint < tableSize; codepoint++) {
+        int index = wrapped.glyphIndices[codepoint];
+        // Glyph rects are whole pixels in the atlas, so the advances are exact as ints
+        if (font.glyphs[index].advanceX != 0) wrapped.advances[codepoint] = font.glyphs[index].advanceX;
+        else wrapped.advances[codepoint] = (int)font.recs[index].width + font.glyphs[index].offsetX;
+    }
+    wrapped.tableSize = tableSize;
+    return wrapped;
+}
+
+void Raylib_UnloadFont(Raylib_Font font) {
+    UnloadFont(font.font);
+    free(font.glyphIndices);
+    free(font.advances);
+}
+
+static inline int Raylib_GlyphIndex(const Raylib_Font *font, int codepoint) {
+    if (codepoint < font->tableSize) return font->glyphIndices[codepoint];
+    return GetGlyphIndex(font->font, codepoint);
+}
+
+// Adds the advances of the ASCII run at the start of chars to width, stopping at a newline or a
+// non-ASCII byte, and returns the length of the run. advances must cover all of ASCII.
+static int Raylib_MeasureAsciiRun(const unsigned char *chars, int length, const int *advances, int *width);
+#if !defined(CLAY_DISABLE_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64))
+    static inline int Raylib__CountTrailingZeros(unsigned int mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (int)index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    static int Raylib_MeasureAsciiRun(const unsigned char *chars, int length, const int *advances, int *width) {
+        const __m128i newline = _mm_set1_epi8('\n');
+        int i = 0;
+        int sum = 0;
+#ifdef __AVX2__
+        __m256i sums = _mm256_setzero_si256();
+#endif
+        while (i + 16 <= length) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(chars + i));
+            // The top bit of each byte is set for non-ASCII bytes and newlines
+            int stop = _mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, newline)));
+            if (stop != 0) {
+                int end = i + Raylib__CountTrailingZeros((unsigned int)stop);
+                for (; i < end; i++) sum += advances[chars[i]];
+                break;
+            }
+#ifdef __AVX2__
+            sums = _mm256_add_epi32(sums, _mm256_i32gather_epi32(advances, _mm256_cvtepu8_epi32(v), 4));
+            sums = _mm256_add_epi32(sums, _mm256_i32gather_epi32(advances, _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)), 4));
+#else
+            int sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+            for (int j = 0; j < 16; j += 4) {
+                sum0 += advances[chars[i + j]];
+                sum1 += advances[chars[i + j + 1]];
+                sum2 += advances[chars[i + j + 2]];
+                sum3 += advances[chars[i + j + 3]];
+            }
+            sum += (sum0 + sum1) + (sum2 + sum3);
+#endif
+            i += 16;
+        }
+#ifdef __AVX2__
+        __m128i sums4 = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        sums4 = _mm_add_epi32(sums4, _mm_shuffle_epi32(sums4, _MM_SHUFFLE(1, 0, 3, 2)));
+        sums4 = _mm_add_epi32(sums4, _mm_shuffle_epi32(sums4, _MM_SHUFFLE(2, 3, 0, 1)));
+        sum += _mm_cvtsi128_si32(sums4);
+#endif
+        if (i + 16 > length) {
+            for (; i < length && chars[i] < 0x80 && chars[i] != '\n'; i++) sum += advances[chars[i]];
+        }
+        *width += sum;
+        return i;
+    }
+#elif !defined(CLAY_DISABLE_SIMD) && defined(__aarch64__)
+    static int Raylib_MeasureAsciiRun(const unsigned char *chars, int length, const int *advances, int *width) {
+        const uint8x16_t newline = vdupq_n_u8('\n');
+        const uint8x16_t nonAscii = vdupq_n_u8(0x80);
+        int i = 0;
+        int sum = 0;
+        while (i + 16 <= length) {
+            uint8x16_t v = vld1q_u8(chars + i);
+            uint8x16_t stop = vorrq_u8(vcgeq_u8(v, nonAscii), vceqq_u8(v, newline));
+            if (vmaxvq_u8(stop) != 0) break;
+            int sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+            for (int j = 0; j < 16; j += 4) {
+                sum0 += advances[chars[i + j]];
+                sum1 += advances[chars[i + j + 1]];
+                sum2 += advances[chars[i + j + 2]];
+                sum3 += advances[chars[i + j + 3]];
+            }
+            sum += (sum0 + sum1) + (sum2 + sum3);
+            i += 16;
+        }
+        for (; i < length && chars[i] < 0x80 && chars[i] != '\n'; i++) sum += advances[chars[i]];
+        *width += sum;
+        return i;
+    }
+#else
+    static int Raylib_MeasureAsciiRun(const unsigned char *chars, int length, const int *advances, int *width) {
+        int i = 0;
+        int sum = 0;
+        for (; i < length && chars[i] < 0x80 && chars[i] != '\n'; i++) sum += advances[chars[i]];
+        *width += sum;
+        return i;
+    }
+#endif
+
 Clay_Dimensions Raylib_MeasureText(Clay_StringSlice text, Clay_TextElementConfig *config, void *userData) {
     // Measure string size for Font
     Clay_Dimensions textSize = { 0 };
 
     float maxTextWidth = 0.0f;
-    float lineTextWidth = 0;
+    // Advances are whole pixels, summing them as ints keeps the loop off the float add latency
+    int lineTextWidth = 0;
 
     float textHeight = config->fontSize;
-    Font* fonts = (Font*)userData;
-    Font fontToUse = fonts[config->fontId];
+    Raylib_Font* fonts = (Raylib_Font*)userData;
+    const Raylib_Font *fontToUse = &fonts[config->fontId];
     // Font failed to load, likely the fonts are in the wrong place relative to the execution dir
-    if (!fontToUse.glyphs) return textSize;
+    if (!fontToUse->font.glyphs) return textSize;
 
-    float scaleFactor = config->fontSize/(float)fontToUse.baseSize;
+    float scaleFactor = config->fontSize/(float)fontToUse->font.baseSize;
+    const int *advances = fontToUse->advances;
+    int tableSize = fontToUse->tableSize;
 
-    for (int i = 0; i < text.length; ++i)
+    const unsigned char *chars = (const unsigned char *)text.chars;
+    for (int i = 0; i < text.length;)
     {
-        if (text.chars[i] == '\n') {
-            maxTextWidth = fmax(maxTextWidth, lineTextWidth);
+        // Tables are at least 128 long, so runs of ASCII only need the one lookup
+        if (tableSize) {
+            i += Raylib_MeasureAsciiRun(chars + i, text.length - i, advances, &lineTextWidth);
+            if (i == text.length) break;
+        }
+        int codepoint = chars[i];
+        int codepointSize = 1;
+        if (codepoint >= 0x80) codepoint = Clay_DecodeCodepoint(text.chars + i, text.length - i, &codepointSize);
+        i += codepointSize;
+        if (codepoint == '\n') {
+            maxTextWidth = fmax(maxTextWidth, (float)lineTextWidth);
             lineTextWidth = 0;
             continue;
         }
-        int index = text.chars[i] - 32;
-        if (fontToUse.glyphs[index].advanceX != 0) lineTextWidth += fontToUse.glyphs[index].advanceX;
-        else lineTextWidth += (fontToUse.recs[index].width + fontToUse.glyphs[index].offsetX);
+        if (codepoint < tableSize) {
+            lineTextWidth += advances[codepoint];
+        } else {
+            int index = Raylib_GlyphIndex(fontToUse, codepoint);
+            const Font *font = &fontToUse->font;
+            if (font->glyphs[index].advanceX != 0) lineTextWidth += font->glyphs[index].advanceX;
+            else lineTextWidth += (int)font->recs[index].width + font->glyphs[index].offsetX;
+        }
     }
 
-    maxTextWidth = fmax(maxTextWidth, lineTextWidth);
+    maxTextWidth = fmax(maxTextWidth, (float)lineTextWidth);
 
     textSize.width = maxTextWidth * scaleFactor;
     textSize.height = textHeight;
@@ -123,26 +289,302 @@ void Clay_Raylib_Initialize(int width, int height, const char *title, unsigned i
 //    EnableEventWaiting();
 }
 
-void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands, Font* fonts)
+bool Clay_Raylib_ScrollInProgress(void) {
+    Clay_Context *context = Clay_GetCurrentContext();
+    for (int32_t i = 0; i < context->scrollContainerDatas.length; i++) {
+        Clay__ScrollContainerDataInternal *scrollData = Clay__ScrollContainerDataInternalArray_Get(&context->scrollContainerDatas, i);
+        if (scrollData->pointerScrollActive || scrollData->scrollMomentum.x != 0 || scrollData->scrollMomentum.y != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Edge of the glyph is where the distance field crosses 0.5, smoothed over about a pixel
+static const char *Raylib_sdfFragmentShader =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec4 colDiffuse;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    float distanceFromOutline = texture(texture0, fragTexCoord).a - 0.5;\n"
+    "    float distanceChangePerFragment = length(vec2(dFdx(distanceFromOutline), dFdy(distanceFromOutline)));\n"
+    "    float alpha = smoothstep(-distanceChangePerFragment, distanceChangePerFragment, distanceFromOutline);\n"
+    "    finalColor = vec4(fragColor.rgb, fragColor.a*alpha);\n"
+    "}\n";
+static Shader Raylib_sdfShader;
+
+// Same output as DrawTextEx, but takes a slice so the text doesn't need to be copied to null terminate it
+static void DrawTextSlice(const Raylib_Font *wrapped, Clay_StringSlice text, Vector2 position, float fontSize, float spacing, Color tint) {
+    Font font = wrapped->font;
+    bool useTable = font.texture.id != 0;
+    if (!useTable) font = GetFontDefault();
+    bool sdf = useTable && wrapped->sdf;
+    if (sdf) {
+        if (Raylib_sdfShader.id == 0) Raylib_sdfShader = LoadShaderFromMemory(NULL, Raylib_sdfFragmentShader);
+        BeginShaderMode(Raylib_sdfShader);
+    }
+    float scaleFactor = fontSize/(float)font.baseSize;
+    float padding = (float)font.glyphPadding;
+    float textOffsetX = 0.0f;
+    float textOffsetY = 0.0f;
+    for (int i = 0; i < text.length;) {
+        int codepointSize = 0;
+        int codepoint = Clay_DecodeCodepoint(text.chars + i, text.length - i, &codepointSize);
+        i += codepointSize;
+        if (codepoint == '\n') {
+            // raylib's default line spacing, see SetTextLineSpacing
+            textOffsetY += fontSize + 2;
+            textOffsetX = 0.0f;
+            continue;
+        }
+        int index = useTable ? Raylib_GlyphIndex(wrapped, codepoint) : GetGlyphIndex(font, codepoint);
+        Rectangle rec = font.recs[index];
+        const GlyphInfo *glyph = &font.glyphs[index];
+        if (codepoint != ' ' && codepoint != '\t') {
+            Rectangle srcRec = { rec.x - padding, rec.y - padding, rec.width + 2.0f*padding, rec.height + 2.0f*padding };
+            Rectangle dstRec = { position.x + textOffsetX + (glyph->offsetX - padding)*scaleFactor,
+                                 position.y + textOffsetY + (glyph->offsetY - padding)*scaleFactor,
+                                 srcRec.width*scaleFactor, srcRec.height*scaleFactor };
+            DrawTexturePro(font.texture, srcRec, dstRec, (Vector2){ 0, 0 }, 0.0f, tint);
+        }
+        if (glyph->advanceX == 0) textOffsetX += rec.width*scaleFactor + spacing;
+        else textOffsetX += (float)glyph->advanceX*scaleFactor + spacing;
+    }
+    if (sdf) EndShaderMode();
+}
+
+// Solid quads queued since the last draw that wasn't one, submitted together by Raylib_FlushQuads.
+// Triangles are queued as quads with the last vertex repeated.
+typedef struct {
+    Vector2 vertices[4];
+    Color color;
+} Raylib_Quad;
+
+static struct {
+    Raylib_Quad *quads;
+    int count;
+    int capacity;
+} Raylib_quadBatch;
+
+static void Raylib_BatchVertices(Vector2 v0, Vector2 v1, Vector2 v2, Vector2 v3, Color color) {
+    if (color.a == 0) return;
+    if (Raylib_quadBatch.count == Raylib_quadBatch.capacity) {
+        int capacity = Raylib_quadBatch.capacity ? Raylib_quadBatch.capacity * 2 : 256;
+        Raylib_Quad *quads = (Raylib_Quad *)realloc(Raylib_quadBatch.quads, capacity * sizeof(Raylib_Quad));
+        if (!quads) {
+            fprintf(stderr, "Couldn't grow the rectangle batch to %d quads\n", capacity);
+            return;
+        }
+        Raylib_quadBatch.quads = quads;
+        Raylib_quadBatch.capacity = capacity;
+    }
+    // rlgl culls back faces, so keep every quad wound the same way as DrawRectangle's
+    float area = (v0.x*v1.y - v1.x*v0.y) + (v1.x*v2.y - v2.x*v1.y) + (v2.x*v3.y - v3.x*v2.y) + (v3.x*v0.y - v0.x*v3.y);
+    if (area > 0) {
+        Vector2 swap = v1;
+        v1 = v3;
+        v3 = swap;
+    }
+    Raylib_quadBatch.quads[Raylib_quadBatch.count++] = (Raylib_Quad) { { v0, v1, v2, v3 }, color };
+}
+
+static void Raylib_BatchQuad(float x, float y, float width, float height, Color color) {
+    if (width <= 0 || height <= 0) return;
+    Raylib_BatchVertices((Vector2) { x, y }, (Vector2) { x, y + height }, (Vector2) { x + width, y + height }, (Vector2) { x + width, y }, color);
+}
+
+// Must run before anything else is drawn, or changes the scissor, so draw order is kept
+static void Raylib_FlushQuads(void) {
+    if (Raylib_quadBatch.count == 0) return;
+    // Makes room for the whole batch at once, rather than checking on every vertex
+    rlCheckRenderBatchLimit(Raylib_quadBatch.count * 4);
+    rlSetTexture(rlGetTextureIdDefault());
+    rlBegin(RL_QUADS);
+    for (int i = 0; i < Raylib_quadBatch.count; i++) {
+        Raylib_Quad *quad = &Raylib_quadBatch.quads[i];
+        rlColor4ub(quad->color.r, quad->color.g, quad->color.b, quad->color.a);
+        rlTexCoord2f(0, 0);
+        for (int k = 0; k < 4; k++) {
+            rlVertex2f(quad->vertices[k].x, quad->vertices[k].y);
+        }
+    }
+    rlEnd();
+    rlSetTexture(0);
+    Raylib_quadBatch.count = 0;
+}
+
+// Quarter circle outlines, from angle 0 to 90 degrees, relative to the corner's centre
+typedef struct {
+    float radius;
+    float width;
+    int segments; // 0 for an empty slot
+    Vector2 *outer;
+    Vector2 *inner;
+} Raylib_CornerGeometry;
+
+#define RAYLIB_CORNER_SEGMENTS_MAX 32
+// Direct mapped, a colliding corner replaces the one in its slot
+#define RAYLIB_CORNER_CACHE_SIZE 256
+static Raylib_CornerGeometry Raylib_cornerCache[RAYLIB_CORNER_CACHE_SIZE];
+
+// Enough segments that the arc strays less than half a pixel from the circle, for a radius in pixels
+static int Raylib_CornerSegments(float radius) {
+    if (radius <= 0.5f) return 1;
+    float step = 2.0f*acosf(1.0f - 0.5f/radius);
+    int segments = (int)ceilf((PI/2.0f)/step);
+    if (segments < 1) return 1;
+    return segments > RAYLIB_CORNER_SEGMENTS_MAX ? RAYLIB_CORNER_SEGMENTS_MAX : segments;
+}
+
+// The scale takes layout units to pixels, so corners drawn zoomed in get enough segments
+static const Raylib_CornerGeometry *Raylib_GetCorner(float radius, float width, float scale) {
+    int segments = Raylib_CornerSegments(radius*scale);
+    uint32_t radiusBits, widthBits;
+    memcpy(&radiusBits, &radius, sizeof(radiusBits));
+    memcpy(&widthBits, &width, sizeof(widthBits));
+    uint32_t hash = (radiusBits*2654435761u) ^ (widthBits*2246822519u) ^ (uint32_t)segments;
+    Raylib_CornerGeometry *corner = &Raylib_cornerCache[(hash ^ (hash >> 16)) % RAYLIB_CORNER_CACHE_SIZE];
+    if (corner->segments == segments && corner->radius == radius && corner->width == width) {
+        return corner;
+    }
+    Vector2 *points = (Vector2 *)realloc(corner->outer, 2*(segments + 1)*sizeof(Vector2));
+    if (!points) {
+        fprintf(stderr, "Couldn't allocate corner geometry with %d segments\n", segments);
+        return NULL;
+    }
+    float innerRadius = radius > width ? radius - width : 0;
+    for (int i = 0; i <= segments; i++) {
+        float angle = (PI/2.0f)*(float)i/(float)segments;
+        Vector2 direction = { cosf(angle), sinf(angle) };
+        points[i] = Vector2Scale(direction, radius);
+        points[segments + 1 + i] = Vector2Scale(direction, innerRadius);
+    }
+    *corner = (Raylib_CornerGeometry) { radius, width, segments, points, points + segments + 1 };
+    return corner;
+}
+
+// Corners clockwise from top left. Each arc runs clockwise, so the outlines join up.
+static const Vector2 Raylib_cornerSigns[4] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+
+static Vector2 Raylib_CornerPoint(const Vector2 *points, int corner, int i, int segments, Vector2 center) {
+    // Top left and bottom right arcs run from 0 to 90 degrees once mirrored, the others backwards
+    Vector2 offset = points[(corner & 1) ? segments - i : i];
+    return (Vector2) { center.x + Raylib_cornerSigns[corner].x*offset.x, center.y + Raylib_cornerSigns[corner].y*offset.y };
+}
+
+static float Raylib_ClampRadius(float radius, Rectangle rec) {
+    float limit = (rec.width < rec.height ? rec.width : rec.height)/2.0f;
+    return radius < limit ? radius : limit;
+}
+
+static void Raylib_CornerCenters(Rectangle rec, const float radii[4], Vector2 centers[4]) {
+    centers[0] = (Vector2) { rec.x + radii[0], rec.y + radii[0] };
+    centers[1] = (Vector2) { rec.x + rec.width - radii[1], rec.y + radii[1] };
+    centers[2] = (Vector2) { rec.x + rec.width - radii[2], rec.y + rec.height - radii[2] };
+    centers[3] = (Vector2) { rec.x + radii[3], rec.y + rec.height - radii[3] };
+}
+
+// The shape is convex, so it's filled as a fan from its centre over the corner outlines
+static void Raylib_BatchRoundedRectangle(Rectangle rec, Clay_CornerRadius cornerRadius, float scale, Color color) {
+    if (rec.width <= 0 || rec.height <= 0) return;
+    float radii[4] = {
+        Raylib_ClampRadius(cornerRadius.topLeft, rec), Raylib_ClampRadius(cornerRadius.topRight, rec),
+        Raylib_ClampRadius(cornerRadius.bottomRight, rec), Raylib_ClampRadius(cornerRadius.bottomLeft, rec),
+    };
+    Vector2 centers[4];
+    Raylib_CornerCenters(rec, radii, centers);
+    Vector2 outline[4*(RAYLIB_CORNER_SEGMENTS_MAX + 1)];
+    int count = 0;
+    for (int c = 0; c < 4; c++) {
+        const Raylib_CornerGeometry *corner = radii[c] > 0 ? Raylib_GetCorner(radii[c], radii[c], scale) : NULL;
+        if (!corner) {
+            outline[count++] = centers[c];
+            continue;
+        }
+        for (int i = 0; i <= corner->segments; i++) {
+            outline[count++] = Raylib_CornerPoint(corner->outer, c, i, corner->segments, centers[c]);
+        }
+    }
+    Vector2 middle = { rec.x + rec.width/2.0f, rec.y + rec.height/2.0f };
+    for (int i = 0; i < count; i++) {
+        Vector2 next = outline[(i + 1) % count];
+        Raylib_BatchVertices(middle, outline[i], next, next, color);
+    }
+}
+
+// Only the corner arcs, the straight edges are drawn as rectangles
+static void Raylib_BatchBorderCorners(Rectangle rec, Clay_CornerRadius cornerRadius, Clay_BorderWidth width, float scale, Color color) {
+    float radii[4] = { cornerRadius.topLeft, cornerRadius.topRight, cornerRadius.bottomRight, cornerRadius.bottomLeft };
+    float widths[4] = { width.top, width.top, width.bottom, width.bottom };
+    Vector2 centers[4];
+    Raylib_CornerCenters(rec, radii, centers);
+    for (int c = 0; c < 4; c++) {
+        if (radii[c] <= 0 || widths[c] <= 0) continue;
+        const Raylib_CornerGeometry *corner = Raylib_GetCorner(radii[c], widths[c], scale);
+        if (!corner) continue;
+        centers[c] = (Vector2) { roundf(centers[c].x), roundf(centers[c].y) };
+        for (int i = 0; i < corner->segments; i++) {
+            Raylib_BatchVertices(
+                Raylib_CornerPoint(corner->outer, c, i, corner->segments, centers[c]),
+                Raylib_CornerPoint(corner->inner, c, i, corner->segments, centers[c]),
+                Raylib_CornerPoint(corner->inner, c, i + 1, corner->segments, centers[c]),
+                Raylib_CornerPoint(corner->outer, c, i + 1, corner->segments, centers[c]),
+                color);
+        }
+    }
+}
+
+// Where a damaged region is being redrawn, in layout coordinates. Scissor rectangles are scaled to
+// the render texture's pixels, as BeginScissorMode doesn't do that for render textures.
+typedef struct {
+    Rectangle rect;
+    float scale;
+} Raylib_Clip;
+
+static void Raylib_BeginScissor(Rectangle rect, const Raylib_Clip *clip) {
+    if (clip) {
+        float x0 = fmaxf(rect.x, clip->rect.x), y0 = fmaxf(rect.y, clip->rect.y);
+        float x1 = fminf(rect.x + rect.width, clip->rect.x + clip->rect.width);
+        float y1 = fminf(rect.y + rect.height, clip->rect.y + clip->rect.height);
+        rect = (Rectangle) { x0*clip->scale, y0*clip->scale, fmaxf(x1 - x0, 0)*clip->scale, fmaxf(y1 - y0, 0)*clip->scale };
+    }
+    BeginScissorMode((int)roundf(rect.x), (int)roundf(rect.y), (int)roundf(rect.width), (int)roundf(rect.height));
+}
+
+static bool Raylib_Overlaps(Clay_BoundingBox box, Rectangle rect) {
+    return box.x < rect.x + rect.width && rect.x < box.x + box.width && box.y < rect.y + rect.height && rect.y < box.y + box.height;
+}
+
+// Text and borders can stray past their bounding boxes by a pixel or so
+#define RAYLIB_DAMAGE_PADDING 2
+
+static void Raylib_RenderCommands(Clay_RenderCommandArray renderCommands, Raylib_Font* fonts, const Raylib_Clip *clip)
 {
+    // Drawn straight to the window, high DPI scaling is applied to everything drawn
+    float scale = clip ? clip->scale : (GetScreenWidth() > 0 ? (float)GetRenderWidth() / (float)GetScreenWidth() : 1.0f);
     for (int j = 0; j < renderCommands.length; j++)
     {
         Clay_RenderCommand *renderCommand = Clay_RenderCommandArray_Get(&renderCommands, j);
         Clay_BoundingBox boundingBox = renderCommand->boundingBox;
+        Clay_RenderCommandType commandType = renderCommand->commandType;
+        if (clip && commandType != CLAY_RENDER_COMMAND_TYPE_SCISSOR_START && commandType != CLAY_RENDER_COMMAND_TYPE_SCISSOR_END
+            && commandType != CLAY_RENDER_COMMAND_TYPE_CUSTOM && !Raylib_Overlaps(boundingBox, clip->rect)) {
+            continue;
+        }
         switch (renderCommand->commandType)
         {
             case CLAY_RENDER_COMMAND_TYPE_TEXT: {
-                // Raylib uses standard C strings so isn't compatible with cheap slices, we need to clone the string to append null terminator
+                Raylib_FlushQuads();
                 Clay_TextRenderData *textData = &renderCommand->renderData.text;
-                char *cloned = (char *)malloc(textData->stringContents.length + 1);
-                memcpy(cloned, textData->stringContents.chars, textData->stringContents.length);
-                cloned[textData->stringContents.length] = '\0';
-                Font fontToUse = fonts[textData->fontId];
-                DrawTextEx(fontToUse, cloned, (Vector2){boundingBox.x, boundingBox.y}, (float)textData->fontSize, (float)textData->letterSpacing, CLAY_COLOR_TO_RAYLIB_COLOR(textData->textColor));
-                free(cloned);
+                DrawTextSlice(&fonts[textData->fontId], textData->stringContents, (Vector2){boundingBox.x, boundingBox.y}, (float)textData->fontSize, (float)textData->letterSpacing, CLAY_COLOR_TO_RAYLIB_COLOR(textData->textColor));
                 break;
             }
             case CLAY_RENDER_COMMAND_TYPE_IMAGE: {
+                Raylib_FlushQuads();
                 Texture2D imageTexture = *(Texture2D *)renderCommand->renderData.image.imageData;
                 Clay_Color tintColor = renderCommand->renderData.image.backgroundColor;
                 if (tintColor.r == 0 && tintColor.g == 0 && tintColor.b == 0 && tintColor.a == 0) {
@@ -157,20 +599,25 @@ void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands, Font* fonts)
                 break;
             }
             case CLAY_RENDER_COMMAND_TYPE_SCISSOR_START: {
-                BeginScissorMode((int)roundf(boundingBox.x), (int)roundf(boundingBox.y), (int)roundf(boundingBox.width), (int)roundf(boundingBox.height));
+                Raylib_FlushQuads();
+                Raylib_BeginScissor(CLAY_RECTANGLE_TO_RAYLIB_RECTANGLE(boundingBox), clip);
                 break;
             }
             case CLAY_RENDER_COMMAND_TYPE_SCISSOR_END: {
+                Raylib_FlushQuads();
                 EndScissorMode();
+                // Back to clipping to the damaged region
+                if (clip) Raylib_BeginScissor(clip->rect, clip);
                 break;
             }
             case CLAY_RENDER_COMMAND_TYPE_RECTANGLE: {
                 Clay_RectangleRenderData *config = &renderCommand->renderData.rectangle;
-                if (config->cornerRadius.topLeft > 0) {
-                    float radius = (config->cornerRadius.topLeft * 2) / (float)((boundingBox.width > boundingBox.height) ? boundingBox.height : boundingBox.width);
-                    DrawRectangleRounded((Rectangle) { boundingBox.x, boundingBox.y, boundingBox.width, boundingBox.height }, radius, 8, CLAY_COLOR_TO_RAYLIB_COLOR(config->backgroundColor));
+                Rectangle rec = { boundingBox.x, boundingBox.y, boundingBox.width, boundingBox.height };
+                if (config->cornerRadius.topLeft > 0 || config->cornerRadius.topRight > 0 || config->cornerRadius.bottomLeft > 0 || config->cornerRadius.bottomRight > 0) {
+                    Raylib_BatchRoundedRectangle(rec, config->cornerRadius, scale, CLAY_COLOR_TO_RAYLIB_COLOR(config->backgroundColor));
                 } else {
-                    DrawRectangle(boundingBox.x, boundingBox.y, boundingBox.width, boundingBox.height, CLAY_COLOR_TO_RAYLIB_COLOR(config->backgroundColor));
+                    // Truncated to whole pixels, as DrawRectangle would
+                    Raylib_BatchQuad((int)rec.x, (int)rec.y, (int)rec.width, (int)rec.height, CLAY_COLOR_TO_RAYLIB_COLOR(config->backgroundColor));
                 }
                 break;
             }
@@ -178,35 +625,25 @@ void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands, Font* fonts)
                 Clay_BorderRenderData *config = &renderCommand->renderData.border;
                 // Left border
                 if (config->width.left > 0) {
-                    DrawRectangle((int)roundf(boundingBox.x), (int)roundf(boundingBox.y + config->cornerRadius.topLeft), (int)config->width.left, (int)roundf(boundingBox.height - config->cornerRadius.topLeft - config->cornerRadius.bottomLeft), CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
+                    Raylib_BatchQuad((int)roundf(boundingBox.x), (int)roundf(boundingBox.y + config->cornerRadius.topLeft), (int)config->width.left, (int)roundf(boundingBox.height - config->cornerRadius.topLeft - config->cornerRadius.bottomLeft), CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
                 }
                 // Right border
                 if (config->width.right > 0) {
-                    DrawRectangle((int)roundf(boundingBox.x + boundingBox.width - config->width.right), (int)roundf(boundingBox.y + config->cornerRadius.topRight), (int)config->width.right, (int)roundf(boundingBox.height - config->cornerRadius.topRight - config->cornerRadius.bottomRight), CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
+                    Raylib_BatchQuad((int)roundf(boundingBox.x + boundingBox.width - config->width.right), (int)roundf(boundingBox.y + config->cornerRadius.topRight), (int)config->width.right, (int)roundf(boundingBox.height - config->cornerRadius.topRight - config->cornerRadius.bottomRight), CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
                 }
                 // Top border
                 if (config->width.top > 0) {
-                    DrawRectangle((int)roundf(boundingBox.x + config->cornerRadius.topLeft), (int)roundf(boundingBox.y), (int)roundf(boundingBox.width - config->cornerRadius.topLeft - config->cornerRadius.topRight), (int)config->width.top, CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
+                    Raylib_BatchQuad((int)roundf(boundingBox.x + config->cornerRadius.topLeft), (int)roundf(boundingBox.y), (int)roundf(boundingBox.width - config->cornerRadius.topLeft - config->cornerRadius.topRight), (int)config->width.top, CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
                 }
                 // Bottom border
                 if (config->width.bottom > 0) {
-                    DrawRectangle((int)roundf(boundingBox.x + config->cornerRadius.bottomLeft), (int)roundf(boundingBox.y + boundingBox.height - config->width.bottom), (int)roundf(boundingBox.width - config->cornerRadius.bottomLeft - config->cornerRadius.bottomRight), (int)config->width.bottom, CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
-                }
-                if (config->cornerRadius.topLeft > 0) {
-                    DrawRing((Vector2) { roundf(boundingBox.x + config->cornerRadius.topLeft), roundf(boundingBox.y + config->cornerRadius.topLeft) }, roundf(config->cornerRadius.topLeft - config->width.top), config->cornerRadius.topLeft, 180, 270, 10, CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
-                }
-                if (config->cornerRadius.topRight > 0) {
-                    DrawRing((Vector2) { roundf(boundingBox.x + boundingBox.width - config->cornerRadius.topRight), roundf(boundingBox.y + config->cornerRadius.topRight) }, roundf(config->cornerRadius.topRight - config->width.top), config->cornerRadius.topRight, 270, 360, 10, CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
-                }
-                if (config->cornerRadius.bottomLeft > 0) {
-                    DrawRing((Vector2) { roundf(boundingBox.x + config->cornerRadius.bottomLeft), roundf(boundingBox.y + boundingBox.height - config->cornerRadius.bottomLeft) }, roundf(config->cornerRadius.bottomLeft - config->width.top), config->cornerRadius.bottomLeft, 90, 180, 10, CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
-                }
-                if (config->cornerRadius.bottomRight > 0) {
-                    DrawRing((Vector2) { roundf(boundingBox.x + boundingBox.width - config->cornerRadius.bottomRight), roundf(boundingBox.y + boundingBox.height - config->cornerRadius.bottomRight) }, roundf(config->cornerRadius.bottomRight - config->width.bottom), config->cornerRadius.bottomRight, 0.1, 90, 10, CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
+                    Raylib_BatchQuad((int)roundf(boundingBox.x + config->cornerRadius.bottomLeft), (int)roundf(boundingBox.y + boundingBox.height - config->width.bottom), (int)roundf(boundingBox.width - config->cornerRadius.bottomLeft - config->cornerRadius.bottomRight), (int)config->width.bottom, CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
                 }
+                Raylib_BatchBorderCorners((Rectangle) { boundingBox.x, boundingBox.y, boundingBox.width, boundingBox.height }, config->cornerRadius, config->width, scale, CLAY_COLOR_TO_RAYLIB_COLOR(config->color));
                 break;
             }
             case CLAY_RENDER_COMMAND_TYPE_CUSTOM: {
+                Raylib_FlushQuads();
                 Clay_CustomRenderData *config = &renderCommand->renderData.custom;
                 CustomLayoutElement *customElement = (CustomLayoutElement *)config->customData;
                 if (!customElement) continue;
@@ -230,4 +667,127 @@ void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands, Font* fonts)
             }
         }
     }
+    Raylib_FlushQuads();
+}
+
+void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands, Raylib_Font* fonts)
+{
+    Raylib_RenderCommands(renderCommands, fonts, NULL);
+}
+
+#define RAYLIB_DAMAGE_RECTS_MAX 8
+
+static struct {
+    RenderTexture2D target;
+    float scale;
+    Clay_RenderDiff diff;
+    Rectangle rects[RAYLIB_DAMAGE_RECTS_MAX];
+    int rectCount;
+} Raylib_damage;
+
+// Text changes look when a font finishes loading in place of the fallback
+static uint64_t Raylib_HashFontTexture(const Clay_RenderCommand *command, void *userData) {
+    if (command->commandType != CLAY_RENDER_COMMAND_TYPE_TEXT) return 0;
+    const Raylib_Font *fonts = (const Raylib_Font *)userData;
+    return fonts[command->renderData.text.fontId].font.texture.id;
+}
+
+static void Raylib_AddDamage(Clay_BoundingBox box) {
+    Rectangle rect = {
+        floorf(box.x) - RAYLIB_DAMAGE_PADDING, floorf(box.y) - RAYLIB_DAMAGE_PADDING,
+        ceilf(box.width) + 2*RAYLIB_DAMAGE_PADDING + 1, ceilf(box.height) + 2*RAYLIB_DAMAGE_PADDING + 1,
+    };
+    if (rect.width <= 0 || rect.height <= 0) return;
+    // Folds the new region into any it touches, or the one it grows least once the list is full.
+    // Merged regions can touch others, so keep going until nothing overlaps.
+    for (;;) {
+        int best = -1;
+        float bestGrowth = 0;
+        for (int i = 0; i < Raylib_damage.rectCount; i++) {
+            Rectangle other = Raylib_damage.rects[i];
+            float x0 = fminf(rect.x, other.x), y0 = fminf(rect.y, other.y);
+            float x1 = fmaxf(rect.x + rect.width, other.x + other.width), y1 = fmaxf(rect.y + rect.height, other.y + other.height);
+            float growth = (x1 - x0)*(y1 - y0) - other.width*other.height - rect.width*rect.height;
+            bool overlaps = CheckCollisionRecs(rect, other);
+            if (overlaps || (Raylib_damage.rectCount == RAYLIB_DAMAGE_RECTS_MAX && (best < 0 || growth < bestGrowth))) {
+                best = i;
+                bestGrowth = overlaps ? -INFINITY : growth;
+                if (overlaps) break;
+            }
+        }
+        if (best < 0) break;
+        Rectangle other = Raylib_damage.rects[best];
+        float x0 = fminf(rect.x, other.x), y0 = fminf(rect.y, other.y);
+        rect = (Rectangle) { x0, y0, fmaxf(rect.x + rect.width, other.x + other.width) - x0, fmaxf(rect.y + rect.height, other.y + other.height) - y0 };
+        Raylib_damage.rects[best] = Raylib_damage.rects[--Raylib_damage.rectCount];
+    }
+    Raylib_damage.rects[Raylib_damage.rectCount++] = rect;
+}
+
+// Adds the regions that changed since the last frame
+static bool Raylib_FindDamage(Clay_RenderCommandArray renderCommands, Raylib_Font *fonts) {
+    Clay_RenderDiff *diff = &Raylib_damage.diff;
+    diff->hashFunction = Raylib_HashFontTexture;
+    diff->hashUserData = fonts;
+    // Fails when out of memory, with every command added next time
+    if (!Clay_RenderDiff_Update(diff, renderCommands)) return false;
+    for (int32_t i = 0; i < diff->addedCount; i++) {
+        Raylib_AddDamage(diff->current[diff->added[i]].boundingBox);
+    }
+    for (int32_t i = 0; i < diff->removedCount; i++) {
+        Raylib_AddDamage(diff->previous[diff->removed[i]].boundingBox);
+    }
+    for (int32_t i = 0; i < diff->changedCount; i++) {
+        Raylib_AddDamage(diff->previous[diff->changed[i].previousIndex].boundingBox);
+        Raylib_AddDamage(diff->current[diff->changed[i].currentIndex].boundingBox);
+    }
+    return true;
+}
+
+void Clay_Raylib_RenderDamaged(Clay_RenderCommandArray renderCommands, Raylib_Font* fonts, Color background)
+{
+    int width = GetRenderWidth(), height = GetRenderHeight();
+    float scale = (float)width / (float)GetScreenWidth();
+    Raylib_damage.rectCount = 0;
+    bool full = !Raylib_FindDamage(renderCommands, fonts);
+    if (Raylib_damage.target.texture.width != width || Raylib_damage.target.texture.height != height || Raylib_damage.scale != scale) {
+        if (Raylib_damage.target.id) UnloadRenderTexture(Raylib_damage.target);
+        Raylib_damage.target = LoadRenderTexture(width, height);
+        Raylib_damage.scale = scale;
+        full = true;
+    }
+    Rectangle screen = { 0, 0, (float)GetScreenWidth(), (float)GetScreenHeight() };
+    if (full) {
+        Raylib_damage.rects[0] = screen;
+        Raylib_damage.rectCount = 1;
+    }
+
+    if (Raylib_damage.rectCount) {
+        BeginTextureMode(Raylib_damage.target);
+        // Render textures aren't scaled for high DPI displays like the window is
+        BeginMode2D((Camera2D) { .zoom = scale });
+        for (int i = 0; i < Raylib_damage.rectCount; i++) {
+            Raylib_Clip clip = { Raylib_damage.rects[i], scale };
+            Raylib_BeginScissor(clip.rect, &clip);
+            ClearBackground(background);
+            Raylib_RenderCommands(renderCommands, fonts, &clip);
+            EndScissorMode();
+        }
+        EndMode2D();
+        EndTextureMode();
+    }
+
+    // Copied as is, the texture's alpha was blended into and no longer means anything
+    rlSetBlendFactors(RL_ONE, RL_ZERO, RL_FUNC_ADD);
+    BeginBlendMode(BLEND_CUSTOM);
+    Texture2D texture = Raylib_damage.target.texture;
+    DrawTexturePro(texture, (Rectangle) { 0, 0, (float)texture.width, -(float)texture.height }, screen, (Vector2) { 0, 0 }, 0, WHITE);
+    EndBlendMode();
+}
+
+void Clay_Raylib_FreeDamageTracking(void)
+{
+    if (Raylib_damage.target.id) UnloadRenderTexture(Raylib_damage.target);
+    Clay_RenderDiff_Free(&Raylib_damage.diff);
+    memset(&Raylib_damage, 0, sizeof(Raylib_damage));
 }
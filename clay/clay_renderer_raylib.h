@@ -8,7 +8,30 @@
 #define CLAY_COLOR_TO_RAYLIB_COLOR(color) (Color) { .r = (unsigned char)roundf(color.r), .g = (unsigned char)roundf(color.g), .b = (unsigned char)roundf(color.b), .a = (unsigned char)roundf(color.a) }
 #define RAYLIB_VECTOR_TO_CLAY_VECTOR(v) (Clay_Vector2) { .x = v.x, .y = v.y }
 
+// A loaded font with codepoint lookup tables, so measuring and drawing text doesn't search the glyphs
+typedef struct {
+    Font font;
+    // Indexed by codepoint, codepoints at or past tableSize are looked up with GetGlyphIndex
+    int *glyphIndices;
+    int *advances; // unscaled
+    int tableSize;
+    // Atlas holds signed distance fields (FONT_SDF), drawn through a shader so one atlas suits every size
+    bool sdf;
+} Raylib_Font;
+
+// Builds the lookup tables for a font loaded with LoadFont*, which is then owned by the result
+Raylib_Font Raylib_WrapFont(Font font);
+void Raylib_UnloadFont(Raylib_Font font);
+
+// userData is the array of Raylib_Font indexed by fontId
 Clay_Dimensions Raylib_MeasureText(Clay_StringSlice text, Clay_TextElementConfig *config, void *userData);
-void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands, Font* fonts);
+void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands, Raylib_Font* fonts);
+// Redraws only what changed since the last call into a render texture kept between frames, then
+// draws that to the screen. Call between BeginDrawing and EndDrawing, in place of Clay_Raylib_Render.
+void Clay_Raylib_RenderDamaged(Clay_RenderCommandArray renderCommands, Raylib_Font* fonts, Color background);
+// Unloads the render texture, call before CloseWindow
+void Clay_Raylib_FreeDamageTracking(void);
+// True while a scroll container is being dragged or still moving from drag scroll momentum
+bool Clay_Raylib_ScrollInProgress(void);
 
 #endif // CLAY_RENDERER_RAYLIB_H
@@ -0,0 +1,377 @@
+#include "clay_renderer_software.h"
+#include "clay_utf8.h"
+
+#include "math.h"
+#include "stdbool.h"
+#include "string.h"
+
+// clay.h includes the SSE2 or NEON headers under the same conditions
+
+typedef struct {
+    unsigned char bytes[4];
+} Software_Pixel;
+
+static Software_Pixel Software_ToPixel(Clay_Color color) {
+    Software_Pixel pixel = { {
+        (unsigned char)roundf(fminf(fmaxf(color.r, 0), 255)), (unsigned char)roundf(fminf(fmaxf(color.g, 0), 255)),
+        (unsigned char)roundf(fminf(fmaxf(color.b, 0), 255)), (unsigned char)roundf(fminf(fmaxf(color.a, 0), 255)),
+    } };
+    return pixel;
+}
+
+// x/255 rounded, for x up to 255*255
+static inline unsigned Software_Div255(unsigned x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// Source over, treating the source colour as opaque with coverage `alpha`, so the destination's
+// alpha builds up the same way its colour does
+static inline void Software_BlendPixel(unsigned char *dst, Software_Pixel color, unsigned alpha) {
+    if (alpha == 0) return;
+    if (alpha == 255) {
+        dst[0] = color.bytes[0];
+        dst[1] = color.bytes[1];
+        dst[2] = color.bytes[2];
+        dst[3] = 255;
+        return;
+    }
+    unsigned inverse = 255 - alpha;
+    dst[0] = (unsigned char)Software_Div255(color.bytes[0]*alpha + dst[0]*inverse);
+    dst[1] = (unsigned char)Software_Div255(color.bytes[1]*alpha + dst[1]*inverse);
+    dst[2] = (unsigned char)Software_Div255(color.bytes[2]*alpha + dst[2]*inverse);
+    dst[3] = (unsigned char)Software_Div255(255*alpha + dst[3]*inverse);
+}
+
+// Blends `color` over `count` pixels at the colour's own alpha. Most of the canvas is filled by
+// these spans, four pixels at a time where SIMD is available.
+static void Software_BlendSpan(unsigned char *dst, int count, Software_Pixel color);
+#if !defined(CLAY_DISABLE_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64))
+    static void Software_BlendSpan(unsigned char *dst, int count, Software_Pixel color) {
+        unsigned alpha = color.bytes[3];
+        if (alpha == 0) return;
+        Software_Pixel opaque = color;
+        opaque.bytes[3] = 255;
+        int32_t packed;
+        memcpy(&packed, opaque.bytes, sizeof(packed));
+        int i = 0;
+        if (alpha == 255) {
+            __m128i fill = _mm_set1_epi32(packed);
+            for (; i + 4 <= count; i += 4) _mm_storeu_si128((__m128i *)(dst + i*4), fill);
+        } else {
+            const __m128i zero = _mm_setzero_si128();
+            // color*alpha + 128 for the rounding in Software_Div255, then blended in 16 bit lanes
+            __m128i source = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32(packed), zero), _mm_set1_epi16((short)alpha)), _mm_set1_epi16(128));
+            __m128i inverse = _mm_set1_epi16((short)(255 - alpha));
+            for (; i + 4 <= count; i += 4) {
+                __m128i pixels = _mm_loadu_si128((const __m128i *)(dst + i*4));
+                __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), inverse), source);
+                __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), inverse), source);
+                low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+                high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+                _mm_storeu_si128((__m128i *)(dst + i*4), _mm_packus_epi16(low, high));
+            }
+        }
+        for (; i < count; i++) Software_BlendPixel(dst + i*4, color, alpha);
+    }
+#elif !defined(CLAY_DISABLE_SIMD) && defined(__aarch64__)
+    static void Software_BlendSpan(unsigned char *dst, int count, Software_Pixel color) {
+        unsigned alpha = color.bytes[3];
+        if (alpha == 0) return;
+        Software_Pixel opaque = color;
+        opaque.bytes[3] = 255;
+        uint32_t packed;
+        memcpy(&packed, opaque.bytes, sizeof(packed));
+        int i = 0;
+        if (alpha == 255) {
+            uint8x16_t fill = vreinterpretq_u8_u32(vdupq_n_u32(packed));
+            for (; i + 4 <= count; i += 4) vst1q_u8(dst + i*4, fill);
+        } else {
+            uint8x8_t two = vreinterpret_u8_u32(vdup_n_u32(packed));
+            uint16x8_t source = vaddq_u16(vmull_u8(two, vdup_n_u8((uint8_t)alpha)), vdupq_n_u16(128));
+            uint8x8_t inverse = vdup_n_u8((uint8_t)(255 - alpha));
+            for (; i + 4 <= count; i += 4) {
+                uint8x16_t pixels = vld1q_u8(dst + i*4);
+                uint16x8_t low = vmlal_u8(source, vget_low_u8(pixels), inverse);
+                uint16x8_t high = vmlal_u8(source, vget_high_u8(pixels), inverse);
+                low = vaddq_u16(low, vshrq_n_u16(low, 8));
+                high = vaddq_u16(high, vshrq_n_u16(high, 8));
+                vst1q_u8(dst + i*4, vcombine_u8(vshrn_n_u16(low, 8), vshrn_n_u16(high, 8)));
+            }
+        }
+        for (; i < count; i++) Software_BlendPixel(dst + i*4, color, alpha);
+    }
+#else
+    static void Software_BlendSpan(unsigned char *dst, int count, Software_Pixel color) {
+        for (int i = 0; i < count; i++) Software_BlendPixel(dst + i*4, color, color.bytes[3]);
+    }
+#endif
+
+static Clay_Software_Rect Software_Intersect(Clay_Software_Rect a, Clay_Software_Rect b) {
+    int x0 = a.x > b.x ? a.x : b.x, y0 = a.y > b.y ? a.y : b.y;
+    int x1 = a.x + a.width < b.x + b.width ? a.x + a.width : b.x + b.width;
+    int y1 = a.y + a.height < b.y + b.height ? a.y + a.height : b.y + b.height;
+    return (Clay_Software_Rect) { x0, y0, x1 > x0 ? x1 - x0 : 0, y1 > y0 ? y1 - y0 : 0 };
+}
+
+static inline unsigned char *Software_PixelAt(Clay_Software_Canvas *canvas, int x, int y) {
+    return canvas->pixels + ((size_t)y*(size_t)canvas->width + (size_t)x)*4;
+}
+
+static void Software_FillRect(Clay_Software_Canvas *canvas, Clay_Software_Rect clip, Clay_Software_Rect rect, Software_Pixel color) {
+    rect = Software_Intersect(rect, clip);
+    if (rect.width == 0) return;
+    for (int y = rect.y; y < rect.y + rect.height; y++) {
+        Software_BlendSpan(Software_PixelAt(canvas, rect.x, y), rect.width, color);
+    }
+}
+
+static inline unsigned Software_Coverage(float coverage, unsigned alpha) {
+    if (coverage <= 0) return 0;
+    if (coverage >= 1) return alpha;
+    return (unsigned)(coverage*(float)alpha + 0.5f);
+}
+
+// How much of the pixel centred at (px, py) lies inside a circle of `radius` around (cx, cy), one
+// pixel wide ramp across the edge
+static inline float Software_CircleCoverage(float px, float py, float cx, float cy, float radius) {
+    float dx = px - cx, dy = py - cy;
+    float coverage = radius - sqrtf(dx*dx + dy*dy) + 0.5f;
+    return coverage < 0 ? 0 : coverage > 1 ? 1 : coverage;
+}
+
+static float Software_ClampRadius(float radius, Clay_Software_Rect rect) {
+    float limit = (float)(rect.width < rect.height ? rect.width : rect.height)/2.0f;
+    return radius < 0 ? 0 : radius < limit ? radius : limit;
+}
+
+// Rows between the corners are plain spans, rows through a corner have their ends antialiased
+static void Software_FillRoundedRect(Clay_Software_Canvas *canvas, Clay_Software_Rect clip, Clay_Software_Rect rect, Clay_CornerRadius cornerRadius, Software_Pixel color) {
+    Clay_Software_Rect visible = Software_Intersect(rect, clip);
+    if (visible.width == 0) return;
+    float topLeft = Software_ClampRadius(cornerRadius.topLeft, rect), topRight = Software_ClampRadius(cornerRadius.topRight, rect);
+    float bottomLeft = Software_ClampRadius(cornerRadius.bottomLeft, rect), bottomRight = Software_ClampRadius(cornerRadius.bottomRight, rect);
+    float x0 = (float)rect.x, y0 = (float)rect.y, x1 = (float)(rect.x + rect.width), y1 = (float)(rect.y + rect.height);
+    for (int y = visible.y; y < visible.y + visible.height; y++) {
+        float py = (float)y + 0.5f;
+        float leftRadius = 0, leftY = py, rightRadius = 0, rightY = py;
+        if (py < y0 + topLeft) { leftRadius = topLeft; leftY = y0 + topLeft; }
+        else if (py > y1 - bottomLeft) { leftRadius = bottomLeft; leftY = y1 - bottomLeft; }
+        if (py < y0 + topRight) { rightRadius = topRight; rightY = y0 + topRight; }
+        else if (py > y1 - bottomRight) { rightRadius = bottomRight; rightY = y1 - bottomRight; }
+        int leftEnd = rect.x + (int)ceilf(leftRadius);
+        int rightStart = rect.x + rect.width - (int)ceilf(rightRadius);
+        int spanStart = leftEnd > visible.x ? leftEnd : visible.x;
+        int spanEnd = rightStart < visible.x + visible.width ? rightStart : visible.x + visible.width;
+        for (int x = visible.x; x < visible.x + visible.width; x++) {
+            if (x >= spanStart && x < spanEnd) {
+                // Skips to the end of the span, drawn in one go
+                Software_BlendSpan(Software_PixelAt(canvas, x, y), spanEnd - x, color);
+                x = spanEnd - 1;
+                continue;
+            }
+            float px = (float)x + 0.5f, coverage = 1;
+            if (x < leftEnd && px < x0 + leftRadius) coverage *= Software_CircleCoverage(px, py, x0 + leftRadius, leftY, leftRadius);
+            if (x >= rightStart && px > x1 - rightRadius) coverage *= Software_CircleCoverage(px, py, x1 - rightRadius, rightY, rightRadius);
+            Software_BlendPixel(Software_PixelAt(canvas, x, y), color, Software_Coverage(coverage, color.bytes[3]));
+        }
+    }
+}
+
+// The quarter ring between `innerRadius` and `radius` around (cx, cy), on the side given by the signs
+static void Software_FillCornerRing(Clay_Software_Canvas *canvas, Clay_Software_Rect clip, float cx, float cy, float radius, float innerRadius, int signX, int signY, Software_Pixel color) {
+    int extent = (int)ceilf(radius);
+    Clay_Software_Rect square = {
+        signX < 0 ? (int)floorf(cx) - extent : (int)floorf(cx), signY < 0 ? (int)floorf(cy) - extent : (int)floorf(cy),
+        extent + 1, extent + 1,
+    };
+    square = Software_Intersect(square, clip);
+    for (int y = square.y; y < square.y + square.height; y++) {
+        float py = (float)y + 0.5f;
+        if ((py - cy)*(float)signY < 0) continue;
+        for (int x = square.x; x < square.x + square.width; x++) {
+            float px = (float)x + 0.5f;
+            if ((px - cx)*(float)signX < 0) continue;
+            float coverage = Software_CircleCoverage(px, py, cx, cy, radius);
+            if (innerRadius > 0) coverage -= Software_CircleCoverage(px, py, cx, cy, innerRadius);
+            Software_BlendPixel(Software_PixelAt(canvas, x, y), color, Software_Coverage(coverage, color.bytes[3]));
+        }
+    }
+}
+
+static void Software_DrawBorder(Clay_Software_Canvas *canvas, Clay_Software_Rect clip, Clay_BoundingBox box, const Clay_BorderRenderData *border) {
+    Software_Pixel color = Software_ToPixel(border->color);
+    Clay_CornerRadius radius = border->cornerRadius;
+    if (border->width.left > 0) {
+        Software_FillRect(canvas, clip, (Clay_Software_Rect) { (int)roundf(box.x), (int)roundf(box.y + radius.topLeft), (int)border->width.left, (int)roundf(box.height - radius.topLeft - radius.bottomLeft) }, color);
+    }
+    if (border->width.right > 0) {
+        Software_FillRect(canvas, clip, (Clay_Software_Rect) { (int)roundf(box.x + box.width - border->width.right), (int)roundf(box.y + radius.topRight), (int)border->width.right, (int)roundf(box.height - radius.topRight - radius.bottomRight) }, color);
+    }
+    if (border->width.top > 0) {
+        Software_FillRect(canvas, clip, (Clay_Software_Rect) { (int)roundf(box.x + radius.topLeft), (int)roundf(box.y), (int)roundf(box.width - radius.topLeft - radius.topRight), (int)border->width.top }, color);
+    }
+    if (border->width.bottom > 0) {
+        Software_FillRect(canvas, clip, (Clay_Software_Rect) { (int)roundf(box.x + radius.bottomLeft), (int)roundf(box.y + box.height - border->width.bottom), (int)roundf(box.width - radius.bottomLeft - radius.bottomRight), (int)border->width.bottom }, color);
+    }
+    // Same corners and widths as the raylib renderer
+    if (radius.topLeft > 0 && border->width.top > 0) {
+        Software_FillCornerRing(canvas, clip, roundf(box.x + radius.topLeft), roundf(box.y + radius.topLeft), radius.topLeft, radius.topLeft - border->width.top, -1, -1, color);
+    }
+    if (radius.topRight > 0 && border->width.top > 0) {
+        Software_FillCornerRing(canvas, clip, roundf(box.x + box.width - radius.topRight), roundf(box.y + radius.topRight), radius.topRight, radius.topRight - border->width.top, 1, -1, color);
+    }
+    if (radius.bottomLeft > 0 && border->width.bottom > 0) {
+        Software_FillCornerRing(canvas, clip, roundf(box.x + radius.bottomLeft), roundf(box.y + box.height - radius.bottomLeft), radius.bottomLeft, radius.bottomLeft - border->width.bottom, -1, 1, color);
+    }
+    if (radius.bottomRight > 0 && border->width.bottom > 0) {
+        Software_FillCornerRing(canvas, clip, roundf(box.x + box.width - radius.bottomRight), roundf(box.y + box.height - radius.bottomRight), radius.bottomRight, radius.bottomRight - border->width.bottom, 1, 1, color);
+    }
+}
+
+static void Software_DrawText(Clay_Software_Canvas *canvas, Clay_Software_Rect clip, Clay_BoundingBox box, const Clay_TextRenderData *text, const Clay_Software_Resources *resources) {
+    if (!resources || !resources->getGlyph) return;
+    Software_Pixel color = Software_ToPixel(text->textColor);
+    float penX = 0, penY = 0;
+    for (int i = 0; i < text->stringContents.length;) {
+        int codepointSize = 0;
+        int codepoint = Clay_DecodeCodepoint(text->stringContents.chars + i, text->stringContents.length - i, &codepointSize);
+        i += codepointSize;
+        if (codepoint == '\n') {
+            // raylib's default line spacing, see SetTextLineSpacing
+            penY += (float)text->fontSize + 2;
+            penX = 0;
+            continue;
+        }
+        const Clay_Software_Glyph *glyph = resources->getGlyph(text->fontId, text->fontSize, codepoint, resources->userData);
+        if (!glyph) continue;
+        int left = (int)floorf(box.x + penX) + glyph->offsetX, top = (int)floorf(box.y + penY) + glyph->offsetY;
+        Clay_Software_Rect area = Software_Intersect((Clay_Software_Rect) { left, top, glyph->width, glyph->height }, clip);
+        for (int y = area.y; y < area.y + area.height; y++) {
+            const unsigned char *coverage = glyph->alpha + (size_t)(y - top)*(size_t)glyph->width + (area.x - left);
+            unsigned char *dst = Software_PixelAt(canvas, area.x, y);
+            for (int x = 0; x < area.width; x++) {
+                Software_BlendPixel(dst + x*4, color, Software_Div255(coverage[x]*color.bytes[3]));
+            }
+        }
+        penX += (float)(glyph->advanceX ? glyph->advanceX : glyph->width) + (float)text->letterSpacing;
+    }
+}
+
+// Nearest neighbour, tinted like DrawTextureEx
+static void Software_DrawImage(Clay_Software_Canvas *canvas, Clay_Software_Rect clip, Clay_BoundingBox box, const Clay_ImageRenderData *image, const Clay_Software_Resources *resources) {
+    if (!resources || !resources->getImage) return;
+    const Clay_Software_Canvas *source = resources->getImage(image->imageData, resources->userData);
+    if (!source || source->width == 0 || source->height == 0) return;
+    Clay_Color tint = image->backgroundColor;
+    if (tint.r == 0 && tint.g == 0 && tint.b == 0 && tint.a == 0) {
+        tint = (Clay_Color) { 255, 255, 255, 255 };
+    }
+    Software_Pixel multiply = Software_ToPixel(tint);
+    // Scaled to the box's width, keeping the aspect ratio, as the raylib renderer does
+    float scale = box.width/(float)source->width;
+    Clay_Software_Rect rect = { (int)roundf(box.x), (int)roundf(box.y), (int)roundf(box.width), (int)roundf((float)source->height*scale) };
+    Clay_Software_Rect area = Software_Intersect(rect, clip);
+    for (int y = area.y; y < area.y + area.height; y++) {
+        int sourceY = (int)(((float)(y - rect.y) + 0.5f)/scale);
+        if (sourceY >= source->height) sourceY = source->height - 1;
+        unsigned char *dst = Software_PixelAt(canvas, area.x, y);
+        for (int x = 0; x < area.width; x++) {
+            int sourceX = (int)(((float)(x + area.x - rect.x) + 0.5f)/scale);
+            if (sourceX >= source->width) sourceX = source->width - 1;
+            const unsigned char *pixel = source->pixels + ((size_t)sourceY*(size_t)source->width + (size_t)sourceX)*4;
+            Software_Pixel color = { {
+                (unsigned char)Software_Div255(pixel[0]*multiply.bytes[0]), (unsigned char)Software_Div255(pixel[1]*multiply.bytes[1]),
+                (unsigned char)Software_Div255(pixel[2]*multiply.bytes[2]), 255,
+            } };
+            Software_BlendPixel(dst + x*4, color, Software_Div255(pixel[3]*multiply.bytes[3]));
+        }
+    }
+}
+
+void Clay_Software_Clear(Clay_Software_Canvas *canvas, Clay_Software_Rect rect, Clay_Color color) {
+    rect = Software_Intersect(rect, (Clay_Software_Rect) { 0, 0, canvas->width, canvas->height });
+    Software_Pixel pixel = Software_ToPixel(color);
+    for (int y = rect.y; y < rect.y + rect.height; y++) {
+        unsigned char *dst = Software_PixelAt(canvas, rect.x, y);
+        for (int x = 0; x < rect.width; x++) memcpy(dst + x*4, pixel.bytes, 4);
+    }
+}
+
+static bool Software_Overlaps(Clay_BoundingBox box, Clay_Software_Rect rect) {
+    return box.x < (float)(rect.x + rect.width) && (float)rect.x < box.x + box.width
+        && box.y < (float)(rect.y + rect.height) && (float)rect.y < box.y + box.height;
+}
+
+void Clay_Software_RenderTile(Clay_Software_Canvas *canvas, Clay_RenderCommandArray renderCommands, const Clay_Software_Resources *resources, Clay_Software_Rect tile) {
+    tile = Software_Intersect(tile, (Clay_Software_Rect) { 0, 0, canvas->width, canvas->height });
+    if (tile.width == 0) return;
+    Clay_Software_Rect clip = tile;
+    for (int j = 0; j < renderCommands.length; j++) {
+        Clay_RenderCommand *renderCommand = Clay_RenderCommandArray_Get(&renderCommands, j);
+        Clay_BoundingBox boundingBox = renderCommand->boundingBox;
+        switch (renderCommand->commandType) {
+            case CLAY_RENDER_COMMAND_TYPE_SCISSOR_START: {
+                Clay_Software_Rect scissor = { (int)roundf(boundingBox.x), (int)roundf(boundingBox.y), (int)roundf(boundingBox.width), (int)roundf(boundingBox.height) };
+                clip = Software_Intersect(scissor, tile);
+                break;
+            }
+            case CLAY_RENDER_COMMAND_TYPE_SCISSOR_END: {
+                clip = tile;
+                break;
+            }
+            case CLAY_RENDER_COMMAND_TYPE_RECTANGLE: {
+                if (!Software_Overlaps(boundingBox, clip)) break;
+                Clay_RectangleRenderData *config = &renderCommand->renderData.rectangle;
+                Software_Pixel color = Software_ToPixel(config->backgroundColor);
+                // Truncated to whole pixels, as DrawRectangle would
+                Clay_Software_Rect rect = { (int)boundingBox.x, (int)boundingBox.y, (int)boundingBox.width, (int)boundingBox.height };
+                if (config->cornerRadius.topLeft > 0 || config->cornerRadius.topRight > 0 || config->cornerRadius.bottomLeft > 0 || config->cornerRadius.bottomRight > 0) {
+                    Software_FillRoundedRect(canvas, clip, rect, config->cornerRadius, color);
+                } else {
+                    Software_FillRect(canvas, clip, rect, color);
+                }
+                break;
+            }
+            case CLAY_RENDER_COMMAND_TYPE_BORDER: {
+                if (!Software_Overlaps(boundingBox, clip)) break;
+                Software_DrawBorder(canvas, clip, boundingBox, &renderCommand->renderData.border);
+                break;
+            }
+            case CLAY_RENDER_COMMAND_TYPE_TEXT: {
+                // Glyphs can hang past the box, so only commands well clear of the tile are skipped
+                Clay_BoundingBox padded = { boundingBox.x - boundingBox.height, boundingBox.y - boundingBox.height, boundingBox.width + 2*boundingBox.height, 3*boundingBox.height };
+                if (!Software_Overlaps(padded, clip)) break;
+                Software_DrawText(canvas, clip, boundingBox, &renderCommand->renderData.text, resources);
+                break;
+            }
+            case CLAY_RENDER_COMMAND_TYPE_IMAGE: {
+                if (!Software_Overlaps(boundingBox, clip)) break;
+                Software_DrawImage(canvas, clip, boundingBox, &renderCommand->renderData.image, resources);
+                break;
+            }
+            // Custom elements are the raylib renderer's 3D models, which can't be drawn here
+            default:
+                break;
+        }
+    }
+}
+
+void Clay_Software_Render(Clay_Software_Canvas *canvas, Clay_RenderCommandArray renderCommands, const Clay_Software_Resources *resources) {
+    Clay_Software_RenderTile(canvas, renderCommands, resources, (Clay_Software_Rect) { 0, 0, canvas->width, canvas->height });
+}
+
+void Clay_Software_PrepareGlyphs(Clay_RenderCommandArray renderCommands, const Clay_Software_Resources *resources) {
+    if (!resources || !resources->getGlyph) return;
+    for (int j = 0; j < renderCommands.length; j++) {
+        Clay_RenderCommand *renderCommand = Clay_RenderCommandArray_Get(&renderCommands, j);
+        if (renderCommand->commandType != CLAY_RENDER_COMMAND_TYPE_TEXT) continue;
+        Clay_TextRenderData *text = &renderCommand->renderData.text;
+        for (int i = 0; i < text->stringContents.length;) {
+            int codepointSize = 0;
+            int codepoint = Clay_DecodeCodepoint(text->stringContents.chars + i, text->stringContents.length - i, &codepointSize);
+            i += codepointSize;
+            if (codepoint != '\n') resources->getGlyph(text->fontId, text->fontSize, codepoint, resources->userData);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef CLAY_RENDERER_SOFTWARE_H
+#define CLAY_RENDERER_SOFTWARE_H
+
+#include <stdint.h>
+#include "clay.h"
+
+// Draws Clay render commands into an RGBA buffer on the CPU, for rendering without a GL context.
+// Glyphs and images come from the caller through Clay_Software_Resources, so this file needs no
+// font or image library. Geometry follows Clay_Raylib_Render, but edges of rounded corners are
+// antialiased by coverage rather than tessellated.
+
+typedef struct {
+    unsigned char *pixels; // RGBA, 4 bytes per pixel, rows packed
+    int width;
+    int height;
+} Clay_Software_Canvas;
+
+typedef struct {
+    int x, y, width, height;
+} Clay_Software_Rect;
+
+// A glyph's coverage, one byte per pixel, drawn with its top left at the pen plus the offset
+typedef struct {
+    const unsigned char *alpha;
+    int width;
+    int height;
+    int offsetX;
+    int offsetY;
+    int advanceX;
+} Clay_Software_Glyph;
+
+typedef struct {
+    // Returns NULL for codepoints the font can't draw. Tiled rendering looks glyphs up from several
+    // threads, so it calls Clay_Software_PrepareGlyphs first and the lookups must be read only after.
+    const Clay_Software_Glyph *(*getGlyph)(uint16_t fontId, uint16_t fontSize, int codepoint, void *userData);
+    // Optional, returns the pixels of an image command's imageData, or NULL to skip it
+    const Clay_Software_Canvas *(*getImage)(void *imageData, void *userData);
+    void *userData;
+} Clay_Software_Resources;
+
+void Clay_Software_Clear(Clay_Software_Canvas *canvas, Clay_Software_Rect rect, Clay_Color color);
+
+// Draws every command over the whole canvas, without clearing it first
+void Clay_Software_Render(Clay_Software_Canvas *canvas, Clay_RenderCommandArray renderCommands, const Clay_Software_Resources *resources);
+
+// Draws only the pixels inside `tile`. Tiles that don't overlap can be drawn on different threads.
+void Clay_Software_RenderTile(Clay_Software_Canvas *canvas, Clay_RenderCommandArray renderCommands, const Clay_Software_Resources *resources, Clay_Software_Rect tile);
+
+// Looks up every glyph the commands use, so they're loaded before rendering tiles in parallel
+void Clay_Software_PrepareGlyphs(Clay_RenderCommandArray renderCommands, const Clay_Software_Resources *resources);
+
+#endif // CLAY_RENDERER_SOFTWARE_H
@@ -0,0 +1,24 @@
+#ifndef CLAY_UTF8_H
+#define CLAY_UTF8_H
+
+// Decodes the UTF-8 codepoint at the start of text, without reading past length bytes, since Clay's
+// string slices aren't terminated. Invalid or truncated sequences decode to '?' and consume one byte,
+// like raylib's GetCodepointNext.
+static inline int Clay_DecodeCodepoint(const char *text, int length, int *codepointSize) {
+    const unsigned char *ptr = (const unsigned char *)text;
+    int size = 1;
+    int codepoint = ptr[0];
+    if (ptr[0] >= 0xf0 && ptr[0] < 0xf8) { size = 4; codepoint = ptr[0] & 0x07; }
+    else if (ptr[0] >= 0xe0 && ptr[0] < 0xf0) { size = 3; codepoint = ptr[0] & 0x0f; }
+    else if (ptr[0] >= 0xc0 && ptr[0] < 0xe0) { size = 2; codepoint = ptr[0] & 0x1f; }
+    else if (ptr[0] >= 0x80) { *codepointSize = 1; return '?'; }
+    if (size > length) { *codepointSize = 1; return '?'; }
+    for (int i = 1; i < size; i++) {
+        if ((ptr[i] & 0xc0) != 0x80) { *codepointSize = 1; return '?'; }
+        codepoint = (codepoint << 6) | (ptr[i] & 0x3f);
+    }
+    *codepointSize = size;
+    return codepoint;
+}
+
+#endif // CLAY_UTF8_H
@@ -1,154 +1,306 @@
-#include <inttypes.h>
+#include <assert.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "clay.h"
 #include "clay_enum_names.h"
 #include "export_layout.h"
 #include "ui_element.h"
+#include "utilities.h"
+
+// The whole file is built in memory and written with a single fwrite, formatting numbers by hand
+// rather than through a printf call per field
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} export_writer_t;
+
+static char* writer_reserve(export_writer_t* w, size_t size)
+{
+    if (w->length + size > w->capacity) {
+        size_t capacity = w->capacity ? w->capacity : 4096;
+        while (capacity < w->length + size) {
+            capacity *= 2;
+        }
+        REALLOC_ASSERT(w->data, capacity);
+        w->capacity = capacity;
+    }
+    return w->data + w->length;
+}
+
+static void write_chars(export_writer_t* w, const char* s, size_t length)
+{
+    // empty strings may have no characters at all
+    if (length == 0) return;
+    memcpy(writer_reserve(w, length), s, length);
+    w->length += length;
+}
+
+static void write_str(export_writer_t* w, const char* s)
+{
+    write_chars(w, s, strlen(s));
+}
+
+static void write_indent(export_writer_t* w, int depth)
+{
+    size_t length = 4 * (size_t) depth;
+    if (length == 0) return;
+    memset(writer_reserve(w, length), ' ', length);
+    w->length += length;
+}
+
+static void write_uint(export_writer_t* w, uint64_t value)
+{
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[sizeof(digits) - ++n] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value);
+    write_chars(w, digits + sizeof(digits) - n, n);
+}
+
+static void write_int(export_writer_t* w, int64_t value)
+{
+    if (value < 0) {
+        write_chars(w, "-", 1);
+        write_uint(w, -(uint64_t) value);
+    } else {
+        write_uint(w, (uint64_t) value);
+    }
+}
+
+// Like printf's "%.<decimals>f", for up to 3 decimals, except that negative zero loses its sign
+static void write_float(export_writer_t* w, float value, int decimals)
+{
+    static const uint64_t scales[] = { 1, 10, 100, 1000 };
+    assert(decimals >= 0 && decimals < (int) numberof(scales));
+    double scaled = (value < 0 ? -(double) value : (double) value) * (double) scales[decimals];
+    if (!(scaled < 1e18)) {
+        // Infinite, NaN, or too large to round in an integer
+        char s[64];
+        int length = snprintf(s, sizeof(s), "%.*f", decimals, value);
+        write_chars(w, s, (size_t) length < sizeof(s) ? (size_t) length : sizeof(s) - 1);
+        return;
+    }
+    // A float times at most 1000 is exact as a double, so ties round to even as printf does
+    uint64_t units = (uint64_t) scaled;
+    double remainder = scaled - (double) units;
+    if (remainder > 0.5 || (remainder == 0.5 && units % 2)) {
+        units++;
+    }
+    if (value < 0 && units) {
+        write_chars(w, "-", 1);
+    }
+    write_uint(w, units / scales[decimals]);
+    if (decimals) {
+        char fraction[4] = { '.' };
+        uint64_t rest = units % scales[decimals];
+        for (int i = decimals; i > 0; --i) {
+            fraction[i] = (char) ('0' + rest % 10);
+            rest /= 10;
+        }
+        write_chars(w, fraction, (size_t) decimals + 1);
+    }
+}
 
 static uint8_t zero[sizeof(Clay_ElementDeclaration)] = { 0 };
 #define IS_NON_ZERO(region) memcmp(&(region), zero, sizeof(region))
 #define IS_DIFFERENT(field)                                                                        \
     (node->on_hover.enabled && memcmp(&(d->field), &(oh->field), sizeof(d->field)))
-#define EXPORT_FIELD(field)                                                                        \
-    if (IS_NON_ZERO(d->field) || IS_DIFFERENT(field)) {                                            \
-        fprintf(f, "." #field " = ");                                                              \
+#define EXPORT_VALUE(field)                                                                        \
+    do {                                                                                           \
+        write_str(w, "." #field " = ");                                                            \
         if (IS_DIFFERENT(field)) {                                                                 \
-            fprintf(f, "Clay_Hovered() ? ");                                                       \
-            export_clay_##field(f, oh->field);                                                     \
-            fprintf(f, " : ");                                                                     \
+            write_str(w, "Clay_Hovered() ? ");                                                     \
+            export_clay_##field(w, oh->field);                                                     \
+            write_str(w, " : ");                                                                   \
         }                                                                                          \
-        export_clay_##field(f, d->field);                                                          \
-        fprintf(f, ", ");                                                                          \
+        export_clay_##field(w, d->field);                                                          \
+    } while (0)
+// A field written inline, within the braces of its parent
+#define EXPORT_FIELD(field)                                                                        \
+    if (IS_NON_ZERO(d->field) || IS_DIFFERENT(field)) {                                            \
+        EXPORT_VALUE(field);                                                                       \
+        write_str(w, ", ");                                                                        \
+    }
+// A field of the element declaration, written on its own line
+#define EXPORT_LINE(field, depth)                                                                  \
+    if (IS_NON_ZERO(d->field) || IS_DIFFERENT(field)) {                                            \
+        write_indent(w, depth);                                                                    \
+        EXPORT_VALUE(field);                                                                       \
+        write_str(w, ",\n");                                                                       \
     }
 
-static void export_clay_sizing(FILE* f, Clay_Sizing s)
+static void export_clay_sizing_axis(export_writer_t* w, Clay_SizingAxis a)
+{
+    write_str(w, _Clay__SizingType_Extra_Macros[a.type]);
+    write_str(w, "(");
+    write_float(w, a.size.percent, 3);
+    write_str(w, ")");
+}
+
+static void export_clay_sizing(export_writer_t* w, Clay_Sizing s)
 {
-    fprintf(f, "{ ");
+    write_str(w, "{ ");
     if (IS_NON_ZERO(s.width)) {
-        fprintf(f, ".width = %s(%.3f), ",
-            _Clay__SizingType_Extra_Macros[s.width.type],
-            s.width.size.percent);
+        write_str(w, ".width = ");
+        export_clay_sizing_axis(w, s.width);
+        write_str(w, ", ");
     }
     if (IS_NON_ZERO(s.height)) {
-        fprintf(f, ".height = %s(%.3f) ",
-            _Clay__SizingType_Extra_Macros[s.height.type],
-            s.height.size.percent);
+        write_str(w, ".height = ");
+        export_clay_sizing_axis(w, s.height);
+        write_str(w, " ");
     }
-    fprintf(f, "}");
+    write_str(w, "}");
 }
 
-static void export_clay_padding(FILE* f, Clay_Padding p)
+static void export_clay_padding(export_writer_t* w, Clay_Padding p)
 {
-    fprintf(f, "(Clay_Padding) { %" PRIu16 ", %" PRIu16 ", %" PRIu16 ", %" PRIu16 " }", p.left,
-        p.right, p.top, p.bottom);
+    write_str(w, "(Clay_Padding) { ");
+    write_uint(w, p.left);
+    write_str(w, ", ");
+    write_uint(w, p.right);
+    write_str(w, ", ");
+    write_uint(w, p.top);
+    write_str(w, ", ");
+    write_uint(w, p.bottom);
+    write_str(w, " }");
 }
 
-static void export_clay_childGap(FILE* f, uint16_t gap)
+static void export_clay_childGap(export_writer_t* w, uint16_t gap)
 {
-    fprintf(f, "%" PRIu16, gap);
+    write_uint(w, gap);
 }
 
-static void export_clay_childAlignment(FILE* f, Clay_ChildAlignment a)
+static void export_clay_childAlignment(export_writer_t* w, Clay_ChildAlignment a)
 {
-    fprintf(f, "{ ");
+    write_str(w, "{ ");
     if (a.x) {
-        fprintf(f, ".x = %s, ", CLAY_ENUM_VALUE_MACRO(Clay_LayoutAlignmentX, a.x));
+        write_str(w, ".x = ");
+        write_str(w, CLAY_ENUM_VALUE_MACRO(Clay_LayoutAlignmentX, a.x));
+        write_str(w, ", ");
     }
     if (a.y) {
-        fprintf(f, ".y = %s, ", CLAY_ENUM_VALUE_MACRO(Clay_LayoutAlignmentY, a.y));
+        write_str(w, ".y = ");
+        write_str(w, CLAY_ENUM_VALUE_MACRO(Clay_LayoutAlignmentY, a.y));
+        write_str(w, ", ");
     }
-    fprintf(f, "}");
+    write_str(w, "}");
 }
 
-static void export_clay_layoutDirection(FILE* f, Clay_LayoutDirection d)
+static void export_clay_layoutDirection(export_writer_t* w, Clay_LayoutDirection d)
 {
-    fprintf(f, "%s", _Clay_LayoutDirection_Macros[d]);
+    write_str(w, _Clay_LayoutDirection_Macros[d]);
 }
 
-static void export_clay_layout(FILE* f, ui_element_t* node)
+static void export_clay_layout(export_writer_t* w, ui_element_t* node)
 {
     Clay_LayoutConfig* d = &node->ptr->layout;
     Clay_LayoutConfig* oh = &node->on_hover.ptr->layout;
-    fprintf(f, ".layout = { ");
+    write_str(w, ".layout = { ");
     EXPORT_FIELD(sizing);
     EXPORT_FIELD(padding);
     EXPORT_FIELD(childGap);
     EXPORT_FIELD(childAlignment);
     EXPORT_FIELD(layoutDirection);
-    fprintf(f, "}, ");
+    write_str(w, "}");
 }
 
-static void export_clay_cornerRadius(FILE* f, Clay_CornerRadius r)
+static void export_clay_cornerRadius(export_writer_t* w, Clay_CornerRadius r)
 {
     if (r.bottomLeft == r.bottomRight &&
         r.topLeft == r.topRight &&
         r.bottomLeft == r.topLeft) {
-        fprintf(f, "CLAY_CORNER_RADIUS(%.1f)", r.bottomLeft);
+        write_str(w, "CLAY_CORNER_RADIUS(");
+        write_float(w, r.bottomLeft, 1);
+        write_str(w, ")");
     } else {
-        fprintf(f, "(Clay_CornerRadius) { %.1f,  %.1f,  %.1f,  %.1f }",
-            r.topLeft, r.topRight, r.bottomLeft, r.bottomRight);
+        write_str(w, "(Clay_CornerRadius) { ");
+        write_float(w, r.topLeft, 1);
+        write_str(w, ",  ");
+        write_float(w, r.topRight, 1);
+        write_str(w, ",  ");
+        write_float(w, r.bottomLeft, 1);
+        write_str(w, ",  ");
+        write_float(w, r.bottomRight, 1);
+        write_str(w, " }");
     }
 }
 
-static void export_clay_offset(FILE* f, Clay_Vector2 o)
+static void export_clay_offset(export_writer_t* w, Clay_Vector2 o)
 {
-    fprintf(f, "{ ");
+    write_str(w, "{ ");
     if (o.x) {
-        fprintf(f, ".x = %.3f, ", o.x);
+        write_str(w, ".x = ");
+        write_float(w, o.x, 3);
+        write_str(w, ", ");
     }
     if (o.y) {
-        fprintf(f, ".y = %.3f ", o.y);
+        write_str(w, ".y = ");
+        write_float(w, o.y, 3);
+        write_str(w, " ");
     }
-    fprintf(f, "}");
+    write_str(w, "}");
 }
 
-static void export_clay_expand(FILE* f, Clay_Dimensions d)
+static void export_clay_expand(export_writer_t* w, Clay_Dimensions d)
 {
-    fprintf(f, "{ ");
-    if (d.width)
-        fprintf(f, ".width = %.3f, ", d.width);
-    if (d.height)
-        fprintf(f, ".height = %.3f ", d.height);
-    fprintf(f, "}");
+    write_str(w, "{ ");
+    if (d.width) {
+        write_str(w, ".width = ");
+        write_float(w, d.width, 3);
+        write_str(w, ", ");
+    }
+    if (d.height) {
+        write_str(w, ".height = ");
+        write_float(w, d.height, 3);
+        write_str(w, " ");
+    }
+    write_str(w, "}");
 }
 
-static void export_clay_zIndex(FILE* f, int16_t index)
+static void export_clay_zIndex(export_writer_t* w, int16_t index)
 {
-    fprintf(f, "%hd", index);
+    write_int(w, index);
 }
 
-static void export_clay_attachPoints(FILE* f, Clay_FloatingAttachPoints p)
+static void export_clay_attachPoints(export_writer_t* w, Clay_FloatingAttachPoints p)
 {
-    fprintf(f, "{ ");
+    write_str(w, "{ ");
     if (p.element) {
-        fprintf(
-            f, ".element = %s, ", CLAY_ENUM_VALUE_MACRO(Clay_FloatingAttachPointType, p.element));
+        write_str(w, ".element = ");
+        write_str(w, CLAY_ENUM_VALUE_MACRO(Clay_FloatingAttachPointType, p.element));
+        write_str(w, ", ");
     }
     if (p.parent) {
-        fprintf(
-            f, ".parent = %s, ", CLAY_ENUM_VALUE_MACRO(Clay_FloatingAttachPointType, p.parent));
+        write_str(w, ".parent = ");
+        write_str(w, CLAY_ENUM_VALUE_MACRO(Clay_FloatingAttachPointType, p.parent));
+        write_str(w, ", ");
     }
-    fprintf(f, "}");
+    write_str(w, "}");
 }
 
-static void export_clay_pointerCaptureMode(FILE* f, Clay_PointerCaptureMode m)
+static void export_clay_pointerCaptureMode(export_writer_t* w, Clay_PointerCaptureMode m)
 {
-    fprintf(f, "%s", CLAY_ENUM_VALUE_MACRO(Clay_PointerCaptureMode, m));
+    write_str(w, CLAY_ENUM_VALUE_MACRO(Clay_PointerCaptureMode, m));
 }
 
-static void export_clay_attachTo(FILE* f, Clay_FloatingAttachToElement a)
+static void export_clay_attachTo(export_writer_t* w, Clay_FloatingAttachToElement a)
 {
-    fprintf(f, "%s", CLAY_ENUM_VALUE_MACRO(Clay_FloatingAttachToElement, a));
+    write_str(w, CLAY_ENUM_VALUE_MACRO(Clay_FloatingAttachToElement, a));
 }
 
-static void export_clay_floating(FILE* f, ui_element_t* node)
+static void export_clay_floating(export_writer_t* w, ui_element_t* node)
 {
     Clay_FloatingElementConfig* d = &node->ptr->floating;
     Clay_FloatingElementConfig* oh = &node->on_hover.ptr->floating;
-    fprintf(f, ".floating = { ");
+    write_str(w, ".floating = { ");
     EXPORT_FIELD(offset);
     EXPORT_FIELD(expand);
     // TODO: parentId
@@ -156,127 +308,194 @@ static void export_clay_floating(FILE* f, ui_element_t* node)
     EXPORT_FIELD(attachPoints);
     EXPORT_FIELD(pointerCaptureMode);
     EXPORT_FIELD(attachTo);
-    fprintf(f, "}, ");
+    write_str(w, "}");
 }
 
-static void export_clay_color(FILE* f, Clay_Color c)
+static void export_clay_color(export_writer_t* w, Clay_Color c)
 {
-    fprintf(f, "(Clay_Color) { %.0f, %.0f, %.0f, %.0f }", c.r, c.g, c.b, c.a);
+    write_str(w, "(Clay_Color) { ");
+    write_float(w, c.r, 0);
+    write_str(w, ", ");
+    write_float(w, c.g, 0);
+    write_str(w, ", ");
+    write_float(w, c.b, 0);
+    write_str(w, ", ");
+    write_float(w, c.a, 0);
+    write_str(w, " }");
 }
 
-static void export_clay_width(FILE* f, Clay_BorderWidth w)
+static void export_clay_width(export_writer_t* w, Clay_BorderWidth b)
 {
-    if (w.left == w.right && w.top == w.bottom && w.left == w.top) {
-        if (w.betweenChildren == w.left) {
-            fprintf(f, "CLAY_BORDER_ALL(%" PRIu16 ")", w.left);
-        } else if (w.betweenChildren == 0) {
-            fprintf(f, "CLAY_BORDER_OUTSIDE(%" PRIu16 ")", w.left);
-        } else
-            goto print_all;
-    } else {
-    print_all:
-        fprintf(f,
-            "{ .left = %" PRIu16 ", .right = %" PRIu16 ", .top = %" PRIu16 ", .bottom = %" PRIu16
-            ", .betweenChildren = %" PRIu16 " }",
-            w.left, w.right, w.top, w.bottom, w.betweenChildren);
+    if (b.left == b.right && b.top == b.bottom && b.left == b.top) {
+        if (b.betweenChildren == b.left) {
+            write_str(w, "CLAY_BORDER_ALL(");
+            write_uint(w, b.left);
+            write_str(w, ")");
+            return;
+        } else if (b.betweenChildren == 0) {
+            write_str(w, "CLAY_BORDER_OUTSIDE(");
+            write_uint(w, b.left);
+            write_str(w, ")");
+            return;
+        }
     }
+    write_str(w, "{ .left = ");
+    write_uint(w, b.left);
+    write_str(w, ", .right = ");
+    write_uint(w, b.right);
+    write_str(w, ", .top = ");
+    write_uint(w, b.top);
+    write_str(w, ", .bottom = ");
+    write_uint(w, b.bottom);
+    write_str(w, ", .betweenChildren = ");
+    write_uint(w, b.betweenChildren);
+    write_str(w, " }");
 }
 
-static void export_clay_border(FILE* f, ui_element_t* node)
+static void export_clay_border(export_writer_t* w, ui_element_t* node)
 {
     Clay_BorderElementConfig* d = &node->ptr->border;
     Clay_BorderElementConfig* oh = &node->on_hover.ptr->border;
-    fprintf(f, ".border = { ");
+    write_str(w, ".border = { ");
     EXPORT_FIELD(color);
     EXPORT_FIELD(width);
-    fprintf(f, "}, ");
+    write_str(w, "}");
 }
 
-static void export_clay_backgroundColor(FILE* f, Clay_Color c)
+static void export_clay_backgroundColor(export_writer_t* w, Clay_Color c)
 {
-    fprintf(f, "(Clay_Color) { %.0f, %.0f, %.0f, %.0f }", c.r, c.g, c.b, c.a);
+    export_clay_color(w, c);
 }
 
-static void export_clay_scroll(FILE* f, Clay_ScrollElementConfig s)
+static void export_clay_scroll(export_writer_t* w, Clay_ScrollElementConfig s)
 {
-    fprintf(f, "{ ");
+    write_str(w, "{ ");
     if (s.horizontal)
-        fprintf(f, ".horizontal = true, ");
+        write_str(w, ".horizontal = true, ");
     if (s.vertical)
-        fprintf(f, ".vertical = true ");
-    fprintf(f, "}");
+        write_str(w, ".vertical = true ");
+    write_str(w, "}");
 }
 
-static void export_clay_declaration(FILE* f, ui_element_t* node)
+// Writes each field on its own line, indented one level deeper than the element
+static void export_clay_declaration(export_writer_t* w, ui_element_t* node, int depth)
 {
     Clay_ElementDeclaration* d = node->ptr;
     Clay_ElementDeclaration* oh = node->on_hover.ptr;
     if (d->id.stringId.length) {
-        fprintf(f, ".id = CLAY_ID(\"%.*s\"), ", d->id.stringId.length, d->id.stringId.chars);
+        write_indent(w, depth + 1);
+        write_str(w, ".id = CLAY_ID(\"");
+        write_chars(w, d->id.stringId.chars, (size_t) d->id.stringId.length);
+        write_str(w, "\"),\n");
     }
     if (IS_NON_ZERO(d->layout)) {
-        export_clay_layout(f, node);
+        write_indent(w, depth + 1);
+        export_clay_layout(w, node);
+        write_str(w, ",\n");
     }
-    EXPORT_FIELD(backgroundColor);
-    EXPORT_FIELD(cornerRadius);
+    EXPORT_LINE(backgroundColor, depth + 1);
+    EXPORT_LINE(cornerRadius, depth + 1);
     if (IS_NON_ZERO(d->floating)) {
-        export_clay_floating(f, node);
+        write_indent(w, depth + 1);
+        export_clay_floating(w, node);
+        write_str(w, ",\n");
     }
     // TODO: custom ?
-    EXPORT_FIELD(scroll);
+    EXPORT_LINE(scroll, depth + 1);
     if (IS_NON_ZERO(d->border.width)) {
-        export_clay_border(f, node);
+        write_indent(w, depth + 1);
+        export_clay_border(w, node);
+        write_str(w, ",\n");
     }
 }
 
-static void export_clay_text(FILE* f, Clay_String s, Clay_TextElementConfig* c)
+static void export_clay_text(export_writer_t* w, Clay_String s, Clay_TextElementConfig* c)
 {
-    fprintf(f, "CLAY_TEXT(CLAY_STRING(\"%.*s\"), CLAY_TEXT_CONFIG({ ", s.length, s.chars);
-    fprintf(f, ".textColor = (Clay_Color) { %.0f, %.0f, %.0f, %.0f }, ", c->textColor.r,
-        c->textColor.g, c->textColor.b, c->textColor.a);
-    if (c->fontId)
-        fprintf(f, ".fontId = %" PRIu16 ", ", c->fontId);
-    fprintf(f, ".fontSize = %" PRIu16 ", ", c->fontSize);
-    if (c->letterSpacing)
-        fprintf(f, ".letterSpacing = %" PRIu16 ", ", c->letterSpacing);
-    if (c->lineHeight)
-        fprintf(f, ".lineHeight = %" PRIu16 ", ", c->lineHeight);
-    if (c->wrapMode)
-        fprintf(f, ".wrapMode = CLAY_TEXT_WRAP_%s, ",
-            CLAY_ENUM_VALUE_MACRO(Clay_TextElementConfigWrapMode, c->wrapMode));
-    if (c->textAlignment)
-        fprintf(f, ".textAlignment = CLAY_TEXT_ALIGN_%s, ",
-            CLAY_ENUM_VALUE_MACRO(Clay_TextAlignment, c->textAlignment));
+    write_str(w, "CLAY_TEXT(CLAY_STRING(\"");
+    write_chars(w, s.chars, (size_t) s.length);
+    write_str(w, "\"), CLAY_TEXT_CONFIG({ .textColor = ");
+    export_clay_color(w, c->textColor);
+    write_str(w, ", ");
+    if (c->fontId) {
+        write_str(w, ".fontId = ");
+        write_uint(w, c->fontId);
+        write_str(w, ", ");
+    }
+    write_str(w, ".fontSize = ");
+    write_uint(w, c->fontSize);
+    write_str(w, ", ");
+    if (c->letterSpacing) {
+        write_str(w, ".letterSpacing = ");
+        write_uint(w, c->letterSpacing);
+        write_str(w, ", ");
+    }
+    if (c->lineHeight) {
+        write_str(w, ".lineHeight = ");
+        write_uint(w, c->lineHeight);
+        write_str(w, ", ");
+    }
+    if (c->wrapMode) {
+        write_str(w, ".wrapMode = CLAY_TEXT_WRAP_");
+        write_str(w, CLAY_ENUM_VALUE_MACRO(Clay_TextElementConfigWrapMode, c->wrapMode));
+        write_str(w, ", ");
+    }
+    if (c->textAlignment) {
+        write_str(w, ".textAlignment = CLAY_TEXT_ALIGN_");
+        write_str(w, CLAY_ENUM_VALUE_MACRO(Clay_TextAlignment, c->textAlignment));
+        write_str(w, ", ");
+    }
     if (c->hashStringContents)
-        fprintf(f, ".hashStringContents = true, ");
-    fprintf(f, "}));\n");
+        write_str(w, ".hashStringContents = true, ");
+    write_str(w, "}));\n");
 }
 
-static void export_layout_r(FILE* f, ui_element_t* root, int depth)
+static void export_layout_r(export_writer_t* w, ui_element_t* root, int depth)
 {
     if (root->type == UI_ELEMENT_DECLARATION) {
-        fprintf(f, "CLAY({");
-        export_clay_declaration(f, root);
-        fprintf(f, "}) {\n");
+        write_indent(w, depth);
+        write_str(w, "CLAY({\n");
+        size_t empty = w->length;
+        export_clay_declaration(w, root, depth);
+        if (w->length == empty) {
+            // No fields, keep the braces together
+            w->length--;
+        } else {
+            write_indent(w, depth);
+        }
+        write_str(w, "}) {\n");
         if (root->on_hover.enabled && root->on_hover.callback.length) {
-            fprintf(f, "Clay_OnHover(%.*s, 0); // TODO: implement\n", root->on_hover.callback.length, root->on_hover.callback.chars);
+            write_indent(w, depth + 1);
+            write_str(w, "Clay_OnHover(");
+            write_chars(w, root->on_hover.callback.chars, (size_t) root->on_hover.callback.length);
+            write_str(w, ", 0); // TODO: implement\n");
         }
-        for (size_t i = 0; i < root->num_children; ++i) {
-            export_layout_r(f, root->children[i], depth + 1);
+        for (ui_element_t* child = root->first_child; child; child = child->next) {
+            export_layout_r(w, child, depth + 1);
         }
-        fprintf(f, "}\n");
+        write_indent(w, depth);
+        write_str(w, "}\n");
     } else if (root->type == UI_ELEMENT_TEXT) {
-        export_clay_text(f, root->text.s, root->text_config);
+        write_indent(w, depth);
+        export_clay_text(w, root->text.s, root->text_config);
     }
 }
 
-void export_layout(const char* filename, ui_element_t* root)
+bool export_layout(const char* filename, ui_element_t* root)
 {
+    export_writer_t w = { 0 };
+    export_layout_r(&w, root, 0);
+
     FILE* f = fopen(filename, "w");
     if (f == NULL) {
         fprintf(stderr, "Unable to open output file %s\n", filename);
-        return;
+        free(w.data);
+        return false;
+    }
+    bool ok = fwrite(w.data, 1, w.length, f) == w.length;
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Unable to write output file %s\n", filename);
     }
-    export_layout_r(f, root, 0);
-    fclose(f);
+    free(w.data);
+    return ok;
 }
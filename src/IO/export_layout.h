@@ -1,8 +1,16 @@
 #ifndef EXPORT_LAYOUT_H
 #define EXPORT_LAYOUT_H
 
+#include <stdbool.h>
+
 #include "ui_element.h"
 
-void export_layout(const char* filename, ui_element_t* root);
+/**
+ * @brief Writes `root` and its children to `filename` as Clay C code, indented by depth, one
+ * declaration field per line
+ *
+ * @return `bool` False if the file couldn't be written
+ */
+bool export_layout(const char* filename, ui_element_t* root);
 
 #endif // EXPORT_LAYOUT_H
@@ -7,14 +7,12 @@
 
 #include "clay_enum_names.h"
 #include "clay_struct_names.h"
+#include "concurrency.h"
+#include "import_layout.h"
 #include "import_preprocessor.h"
 #include "ui_element.h"
 #include "utilities.h"
 
-#include "stb_c_lexer_config.h"
-#define STB_C_LEXER_IMPLEMENTATION
-#include "stb_c_lexer.h"
-
 #ifndef numberof
 #define numberof(x) (sizeof(x) / sizeof(*(x)))
 #endif
@@ -22,7 +20,8 @@
 typedef struct {
     ui_element_t* parent;
     ui_element_t* me;
-    stb_lexer* lexer;
+    pp_t* pp;
+    const pp_token_t* tok;
     const char* filename;
 } parse_ctx_t;
 
@@ -55,7 +54,7 @@ static ui_element_t* parse_tree_r(parse_ctx_t* ctx);
 void report_failure(parse_ctx_t* ctx, const char* expected)
 {
     stb_lex_location loc;
-    stb_c_lexer_get_location((ctx)->lexer, (ctx)->lexer->where_firstchar, &loc);
+    pp_location((ctx)->pp, &loc);
     fprintf(stderr, "Unexpected token at %s:%d:%d\n", (ctx)->filename, loc.line_number,
         loc.line_offset);
     fprintf(stderr, "Expected %s\n", expected);
@@ -74,19 +73,19 @@ void report_failure(parse_ctx_t* ctx, const char* expected)
 
 static int expect_tokens(parse_ctx_t* ctx, const char** tokens, int num_tokens)
 {
-    int ret = stb_c_lexer_get_token(ctx->lexer);
+    bool ret = pp_next(ctx->pp);
     if (ret == 0) {
         return -1;
     }
     char character_buffer[] = " ";
     for (int i = 0; i < num_tokens; ++i) {
-        if (ctx->lexer->token < CLEX_eof) {
-            character_buffer[0] = (char) ctx->lexer->token;
+        if (ctx->tok->token < CLEX_eof) {
+            character_buffer[0] = (char) ctx->tok->token;
             if (!strcmp(tokens[i], character_buffer)) {
                 return i;
             }
         } else {
-            if (!strcmp(tokens[i], ctx->lexer->string)) {
+            if (!strcmp(tokens[i], ctx->tok->string)) {
                 return i;
             }
         }
@@ -96,12 +95,12 @@ static int expect_tokens(parse_ctx_t* ctx, const char** tokens, int num_tokens)
 
 static bool expect_token(parse_ctx_t* ctx, const char* token)
 {
-    int ret = stb_c_lexer_get_token(ctx->lexer);
+    bool ret = pp_next(ctx->pp);
     if (!ret) return false;
-    if (ctx->lexer->token < CLEX_eof) {
-        return token[0] == ctx->lexer->token && token[1] == '\0';
+    if (ctx->tok->token < CLEX_eof) {
+        return token[0] == ctx->tok->token && token[1] == '\0';
     }
-    return strcmp(token, ctx->lexer->string) == 0;
+    return strcmp(token, ctx->tok->string) == 0;
 }
 
 typedef enum {
@@ -211,19 +210,19 @@ value_t evaluate_expression(parse_ctx_t* ctx, bool* done)
     value_t rhs;
     operation_t op = OP_NONE;
     while (*done == false) {
-        char* before = ctx->lexer->parse_point;
-        if (!stb_c_lexer_get_token(ctx->lexer)) {
+        size_t before = pp_tell(ctx->pp);
+        if (!pp_next(ctx->pp)) {
             report_failure(ctx, "constant expression");
             return lhs;
         }
-        switch (ctx->lexer->token) {
+        switch (ctx->tok->token) {
             case CLEX_intlit:
                 if (op == OP_NONE) {
                     lhs.type = VALUE_TYPE_INT;
-                    lhs.i = ctx->lexer->int_number;
+                    lhs.i = ctx->tok->int_number;
                 } else {
                     rhs.type = VALUE_TYPE_INT;
-                    rhs.i = ctx->lexer->int_number;
+                    rhs.i = ctx->tok->int_number;
                     lhs = evaluate_simple_expression(lhs, rhs, op);
                 }
                 lhs_valid = true;
@@ -231,10 +230,10 @@ value_t evaluate_expression(parse_ctx_t* ctx, bool* done)
             case CLEX_floatlit:
                 if (op == OP_NONE) {
                     lhs.type = VALUE_TYPE_FLOAT;
-                    lhs.f = (float) ctx->lexer->real_number;
+                    lhs.f = (float) ctx->tok->real_number;
                 } else {
                     rhs.type = VALUE_TYPE_FLOAT;
-                    rhs.f = (float) ctx->lexer->real_number;
+                    rhs.f = (float) ctx->tok->real_number;
                     lhs = evaluate_simple_expression(lhs, rhs, op);
                 }
                 lhs_valid = true;
@@ -246,10 +245,11 @@ value_t evaluate_expression(parse_ctx_t* ctx, bool* done)
                         return lhs;
                     }
                     lhs = evaluate_expression(ctx, done);
+                    lhs_valid = true;
                     break;
                 }
                 rhs = evaluate_expression(ctx, done);
-                if (ctx->lexer->token != ')') {
+                if (ctx->tok->token != ')') {
                     report_failure(ctx, ")");
                     return lhs;
                 }
@@ -271,7 +271,7 @@ value_t evaluate_expression(parse_ctx_t* ctx, bool* done)
                 op = OP_ADD;
                 rhs = evaluate_expression(ctx, done);
                 lhs = evaluate_simple_expression(lhs, rhs, op);
-                if (ctx->lexer->token == ')') return lhs;
+                if (ctx->tok->token == ')') return lhs;
                 lhs_valid = true;
                 break;
             case '-':
@@ -289,7 +289,7 @@ value_t evaluate_expression(parse_ctx_t* ctx, bool* done)
                 break;
             default:
                 *done = true;
-                ctx->lexer->parse_point = before;
+                pp_seek(ctx->pp, before);
                 return lhs;
         }
     }
@@ -378,29 +378,29 @@ static void write_value(uint8_t* out, type_t expected_type, size_t size, value_t
 
 static bool parse_string_literal(parse_ctx_t* ctx, dstring_t* s)
 {
-    int ret = stb_c_lexer_get_token(ctx->lexer);
-    if (!ret || ctx->lexer->token != CLEX_dqstring) {
+    bool ret = pp_next(ctx->pp);
+    if (!ret || ctx->tok->token != CLEX_dqstring) {
         report_failure(ctx, "string literal");
         return false;
     }
-    if (s->capacity < ctx->lexer->string_len) {
-        s->capacity = ctx->lexer->string_len;
+    if (s->capacity < ctx->tok->string_len) {
+        s->capacity = ctx->tok->string_len;
         void* tmp = realloc((char*) s->s.chars, s->capacity);
         assert(tmp);
         s->s.chars = tmp;
     }
-    s->s.length = ctx->lexer->string_len;
-    memcpy((char*) s->s.chars, ctx->lexer->string, s->capacity);
+    s->s.length = ctx->tok->string_len;
+    memcpy((char*) s->s.chars, ctx->tok->string, s->capacity);
     return true;
 }
 
 static bool parse_enum(parse_ctx_t* ctx, uint8_t* out, const enum_info_t* info)
 {
-    int ret = stb_c_lexer_get_token(ctx->lexer);
+    bool ret = pp_next(ctx->pp);
     if (!ret) return false;
-    if (ctx->lexer->token != CLEX_id) return false;
+    if (ctx->tok->token != CLEX_id) return false;
     for (size_t i = 0; i < info->count; ++i) {
-        if (!strcmp(ctx->lexer->string, info->macros[i])) {
+        if (!strcmp(ctx->tok->string, info->macros[i])) {
             *out = (uint8_t) i;
             return true;
         }
@@ -454,7 +454,7 @@ static bool parse_value(parse_ctx_t* ctx, uint8_t* out, uint8_t* on_hover_out, c
 static bool parse_struct_member(parse_ctx_t* ctx, uint8_t* out, uint8_t* on_hover_out, const struct_info_t* info, size_t member_index)
 {
     // Check for Clay_Hovered() ternary
-    char* prev_parse_point = ctx->lexer->parse_point;
+    size_t prev_parse_point = pp_tell(ctx->pp);
     if (expect_token(ctx, "Clay_Hovered")) {
         ctx->me->on_hover.enabled = true;
         EXPECT_REQUIRED(ctx, "(");
@@ -464,7 +464,7 @@ static bool parse_struct_member(parse_ctx_t* ctx, uint8_t* out, uint8_t* on_hove
         EXPECT_REQUIRED(ctx, ":");
         return parse_value(ctx, out, NULL, info, member_index);
     }
-    ctx->lexer->parse_point = prev_parse_point;
+    pp_seek(ctx->pp, prev_parse_point);
     if (!parse_value(ctx, out, on_hover_out, info, member_index)) {
         return false;
     }
@@ -477,27 +477,27 @@ static bool parse_struct_members(parse_ctx_t* ctx, uint8_t* out, uint8_t* on_hov
 {
     int braces = 1;
     for (size_t i = 0; i < info->count; ++i) {
-        char* before = ctx->lexer->parse_point;
-        for (stb_c_lexer_get_token(ctx->lexer); ctx->lexer->token == '{'; ++braces) {
-            before = ctx->lexer->parse_point;
-            if (!stb_c_lexer_get_token(ctx->lexer)) {
+        size_t before = pp_tell(ctx->pp);
+        for (pp_next(ctx->pp); ctx->tok->token == '{'; ++braces) {
+            before = pp_tell(ctx->pp);
+            if (!pp_next(ctx->pp)) {
                 report_failure(ctx, info->members[i]);
                 return false;
             }
         }
-        if (ctx->lexer->token == '}') {
+        if (ctx->tok->token == '}') {
             --braces;
             break;
         }
-        if (ctx->lexer->token == '.') {
+        if (ctx->tok->token == '.') {
             // adjust i to member given
-            if (!stb_c_lexer_get_token(ctx->lexer)) {
+            if (!pp_next(ctx->pp)) {
                 report_failure(ctx, "struct member before EOF");
                 return false;
             }
             bool found = false;
             for (size_t j = 0; j < info->count; ++j) {
-                if (!strcmp(info->members[j], ctx->lexer->string)) {
+                if (!strcmp(info->members[j], ctx->tok->string)) {
                     found = true;
                     i = j;
                     break;
@@ -508,14 +508,14 @@ static bool parse_struct_members(parse_ctx_t* ctx, uint8_t* out, uint8_t* on_hov
             }
             EXPECT_REQUIRED(ctx, "=");
         } else {
-            ctx->lexer->parse_point = before;
+            pp_seek(ctx->pp, before);
         }
         if (!parse_struct_member(ctx, out, on_hover_out, info, i)) {
             return false;
         }
-        if (!stb_c_lexer_get_token(ctx->lexer)) return false;
-        if (ctx->lexer->token == ',') continue;
-        if (ctx->lexer->token == '}') {
+        if (!pp_next(ctx->pp)) return false;
+        if (ctx->tok->token == ',') continue;
+        if (ctx->tok->token == '}') {
             --braces;
             break;
         }
@@ -539,13 +539,13 @@ static bool parse_struct(parse_ctx_t* ctx, uint8_t* out, uint8_t* on_hover_out,
         return parse_struct_members(ctx, out, on_hover_out, info);
     } else if (token == 1) {
         int parens = 0;
-        while (ctx->lexer->token == '(') {
-            int ret = stb_c_lexer_get_token(ctx->lexer);
-            if (!ret || (ctx->lexer->token == CLEX_id &&
-                        strcmp(info->name, ctx->lexer->string))) {
+        while (ctx->tok->token == '(') {
+            bool ret = pp_next(ctx->pp);
+            if (!ret || (ctx->tok->token == CLEX_id &&
+                        strcmp(info->name, ctx->tok->string))) {
                 report_failure(ctx, info->name);
                 return false;
-            } else if (ctx->lexer->token == '(') {
+            } else if (ctx->tok->token == '(') {
                 ++parens;
             }
         }
@@ -562,46 +562,46 @@ static bool parse_struct(parse_ctx_t* ctx, uint8_t* out, uint8_t* on_hover_out,
 
 static bool parse_union_by_members(parse_ctx_t* ctx, uint8_t* out, uint8_t* on_hover_out, const struct_info_t* info)
 {
-    char* prev = ctx->lexer->parse_point;
-    if (!stb_c_lexer_get_token(ctx->lexer)) {
+    size_t prev = pp_tell(ctx->pp);
+    if (!pp_next(ctx->pp)) {
         report_failure(ctx, "union member");
         return false;
     }
-    if (ctx->lexer->token == '.') {
-        int ret = stb_c_lexer_get_token(ctx->lexer);
-        if (!ret || ctx->lexer->token != CLEX_id) return false;
+    if (ctx->tok->token == '.') {
+        bool ret = pp_next(ctx->pp);
+        if (!ret || ctx->tok->token != CLEX_id) return false;
         for (size_t i = 0; i < info->count; ++i) {
-            if (!strcmp(ctx->lexer->string, info->members[i])) {
+            if (!strcmp(ctx->tok->string, info->members[i])) {
                 EXPECT_REQUIRED(ctx, "=");
                 if (!parse_struct_member(ctx, out, on_hover_out, info, i)) return false;
-                ret = stb_c_lexer_get_token(ctx->lexer);
+                ret = pp_next(ctx->pp);
                 if (!ret) return false;
-                if (ctx->lexer->token == ',') {
+                if (ctx->tok->token == ',') {
                     report_failure(ctx, "}, initialing subobjects of unions is not supported");
                     return false;
                 }
-                if (ctx->lexer->token == '}') return true;
+                if (ctx->tok->token == '}') return true;
                 report_failure(ctx, "}");
             }
         }
         return false;
     }
-    ctx->lexer->parse_point = prev;
+    pp_seek(ctx->pp, prev);
     // do something else
     return false;
 }
 
 static bool parse_union_literal(parse_ctx_t* ctx, uint8_t* out, uint8_t* on_hover_out, const struct_info_t* info)
 {
-    char* prev = ctx->lexer->parse_point;
-    int ret = stb_c_lexer_get_token(ctx->lexer);
-    if (!ret || ctx->lexer->token != CLEX_id) {
+    size_t prev = pp_tell(ctx->pp);
+    bool ret = pp_next(ctx->pp);
+    if (!ret || ctx->tok->token != CLEX_id) {
         report_failure(ctx, "type of union member");
         return false;
     }
     for (size_t i = 0; i < info->count; ++i) {
-        if (!strcmp(ctx->lexer->string, info->members[i])) {
-            ctx->lexer->parse_point = prev;
+        if (!strcmp(ctx->tok->string, info->members[i])) {
+            pp_seek(ctx->pp, prev);
             return parse_struct(ctx, out, on_hover_out, info->info[i].struct_info);
         }
     }
@@ -640,13 +640,9 @@ static bool parse_custom(parse_ctx_t* ctx, uint8_t* out, const struct_info_t* in
 static ui_element_t* parse_element_declaration(parse_ctx_t* ctx)
 {
     EXPECT_REQUIRED(ctx, "(");
-    ui_element_t* me = (ui_element_t*) malloc_assert(sizeof *me);
+    ui_element_t* me = ui_element_create(UI_ELEMENT_DECLARATION);
     ctx->me = me;
-    memset(me, 0, sizeof *me);
-    me->ptr = (Clay_ElementDeclaration*) malloc_assert(sizeof *me->ptr);
-    memset(me->ptr, 0, sizeof *me->ptr);
-    me->on_hover.ptr = (Clay_ElementDeclaration*) malloc_assert(sizeof *me->on_hover.ptr);
-    memset(me->on_hover.ptr, 0, sizeof *me->on_hover.ptr);
+    me->on_hover.ptr = ui_element_alloc_declaration();
     if (!parse_struct(ctx, (uint8_t*) me->ptr, (uint8_t*) me->on_hover.ptr, STRUCT_INFO(Clay_ElementDeclaration))) goto fail;
     EXPECT_REQUIRED(ctx, ")");
     const char* possible_after_decl[] = { "{", ";" };
@@ -654,7 +650,7 @@ static ui_element_t* parse_element_declaration(parse_ctx_t* ctx)
     if (next_token == 1) return me;
     if (next_token == -1) goto fail;
     if (!me->on_hover.enabled) {
-        free(me->on_hover.ptr);
+        ui_element_free_declaration(me->on_hover.ptr);
         me->on_hover.ptr = NULL;
     }
     ui_element_t* child;
@@ -662,10 +658,7 @@ static ui_element_t* parse_element_declaration(parse_ctx_t* ctx)
     do {
         child = parse_tree_r(ctx);
         if (child && child != (void*) SIZE_MAX) {
-            child->parent = me;
-            me->num_children++;
-            REALLOC_ASSERT(me->children, sizeof(*me->children) * me->num_children);
-            me->children[me->num_children - 1] = child;
+            ui_element_append_child(me, child);
         }
     } while (child);
     return me;
@@ -679,12 +672,7 @@ static ui_element_t* parse_text(parse_ctx_t* ctx)
     ui_element_t* me = NULL;
     EXPECT_REQUIRED(ctx, "CLAY_STRING");
     EXPECT_REQUIRED(ctx, "(");
-    me = (ui_element_t*) malloc_assert(sizeof(*me));
-    memset(me, 0, sizeof(*me));
-    me->type = UI_ELEMENT_TEXT;
-    me->text_config = 0;
-    me->text_config = (Clay_TextElementConfig*) malloc_assert(sizeof(*me->text_config));
-    memset(me->text_config, 0, sizeof(*me->text_config));
+    me = ui_element_create(UI_ELEMENT_TEXT);
     if (!parse_string_literal(ctx, &me->text)) goto fail;
     EXPECT_REQUIRED(ctx, ")");
     EXPECT_REQUIRED(ctx, ",");
@@ -694,10 +682,7 @@ static ui_element_t* parse_text(parse_ctx_t* ctx)
     EXPECT_REQUIRED(ctx, ")");
     return me;
 fail:
-    if (me) {
-        free(me->text_config);
-        free(me);
-    }
+    ui_element_remove(me);
     return NULL;
 }
 
@@ -709,27 +694,27 @@ static bool parse_on_hover(parse_ctx_t* ctx)
     }
     ctx->parent->on_hover.enabled = true;
     EXPECT_REQUIRED(ctx, "(");
-    int ret = stb_c_lexer_get_token(ctx->lexer);
-    if (!ret || ctx->lexer->token != CLEX_id) {
+    bool ret = pp_next(ctx->pp);
+    if (!ret || ctx->tok->token != CLEX_id) {
         report_failure(ctx, "callback function");
         return false;
     }
-    ctx->parent->on_hover.callback.length = ctx->lexer->string_len;
-    ctx->parent->on_hover.callback.chars = malloc_assert(ctx->lexer->string_len + 1);
-    strcpy((char*) ctx->parent->on_hover.callback.chars, ctx->lexer->string);
+    ctx->parent->on_hover.callback.length = ctx->tok->string_len;
+    ctx->parent->on_hover.callback.chars = malloc_assert(ctx->tok->string_len + 1);
+    strcpy((char*) ctx->parent->on_hover.callback.chars, ctx->tok->string);
     EXPECT_REQUIRED(ctx, ",");
     // ignore second argument by ignoring everything until ')'
     // this could obviously accept a lot of invalid syntax
     size_t num_parens = 1;
     do {
-        ret = stb_c_lexer_get_token(ctx->lexer);
+        ret = pp_next(ctx->pp);
         if (!ret) {
             report_failure(ctx, ")");
             return false;
         }
-        if (ctx->lexer->token == '(') {
+        if (ctx->tok->token == '(') {
             num_parens++;
-        } else if (ctx->lexer->token == ')') {
+        } else if (ctx->tok->token == ')') {
             num_parens--;
         }
     } while (num_parens);
@@ -772,17 +757,78 @@ fail:
 
 ui_element_t* import_layout(const char* filename)
 {
-    ui_element_t* head = NULL;
-    char *file_data;
-    stb_lexer lexer = { 0 };
-    int64_t size;
-
-    parse_ctx_t ctx = { .parent = NULL, .lexer = &lexer, .filename = filename };
-    // First pass replaces macros
-    if (!replace_macros(filename, &lexer, &file_data, &size)) return head;
-    head = parse_tree_r(&ctx);
-
-    free(file_data);
-    free(lexer.string_storage);
+    pp_t* pp = pp_open(filename);
+    if (pp == NULL) return NULL;
+    parse_ctx_t ctx = { .parent = NULL, .pp = pp, .tok = pp_token(pp), .filename = filename };
+    ui_element_t* head = parse_tree_r(&ctx);
+    pp_close(pp);
     return head;
 }
+
+typedef struct {
+    const char** files;
+    ui_element_t** roots;
+    size_t n;
+    size_t next;
+    mutex_t lock;
+} import_jobs_t;
+
+static void import_worker(void* arg)
+{
+    import_jobs_t* jobs = (import_jobs_t*) arg;
+    for (;;) {
+        mutex_lock(&jobs->lock);
+        size_t i = jobs->next++;
+        mutex_unlock(&jobs->lock);
+        if (i >= jobs->n) break;
+        jobs->roots[i] = import_layout(jobs->files[i]);
+    }
+    ui_element_release_thread_cache();
+}
+
+size_t import_layouts(const char** files,
+                      size_t n,
+                      ui_element_t* parent,
+                      ui_element_t** roots,
+                      size_t num_threads)
+{
+    assert(parent || roots);
+    import_jobs_t jobs = { .files = files, .n = n, .next = 0 };
+    jobs.roots = roots ? roots : (ui_element_t**) malloc_assert(sizeof(*roots) * (n ? n : 1));
+    mutex_init(&jobs.lock);
+    if (num_threads == 0) {
+        num_threads = processor_count();
+    }
+    if (num_threads > n) {
+        num_threads = n;
+    }
+    // The calling thread imports too, so one fewer thread is started
+    thread_t* threads = NULL;
+    size_t started = 0;
+    if (num_threads > 1) {
+        threads = (thread_t*) malloc_assert(sizeof(*threads) * (num_threads - 1));
+        while (started < num_threads - 1 && thread_create(&threads[started], import_worker, &jobs)) {
+            ++started;
+        }
+    }
+    import_worker(&jobs);
+    for (size_t i = 0; i < started; ++i) {
+        thread_join(threads[i]);
+    }
+    free(threads);
+    mutex_destroy(&jobs.lock);
+
+    size_t imported = 0;
+    for (size_t i = 0; i < n; ++i) {
+        ui_element_t* root = jobs.roots[i];
+        if (root == NULL) continue;
+        ++imported;
+        if (parent) {
+            ui_element_append_child(parent, root);
+        }
+    }
+    if (roots == NULL) {
+        free(jobs.roots);
+    }
+    return imported;
+}
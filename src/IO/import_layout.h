@@ -1,8 +1,30 @@
 #ifndef IMPORT_LAYOUT_H
 #define IMPORT_LAYOUT_H
 
+#include <stddef.h>
+
 #include "ui_element.h"
 
 ui_element_t* import_layout(const char* filename);
 
+/**
+ * @brief Imports several files at once on a pool of worker threads
+ *
+ * Files are parsed independently, sharing the clay.h macro table. The result is the same as
+ * calling import_layout() on each file in turn.
+ *
+ * @param files Files to import
+ * @param n Number of files
+ * @param parent Element to attach the imported layouts to in the order of `files`, can be `NULL`
+ * @param roots Receives the layout imported from each file, `NULL` for files that failed, can be
+ * `NULL` if `parent` isn't
+ * @param num_threads Number of threads to import on, 0 for one per processor
+ * @return `size_t` Number of files imported
+ */
+size_t import_layouts(const char** files,
+                      size_t n,
+                      ui_element_t* parent,
+                      ui_element_t** roots,
+                      size_t num_threads);
+
 #endif // IMPORT_LAYOUT_H
@@ -5,27 +5,74 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <errno.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #define STB_DS_IMPLEMENTATION
 #include "stb_ds.h"
-#include "stb_c_lexer.h"
 
+#include "concurrency.h"
 #include "import_preprocessor.h"
 #include "utilities.h"
 
+#include "stb_c_lexer_config.h"
+#define STB_C_LEXER_IMPLEMENTATION
+#include "stb_c_lexer.h"
+
 #define MAX_ARGS    (8)
+#define CLAY_H_PATH "clay/clay.h"
 
-typedef struct {
-    char* ptr;
+#define ARENA_BLOCK_SIZE    (4096)
+#define ARENA_ALIGNMENT     (8)
+#define LEXER_STORAGE_SIZE  (64)
+
+// Tokens the parser may back up over, it never needs more than a couple
+#define PP_HISTORY_SIZE     (32)
+// Token type for a reference to a macro parameter, int_number holds the parameter index
+#define PP_PARAM            (CLEX_first_unused_token)
+
+#define MACRO_CACHE_MAGIC   (0x434d4c43u) // "CLMC"
+#define MACRO_CACHE_VERSION (2)
+
+// Strings are never freed individually, so the arena is a list of blocks that only grows.
+// Each block is twice the size of the last, starting small so short files stay cheap.
+typedef struct arena_block_s {
+    struct arena_block_s* prev;
     size_t cap;
     size_t size;
+    char data[];
+} arena_block_t;
+
+typedef struct {
+    arena_block_t* block;
 } arena_t;
 
+typedef struct {
+    char* data;
+    int64_t size;
+    bool mapped;
+} source_t;
+
 typedef struct {
     char* expression;
     char* arguments[MAX_ARGS];
     int num_args;
     bool variadic;
+    bool function_like;
+    // expression lexed once at definition, parameters are PP_PARAM tokens
+    pp_token_t* body;
+    int body_len;
 } macro_definition_t;
 
 typedef struct {
@@ -33,70 +80,124 @@ typedef struct {
     macro_definition_t value;
 } macro_t;
 
+typedef struct {
+    char* ptr;
+    size_t size;
+    size_t capacity;
+} buffer_t;
+
 typedef struct {
     arena_t* a;
     stb_lexer* lex;
     const char* filename;
     macro_t** map;
+    buffer_t expression;
 } ctx_t;
 
 typedef struct {
-    char* ptr;
-    size_t size;
-    size_t capacity;
-} buffer_t;
-
-static bool replace_macro(ctx_t ctx, buffer_t* output, macro_definition_t* macro);
-
-static arena_t arena_init(size_t capacity)
-{
-    return (arena_t) { .ptr = malloc_assert(capacity), .cap = capacity, .size = 0 };
-}
-
-static char* arena_alloc(arena_t* a, size_t num_bytes)
-{
-    assert(a->size + num_bytes < a->cap);
-    char* ret = a->ptr + a->size;
-    a->size += num_bytes;
-    a->ptr[a->size++] = '\0';
-    return ret;
-}
+    pp_token_t* tokens;
+    size_t next;
+    // name of the macro this is the expansion of, it isn't expanded again while the frame is open
+    const char* macro;
+    // reading stops at the end of a barrier frame instead of continuing with the frame below
+    bool barrier;
+} pp_frame_t;
+
+struct pp_s {
+    stb_lexer lex;
+    source_t src;
+    arena_t arena;
+    macro_t* map;
+    ctx_t ctx;
+    pp_frame_t* frames;
+    pp_token_t history[PP_HISTORY_SIZE];
+    size_t produced;
+    size_t position;
+    pp_token_t tok;
+    bool failed;
+};
+
+// clay.h macros are gathered once per process and shared by every import. Macros defined by
+// the imported file itself go into a map local to that import, which is searched first.
+typedef struct {
+    bool loaded;
+    macro_t* map;
+    arena_t arena;
+    char* cache_data;
+} clay_h_macros_t;
 
-static char* arena_copy_string(arena_t* a, const char* s)
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int64_t mtime;
+    int64_t size;
+    uint64_t hash;
+    uint32_t count;
+    uint32_t strings_size;
+} macro_cache_header_t;
+
+// Strings are stored as offsets into the string block following the records
+typedef struct {
+    uint32_t name;
+    uint32_t expression;
+    uint32_t arguments[MAX_ARGS];
+    int32_t num_args;
+    int32_t variadic;
+    int32_t function_like;
+} macro_cache_record_t;
+
+static clay_h_macros_t clay_h_macros;
+static mutex_t clay_h_macros_lock = MUTEX_INITIALIZER;
+// stb_ds advances a global seed whenever it creates a hash table, which shput() may do
+static mutex_t table_creation_lock = MUTEX_INITIALIZER;
+static const char* macro_cache_path;
+
+static void* arena_alloc(arena_t* a, size_t n, size_t align)
 {
-    size_t len = strlen(s);
-    assert(len + a->size <= a->cap);
-    char* ret = a->ptr + a->size;
-    strcpy(ret, s);
-    a->size += len + 1;
-    return ret;
+    uintptr_t p = 0;
+    if (a->block) {
+        p = (uintptr_t) (a->block->data + a->block->size);
+        p = (p + align - 1) & ~(uintptr_t) (align - 1);
+    }
+    if (a->block == NULL || p + n > (uintptr_t) (a->block->data + a->block->cap)) {
+        size_t cap = a->block ? a->block->cap * 2 : ARENA_BLOCK_SIZE;
+        while (cap < n + align) {
+            cap *= 2;
+        }
+        arena_block_t* block = (arena_block_t*) malloc_assert(sizeof(*block) + cap);
+        block->prev = a->block;
+        block->cap = cap;
+        block->size = 0;
+        a->block = block;
+        p = (uintptr_t) block->data;
+        p = (p + align - 1) & ~(uintptr_t) (align - 1);
+    }
+    a->block->size = (size_t) (p - (uintptr_t) a->block->data) + n;
+    return (void*) p;
 }
 
 static char* arena_copy_string_n(arena_t* a, const char* s, size_t n)
 {
-    assert(a->size + n + 1 <= a->cap);
-    char* ret = a->ptr + a->size;
-    memcpy(a->ptr + a->size, s, n);
-    a->size += n;
-    a->ptr[a->size] = '\0';
+    char* ret = (char*) arena_alloc(a, n + 1, 1);
+    if (n) {
+        memcpy(ret, s, n);
+    }
+    ret[n] = '\0';
     return ret;
 }
 
-static void arena_append_char(arena_t* a, char c)
+static char* arena_copy_string(arena_t* a, const char* s)
 {
-    assert(a->size + 1 < a->cap);
-    a->ptr[a->size++] = c;
-    a->ptr[a->size] = '\0';
+    return arena_copy_string_n(a, s, strlen(s));
 }
 
 static void arena_destory(arena_t a)
 {
-    free(a.ptr);
-}
-
-static char* arena_append_point(arena_t* a)
-{
-    return a->ptr + a->size;
+    while (a.block) {
+        arena_block_t* prev = a.block->prev;
+        free(a.block);
+        a.block = prev;
+    }
 }
 
 static void report_failure(const char* filename, stb_lexer* lex, const char* expected)
@@ -107,16 +208,37 @@ static void report_failure(const char* filename, stb_lexer* lex, const char* exp
     fprintf(stderr, "Expected %s\n", expected);
 }
 
+static macro_definition_t* find_macro(const ctx_t* ctx, const char* name)
+{
+    ptrdiff_t index = -1;
+    if (*ctx->map) {
+        index = shgeti(*ctx->map, name);
+        if (index != -1) {
+            return &(*ctx->map)[index].value;
+        }
+    }
+    // The clay.h table is shared between threads importing at once, and shgeti() isn't safe for
+    // that as it stores the index in the table
+    macro_t* shared = clay_h_macros.map;
+    if (shared == NULL) return NULL;
+    stbds_hmget_key_ts(shared, sizeof(*shared), (void*) name, sizeof(shared->key), &index,
+        STBDS_HM_STRING);
+    return index == -1 ? NULL : &shared[index].value;
+}
+
 static void append_bytes_to_buffer(buffer_t* buffer, const char* bytes, size_t num_bytes)
 {
-    while (buffer->size + num_bytes > buffer->capacity) {
-        buffer->capacity *= 2;
+    if (buffer->size + num_bytes > buffer->capacity) {
+        while (buffer->size + num_bytes > buffer->capacity) {
+            buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 64;
+        }
         REALLOC_ASSERT(buffer->ptr, buffer->capacity);
     }
     memcpy(buffer->ptr + buffer->size, bytes, num_bytes);
     buffer->size += num_bytes;
 }
 
+// The buffer is null terminated, as the lexer may look one character past the end of input
 static bool read_file_data(const char* filename, char** file_data, int64_t* size)
 {
     bool ret = false;
@@ -130,8 +252,8 @@ static bool read_file_data(const char* filename, char** file_data, int64_t* size
     *size = ftell(f);
     fseek(f, 0, SEEK_SET);
     assert(*size >= 0);
-    *file_data = (char*) malloc(*size);
-    if (!file_data) {
+    *file_data = (char*) malloc(*size + 1);
+    if (!*file_data) {
         fprintf(stderr, "Unable to allocate memory for file data\n");
         goto cleanup;
     }
@@ -140,137 +262,224 @@ static bool read_file_data(const char* filename, char** file_data, int64_t* size
         free(*file_data);
         goto cleanup;
     }
+    (*file_data)[*size] = '\0';
     ret = true;
 cleanup:
     if (f) fclose(f);
     return ret;
 }
 
-static int expand_arguments(ctx_t ctx, macro_definition_t* macro, char* args[MAX_ARGS])
+/**
+ * @brief Maps a file into memory, or reads it if it can't be mapped
+ *
+ * Files whose size is a multiple of the page size are read instead, since there would be no
+ * zero padding after the last character for the lexer to stop at.
+ */
+static bool source_open(const char* filename, source_t* src)
 {
-    stb_lexer* lex = ctx.lex;
-    if (!stb_c_lexer_get_token(lex) || lex->token != '(') {
-        report_failure(ctx.filename, lex, "macro arguments");
-        return -1;
-    }
-    int num_parens = 0;
-    for (int i = 0; i < MAX_ARGS; ++i) {
-        args[i] = arena_append_point(ctx.a);
-        for (;;) {
-            char* prev = lex->parse_point;
-            if (!stb_c_lexer_get_token(lex)) {
-                report_failure(ctx.filename, lex, "macro arguments");
-                return -1;
+    *src = (source_t) { 0 };
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER size;
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0
+            && size.QuadPart % info.dwPageSize) {
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping) {
+                src->data = (char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                src->size = size.QuadPart;
+                CloseHandle(mapping);
             }
-            if (num_parens == 0 && lex->token == ',') {
-                if (!macro->variadic && i == macro->num_args - 1) {
-                    report_failure(ctx.filename, lex, "), too many macro arguments given");
-                    return -1;
-                }
-                arena_append_char(ctx.a, '\0');
-                break;
-            } else if (num_parens == 0 && lex->token == ')') {
-                if (!macro->variadic && i < macro->num_args - 1) {
-                    report_failure(ctx.filename, lex, "more macro arguments");
-                    fprintf(stderr, "%d given, %d expected\n", i + 1, macro->num_args);
-                    return -1;
-                }
-                arena_append_char(ctx.a, '\0');
-                return i + 1;
+        }
+        CloseHandle(file);
+    }
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd != -1) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size % sysconf(_SC_PAGESIZE)) {
+            void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                src->data = (char*) data;
+                src->size = st.st_size;
             }
-            if (lex->token == ')' || lex->token == '}') {
-                --num_parens;
-            } else if (lex->token == '{' || lex->token == '(') {
-                ++num_parens;
+        }
+        close(fd);
+    }
+#endif
+    if (src->data) {
+        src->mapped = true;
+        return true;
+    }
+    return read_file_data(filename, &src->data, &src->size);
+}
+
+static void source_close(source_t* src)
+{
+    if (src->mapped) {
+#ifdef _WIN32
+        UnmapViewOfFile(src->data);
+#else
+        munmap(src->data, (size_t) src->size);
+#endif
+    } else {
+        free(src->data);
+    }
+    *src = (source_t) { 0 };
+}
+
+static int lexer_get_token(stb_lexer* lex)
+{
+    for (;;) {
+        char* start = lex->parse_point;
+        int ret = stb_c_lexer_get_token(lex);
+        if (!ret || lex->token != CLEX_parse_error
+            || lex->where_lastchar - lex->where_firstchar + 2 < lex->string_storage_len) {
+            return ret;
+        }
+        // The token didn't fit in the string storage, grow it and lex the token again
+        lex->string_storage_len *= 2;
+        REALLOC_ASSERT(lex->string_storage, (size_t) lex->string_storage_len);
+        lex->parse_point = start;
+    }
+}
+
+static void make_token(arena_t* a, const stb_lexer* lex, pp_token_t* out)
+{
+    *out = (pp_token_t) {
+        .token = lex->token,
+        .string = "",
+        .int_number = lex->int_number,
+        .real_number = lex->real_number,
+        .where = lex->where_firstchar,
+    };
+    if (lex->token == CLEX_id || lex->token == CLEX_dqstring) {
+        out->string = arena_copy_string_n(a, lex->string, lex->string_len);
+        out->string_len = lex->string_len;
+    }
+}
+
+static void tokenize_macro(arena_t* a, macro_definition_t* m)
+{
+    stb_lexer lex;
+    pp_token_t* body = NULL;
+    stb_c_lexer_init(&lex, m->expression, m->expression + strlen(m->expression),
+        malloc_assert(LEXER_STORAGE_SIZE), LEXER_STORAGE_SIZE);
+    while (lexer_get_token(&lex)) {
+        pp_token_t t;
+        make_token(a, &lex, &t);
+        t.where = NULL;
+        if (t.token == CLEX_id) {
+            if (m->variadic && !strcmp("__VA_ARGS__", t.string)) {
+                t.token = PP_PARAM;
+                t.int_number = m->num_args;
             }
-            int index = shgeti(*ctx.map, lex->string);
-            if (lex->token != CLEX_id || index == -1) {
-                arena_copy_string_n(ctx.a, prev, lex->parse_point - prev);
-                continue;
+            for (int i = 0; i < m->num_args; ++i) {
+                if (!strcmp(t.string, m->arguments[i])) {
+                    t.token = PP_PARAM;
+                    t.int_number = i;
+                    break;
+                }
             }
-            buffer_t idk = { .ptr = malloc(64), .capacity = 64, .size = 0 };
-            replace_macro(ctx, &idk, &(*ctx.map)[index].value);
-            arena_append_char(ctx.a, '\0');
-            arena_copy_string_n(ctx.a, idk.ptr, idk.size);
-            free(idk.ptr);
         }
+        arrput(body, t);
+    }
+    free(lex.string_storage);
+    m->body_len = (int) arrlen(body);
+    m->body = (pp_token_t*) arena_alloc(a, sizeof(*body) * arrlenu(body), ARENA_ALIGNMENT);
+    if (body) {
+        memcpy(m->body, body, sizeof(*body) * arrlenu(body));
     }
-    report_failure(ctx.filename, lex, "), too many macro arguments, max is 8");
-    return -1;
+    arrfree(body);
 }
 
-static bool replace_macro(ctx_t ctx, buffer_t* output, macro_definition_t* macro)
+/**
+ * @brief Parses a macro definition, the lexer is expected to be just past `define`
+ */
+static bool parse_define(ctx_t* ctx)
 {
-    if (macro->num_args == 0 && !macro->variadic) {
-        append_bytes_to_buffer(output,
-                               macro->expression,
-                               strlen(macro->expression));
-        return true;
-    }
-    // get arguments
-    char* args[MAX_ARGS];
-    int args_given = expand_arguments(ctx, macro, args);
-    if (args_given == -1) {
+    stb_lexer* lex = ctx->lex;
+    if (!lexer_get_token(lex) || lex->token != CLEX_id) {
+        report_failure(ctx->filename, lex, "macro");
         return false;
     }
-    // replace arguments
-    char storage[64] = { 0 };
-    stb_lexer macro_lexer = { 0 };
-    char* exp = macro->expression;
-    size_t exp_len = strlen(exp);
-    stb_c_lexer_init(&macro_lexer, exp, exp + exp_len, storage, 64);
-    buffer_t argument_buffer = { 0 };
-    stb_lexer argument_lexer = { 0 };
-
-    ctx.lex = &macro_lexer;
-
-    while (true) {
-        char* before = ctx.lex->parse_point;
-        if (!stb_c_lexer_get_token(ctx.lex)) {
-            if (ctx.lex == &argument_lexer) {
-                free(argument_buffer.ptr);
-                ctx.lex = &macro_lexer;
-                continue;
-            }
-            break;
+    macro_definition_t m = { 0 };
+    char* macro = arena_copy_string(ctx->a, lex->string);
+    switch (*lex->parse_point) {
+    case '(':
+        m.function_like = true;
+        lexer_get_token(lex); // (
+        while (lex->parse_point != lex->eof && isspace(*lex->parse_point))
+            ++lex->parse_point;
+        if (*lex->parse_point == ')') {
+            lexer_get_token(lex);
+            goto expression;
         }
-        if (ctx.lex->token == CLEX_id) {
-            if (macro->variadic && !strncmp("__VA_ARGS__", ctx.lex->string, 11)) {
-                for (int i = macro->num_args; i < args_given; ++i) {
-                    append_bytes_to_buffer(output, args[i], strlen(args[i]));
-                    if (i != args_given - 1)
-                        append_bytes_to_buffer(output, ",", 1);
+        do {
+            while (lex->parse_point != lex->eof && isspace(*lex->parse_point))
+                ++lex->parse_point;
+            if (!strncmp("...", lex->parse_point, 3)) {
+                m.variadic = true;
+                lex->parse_point += 3;
+                if (!lexer_get_token(lex) || lex->token != ')') {
+                    report_failure(ctx->filename, lex, ") after variadic macro definition");
+                    return false;
                 }
-                continue;
+                break;
             }
-            bool found = false;
-            int index = shgeti(*ctx.map, ctx.lex->string);
-            if (index != -1) {
-                argument_buffer.ptr = malloc(128);
-                argument_buffer.capacity = 128;
-                replace_macro(ctx, &argument_buffer, &(*ctx.map)[index].value);
-                ctx.lex = &argument_lexer;
-                stb_c_lexer_init(ctx.lex,
-                                 argument_buffer.ptr,
-                                 argument_buffer.ptr + argument_buffer.size,
-                                 arena_alloc(ctx.a, 64),
-                                 64);
-                continue;
+            if (!lexer_get_token(lex) || lex->token != CLEX_id) {
+                report_failure(ctx->filename, lex, "macro argument");
+                return false;
             }
-            for (int i = 0; i < macro->num_args; ++i) {
-                if (!strcmp(ctx.lex->string, macro->arguments[i])) {
-                    found = true;
-                    append_bytes_to_buffer(output, args[i], strlen(args[i]));
-                    break;
+            if (m.num_args == MAX_ARGS) {
+                report_failure(ctx->filename, lex, "), too many macro arguments, max is 8");
+                return false;
+            }
+            m.arguments[m.num_args++] = arena_copy_string(ctx->a, lex->string);
+        } while (lexer_get_token(lex) && lex->token == ',');
+
+        if (lex->token != ')') {
+            report_failure(ctx->filename, lex, "macro arguments");
+            return false;
+        }
+        // fallthrough
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+    case '\\':
+    expression:
+        ctx->expression.size = 0;
+        while (lex->parse_point < lex->eof) {
+            if (*lex->parse_point == '\r' || *lex->parse_point == '\n') {
+                break;
+            }
+            if (*lex->parse_point == '\\' && lex->parse_point + 1 < lex->eof) {
+                char* next = lex->parse_point + 1;
+                if (*next == '\r' && next + 1 < lex->eof && *(next + 1) == '\n') {
+                    ++next;
+                }
+                if (*next == '\r' || *next == '\n') {
+                    lex->parse_point = next + 1;
+                    continue;
                 }
             }
-            if (!found)
-                append_bytes_to_buffer(output, before, ctx.lex->parse_point - before);
-        } else {
-            append_bytes_to_buffer(output, before, ctx.lex->parse_point - before);
+            append_bytes_to_buffer(&ctx->expression, lex->parse_point, 1);
+            lex->parse_point++;
         }
+        m.expression = arena_copy_string_n(ctx->a, ctx->expression.ptr, ctx->expression.size);
+        tokenize_macro(ctx->a, &m);
+        mutex_lock(&table_creation_lock);
+        shput(*ctx->map, macro, m);
+        mutex_unlock(&table_creation_lock);
+        return true;
+    default:
+        report_failure(ctx->filename, lex, "macro definition");
+        return false;
     }
-    return true;
 }
 
 static bool gather_macro_definitions(ctx_t* ctx)
@@ -282,164 +491,514 @@ static bool gather_macro_definitions(ctx_t* ctx)
             continue;
         }
         lex->parse_point += 2; // \n#
-        if (!stb_c_lexer_get_token(lex) || lex->token != CLEX_id) {
+        if (!lexer_get_token(lex) || lex->token != CLEX_id) {
             report_failure(ctx->filename, lex, "preprocessor directive");
             return false;
         }
         if (strcmp("define", lex->string)) {
             continue;
         }
-        if (!stb_c_lexer_get_token(lex) || lex->token != CLEX_id) {
-            report_failure(ctx->filename, lex, "macro");
+        if (!parse_define(ctx)) {
             return false;
         }
+    }
+    return true;
+}
+
+static uint64_t hash_bytes(const char* bytes, int64_t size)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325u;
+    for (int64_t i = 0; i < size; ++i) {
+        hash ^= (uint8_t) bytes[i];
+        hash *= 0x100000001b3u;
+    }
+    return hash;
+}
+
+static bool load_macro_cache(const macro_cache_header_t* expected)
+{
+    char* data;
+    int64_t size;
+    // A missing cache is expected the first time, so check for it quietly before reading it
+    FILE* f = fopen(macro_cache_path, "rb");
+    if (f == NULL) return false;
+    fclose(f);
+    if (!read_file_data(macro_cache_path, &data, &size)) return false;
+
+    macro_cache_header_t header;
+    if ((size_t) size < sizeof(header)) goto invalid;
+    memcpy(&header, data, sizeof(header));
+    size_t records_size = sizeof(macro_cache_record_t) * header.count;
+    if (header.magic != expected->magic || header.version != expected->version
+        || header.mtime != expected->mtime || header.size != expected->size
+        || header.hash != expected->hash
+        || (size_t) size != sizeof(header) + records_size + header.strings_size) {
+        goto invalid;
+    }
+    const macro_cache_record_t* records = (const macro_cache_record_t*) (data + sizeof(header));
+    char* strings = data + sizeof(header) + records_size;
+    // Every offset must point into the string block, which must end a string, so a damaged cache
+    // of the right size can't send the table reading outside it. Checked before anything is added
+    // to the table, as it would point into the freed file otherwise.
+    if (header.strings_size == 0 || strings[header.strings_size - 1] != '\0') goto invalid;
+    for (uint32_t i = 0; i < header.count; ++i) {
+        if (records[i].name >= header.strings_size || records[i].expression >= header.strings_size
+            || records[i].num_args < 0 || records[i].num_args > MAX_ARGS) {
+            goto invalid;
+        }
+        for (int j = 0; j < records[i].num_args; ++j) {
+            if (records[i].arguments[j] >= header.strings_size) goto invalid;
+        }
+    }
+    for (uint32_t i = 0; i < header.count; ++i) {
         macro_definition_t m = { 0 };
-        char* macro = arena_copy_string(ctx->a, lex->string);
-        switch (*lex->parse_point) {
-        case '(':
-            stb_c_lexer_get_token(lex); // (
-            do {
-                while (lex->parse_point != lex->eof && isspace(*lex->parse_point))
-                    ++lex->parse_point;
-                if (!strncmp("...", lex->parse_point, 3)) {
-                    m.variadic = true;
-                    lex->parse_point += 3;
-                    if (!stb_c_lexer_get_token(lex) || lex->token != ')') {
-                        report_failure(ctx->filename, lex, ") after variadic macro definition");
-                        return false;
-                    }
-                    break;
-                }
-                if (!stb_c_lexer_get_token(lex) || lex->token != CLEX_id) {
-                    report_failure(ctx->filename, lex, "macro argument");
-                    return false;
-                }
-                m.arguments[m.num_args++] = arena_copy_string(ctx->a, lex->string);
-            } while (stb_c_lexer_get_token(lex) && lex->token == ',');
+        m.expression = strings + records[i].expression;
+        m.num_args = records[i].num_args;
+        m.variadic = records[i].variadic;
+        m.function_like = records[i].function_like;
+        for (int j = 0; j < m.num_args; ++j) {
+            m.arguments[j] = strings + records[i].arguments[j];
+        }
+        tokenize_macro(&clay_h_macros.arena, &m);
+        shput(clay_h_macros.map, strings + records[i].name, m);
+    }
+    // The cache file itself backs every string in the table
+    clay_h_macros.cache_data = data;
+    return true;
+invalid:
+    free(data);
+    return false;
+}
 
-            if (lex->token != ')') {
-                report_failure(ctx->filename, lex, "macro arguments");
-                return false;
-            }
-            // fallthrough
-        case ' ':
-        case '\t':
-        case '\r':
-        case '\n':
-        case '\\':
-            m.expression = arena_append_point(ctx->a);
-            while (lex->parse_point < lex->eof) {
-                if (*lex->parse_point == '\r' || *lex->parse_point == '\n') {
-                    arena_append_char(ctx->a, '\0');
-                    break;
-                }
-                if (*lex->parse_point == '\\') {
-                    if (*(lex->parse_point + 1) == '\r') {
-                        lex->parse_point += 1;
-                    }
-                    if (*(lex->parse_point + 1) == '\n') {
-                        lex->parse_point += 2;
-                    }
-                    continue;
-                }
-                arena_append_char(ctx->a, *lex->parse_point);
-                lex->parse_point++;
-            }
-            ctx->a->size++;
-            shput(*ctx->map, macro, m);
-            break;
-        default:
-            report_failure(ctx->filename, lex, "macro definition");
-            return false;
+static uint32_t append_cache_string(buffer_t* strings, const char* s)
+{
+    uint32_t offset = (uint32_t) strings->size;
+    append_bytes_to_buffer(strings, s, strlen(s) + 1);
+    return offset;
+}
+
+static void save_macro_cache(const macro_cache_header_t* key)
+{
+    macro_cache_header_t header = *key;
+    header.count = (uint32_t) shlenu(clay_h_macros.map);
+    macro_cache_record_t* records = calloc(header.count ? header.count : 1, sizeof(*records));
+    buffer_t strings = { .ptr = malloc_assert(4096), .capacity = 4096, .size = 0 };
+    assert(records);
+    for (uint32_t i = 0; i < header.count; ++i) {
+        const macro_definition_t* m = &clay_h_macros.map[i].value;
+        records[i].name = append_cache_string(&strings, clay_h_macros.map[i].key);
+        records[i].expression = append_cache_string(&strings, m->expression);
+        records[i].num_args = m->num_args;
+        records[i].variadic = m->variadic;
+        records[i].function_like = m->function_like;
+        for (int j = 0; j < m->num_args; ++j) {
+            records[i].arguments[j] = append_cache_string(&strings, m->arguments[j]);
         }
     }
+    header.strings_size = (uint32_t) strings.size;
+
+    // Written beside the cache and renamed over it, so processes sharing the cache never read one
+    // that is half written. The name is unique to the process, as they may write it at once.
+    size_t length = strlen(macro_cache_path);
+    char* temporary = malloc_assert(length + 32);
+    snprintf(temporary, length + 32, "%s.%ld.tmp", macro_cache_path, (long) getpid());
+    FILE* f = fopen(temporary, "wb");
+    bool ok = f && fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(records, sizeof(*records), header.count, f) == header.count
+        && fwrite(strings.ptr, 1, strings.size, f) == strings.size;
+    ok = f && fclose(f) == 0 && ok;
+#ifdef _WIN32
+    // rename() doesn't replace files on Windows
+    ok = ok && (remove(macro_cache_path) == 0 || errno == ENOENT);
+#endif
+    ok = ok && rename(temporary, macro_cache_path) == 0;
+    if (!ok) {
+        remove(temporary);
+        fprintf(stderr, "Unable to write macro cache %s\n", macro_cache_path);
+    }
+    free(temporary);
+    free(records);
+    free(strings.ptr);
+}
+
+static bool gather_clay_h_macros(char* clay_h_data, int64_t clay_h_size)
+{
+    stb_lexer clay_lexer;
+    stb_c_lexer_init(&clay_lexer, clay_h_data, clay_h_data + clay_h_size,
+        malloc_assert(LEXER_STORAGE_SIZE), LEXER_STORAGE_SIZE);
+    ctx_t clay_h_ctx = {
+        .filename = "clay.h",
+        .lex = &clay_lexer,
+        .map = &clay_h_macros.map,
+        .a = &clay_h_macros.arena
+    };
+    bool ok = gather_macro_definitions(&clay_h_ctx);
+    free(clay_lexer.string_storage);
+    free(clay_h_ctx.expression.ptr);
+    if (!ok) {
+        fprintf(stderr, "Error collecting clay.h definitions\n");
+        return false;
+    }
+    // These macros are easier to handle in a custom manner
+    shdel(clay_h_macros.map, "CLAY");
+    shdel(clay_h_macros.map, "CLAY_TEXT");
+    shdel(clay_h_macros.map, "CLAY_TEXT_CONFIG");
+    shdel(clay_h_macros.map, "CLAY_STRING");
+    shdel(clay_h_macros.map, "CLAY_ID");
+    ptrdiff_t index = shgeti(clay_h_macros.map, "CLAY__CONFIG_WRAPPER");
+    if (index != -1) {
+        macro_definition_t* m = &clay_h_macros.map[index].value;
+        m->expression = arena_copy_string(&clay_h_macros.arena, "(type) { __VA_ARGS__ }");
+        tokenize_macro(&clay_h_macros.arena, m);
+    }
     return true;
 }
 
-bool replace_macros(const char* filename, stb_lexer* lex, char** file_data, int64_t* size)
+static void load_clay_h_macros_locked(void)
 {
-    bool ret = false;
-    macro_t* map = NULL;
+    if (clay_h_macros.loaded) return;
+    clay_h_macros.loaded = true;
 
-    char* clay_h_data = NULL;
-    int64_t clay_h_size;
-    arena_t clay_arena = { 0 };
-    if (!read_file_data("clay/clay.h", &clay_h_data, &clay_h_size)) {
+    source_t clay_h;
+    if (!source_open(CLAY_H_PATH, &clay_h)) {
         fprintf(stderr, "Unable to open or read clay.h, macros will not be available\n");
+        return;
+    }
+    struct stat st;
+    macro_cache_header_t key = {
+        .magic = MACRO_CACHE_MAGIC,
+        .version = MACRO_CACHE_VERSION,
+        .mtime = stat(CLAY_H_PATH, &st) == 0 ? (int64_t) st.st_mtime : 0,
+        .size = clay_h.size,
+        .hash = hash_bytes(clay_h.data, clay_h.size),
+    };
+    if (macro_cache_path && load_macro_cache(&key)) {
+        source_close(&clay_h);
+        return;
+    }
+    if (gather_clay_h_macros(clay_h.data, clay_h.size)) {
+        if (macro_cache_path) {
+            save_macro_cache(&key);
+        }
     } else {
-        stb_lexer clay_lexer;
-        char* storage = malloc(256);
-        stb_c_lexer_init(&clay_lexer, clay_h_data, clay_h_data + clay_h_size, storage, 256);
-        clay_arena = arena_init(clay_h_size);
-        ctx_t clay_h_ctx = {
-            .filename = "clay.h",
-            .lex = &clay_lexer,
-            .map = &map,
-            .a = &clay_arena
-        };
-        if (!gather_macro_definitions(&clay_h_ctx)) {
-            fprintf(stderr, "Error collecting clay.h definitions\n");
-            shfree(map);
-            map = NULL;
+        shfree(clay_h_macros.map);
+        clay_h_macros.map = NULL;
+    }
+    source_close(&clay_h);
+}
+
+static void load_clay_h_macros(void)
+{
+    mutex_lock(&clay_h_macros_lock);
+    load_clay_h_macros_locked();
+    mutex_unlock(&clay_h_macros_lock);
+}
+
+void set_macro_cache_path(const char* path)
+{
+    macro_cache_path = path;
+}
+
+void free_clay_h_macros(void)
+{
+    shfree(clay_h_macros.map);
+    arena_destory(clay_h_macros.arena);
+    free(clay_h_macros.cache_data);
+    clay_h_macros = (clay_h_macros_t) { 0 };
+}
+
+static void report_token_failure(pp_t* pp, const pp_token_t* t, const char* expected)
+{
+    stb_lex_location loc;
+    stb_c_lexer_get_location(&pp->lex, t->where ? t->where : pp->lex.parse_point, &loc);
+    fprintf(stderr, "Unexpected token at %s:%d:%d\n", pp->ctx.filename, loc.line_number,
+        loc.line_offset);
+    fprintf(stderr, "Expected %s\n", expected);
+}
+
+static bool at_line_start(const stb_lexer* lex, const char* p)
+{
+    while (p > lex->input_stream && (p[-1] == ' ' || p[-1] == '\t'))
+        --p;
+    return p == lex->input_stream || p[-1] == '\n' || p[-1] == '\r';
+}
+
+static void skip_directive(stb_lexer* lex)
+{
+    char* p = lex->parse_point;
+    while (p < lex->eof && *p != '\n') {
+        if (*p == '\\' && p + 1 < lex->eof && (p[1] == '\r' || p[1] == '\n')) {
+            p += (p[1] == '\r' && p + 2 < lex->eof && p[2] == '\n') ? 3 : 2;
+            continue;
         }
-        // These macros are easier to handle in a custom manner
-        shdel(map, "CLAY");
-        shdel(map, "CLAY_TEXT");
-        shdel(map, "CLAY_TEXT_CONFIG");
-        shdel(map, "CLAY_STRING");
-        shdel(map, "CLAY_ID");
-        int index = shgeti(map, "CLAY__CONFIG_WRAPPER");
-        map[index].value.expression = arena_copy_string(&clay_arena, "(type) { __VA_ARGS__ }");
-        free(storage);
-    }
-
-    buffer_t output_buffer = { 0 };
-    if (!read_file_data(filename, file_data, size)) return false;
-    char* storage = (char*) malloc_assert(*size);
-    arena_t arena = arena_init(*size);
-    stb_c_lexer_init(lex, *file_data, (*file_data) + *size, storage, *size);
-
-    ctx_t ctx = {
-        .a = &arena,
-        .lex = lex,
-        .filename = filename,
-        .map = &map
-    };
+        ++p;
+    }
+    lex->parse_point = p;
+}
 
-    // gather all macro definitions first
-    if (!gather_macro_definitions(&ctx)) goto cleanup;
+static bool pp_directive(pp_t* pp)
+{
+    stb_lexer* lex = &pp->lex;
+    char* name = lex->parse_point;
+    if (lexer_get_token(lex) && lex->token == CLEX_id && !strcmp("define", lex->string)) {
+        return parse_define(&pp->ctx);
+    }
+    // Everything else, #include included, is ignored
+    lex->parse_point = name;
+    skip_directive(lex);
+    return true;
+}
 
-    output_buffer.ptr = (char*) malloc(*size);
-    output_buffer.capacity = *size;
-    output_buffer.size = 0;
-    stb_c_lexer_init(lex, *file_data, (*file_data) + *size, storage, *size);
+static bool pp_lex(pp_t* pp, pp_token_t* out)
+{
+    stb_lexer* lex = &pp->lex;
+    while (lexer_get_token(lex)) {
+        if (lex->token == '#' && at_line_start(lex, lex->where_firstchar)) {
+            if (!pp_directive(pp)) {
+                pp->failed = true;
+                return false;
+            }
+            continue;
+        }
+        make_token(&pp->arena, lex, out);
+        return true;
+    }
+    return false;
+}
+
+static void pp_push_frame(pp_t* pp, pp_token_t* tokens, const char* macro, bool barrier)
+{
+    pp_frame_t frame = { .tokens = tokens, .next = 0, .macro = macro, .barrier = barrier };
+    arrput(pp->frames, frame);
+}
+
+static void pp_pop_frame(pp_t* pp)
+{
+    arrfree(arrlast(pp->frames).tokens);
+    arrpop(pp->frames);
+}
+
+static void pp_unread(pp_t* pp, const pp_token_t* t)
+{
+    pp_token_t* tokens = NULL;
+    arrput(tokens, *t);
+    pp_push_frame(pp, tokens, NULL, false);
+}
+
+/**
+ * @brief Gets the next token without expanding it, from the innermost expansion or the source
+ */
+static bool pp_raw_next(pp_t* pp, pp_token_t* out)
+{
+    while (arrlenu(pp->frames)) {
+        pp_frame_t* frame = &arrlast(pp->frames);
+        if (frame->next < arrlenu(frame->tokens)) {
+            *out = frame->tokens[frame->next++];
+            return true;
+        }
+        if (frame->barrier) return false;
+        pp_pop_frame(pp);
+    }
+    return pp_lex(pp, out);
+}
 
+static bool pp_macro_active(const pp_t* pp, const char* name)
+{
+    for (size_t i = 0; i < arrlenu(pp->frames); ++i) {
+        if (pp->frames[i].macro && !strcmp(pp->frames[i].macro, name)) return true;
+    }
+    return false;
+}
 
-    while (true) {
-        char* before = lex->parse_point;
-        if (!stb_c_lexer_get_token(lex)) {
-            break;
+static bool pp_expand_next(pp_t* pp, pp_token_t* out);
+
+/**
+ * @brief Reads the arguments of a macro invocation up to the closing parenthesis
+ *
+ * Arguments past the named parameters of a variadic macro are collected, commas included, into
+ * `args[m->num_args]`.
+ */
+static bool pp_collect_arguments(pp_t* pp,
+                                 const macro_definition_t* m,
+                                 const pp_token_t* name,
+                                 pp_token_t* args[MAX_ARGS + 1])
+{
+    int i = 0;
+    int depth = 0;
+    pp_token_t t;
+    for (;;) {
+        if (!pp_raw_next(pp, &t)) {
+            report_token_failure(pp, name, ") after macro arguments");
+            return false;
         }
-        ptrdiff_t index = shgeti(map, lex->string);
-        if (lex->token != CLEX_id || index == -1) {
-            append_bytes_to_buffer(&output_buffer, before, lex->parse_point - before);
+        if (depth == 0 && t.token == ')') break;
+        if (depth == 0 && t.token == ',' && i < m->num_args) {
+            if (++i == m->num_args && !m->variadic) {
+                report_token_failure(pp, &t, "), too many macro arguments given");
+                return false;
+            }
             continue;
         }
-        replace_macro(ctx, &output_buffer, &map[index].value);
+        if (t.token == '(' || t.token == '{') {
+            ++depth;
+        } else if (t.token == ')' || t.token == '}') {
+            --depth;
+        }
+        arrput(args[i], t);
+    }
+    if (!m->variadic && (i < m->num_args - 1 || (m->num_args == 0 && arrlen(args[0])))) {
+        report_token_failure(pp, &t, "matching number of macro arguments");
+        fprintf(stderr, "%d given, %d expected\n", i + 1, m->num_args);
+        return false;
     }
+    return true;
+}
 
-    char* tmp = *file_data;
-    *file_data = output_buffer.ptr;
-    output_buffer.ptr = tmp;
-    *size = output_buffer.size;
+/**
+ * @brief Fully expands a list of tokens in place, without reading past its end
+ */
+static bool pp_expand_list(pp_t* pp, pp_token_t** list)
+{
+    size_t depth = arrlenu(pp->frames);
+    pp_push_frame(pp, *list, NULL, true);
+    *list = NULL;
+    pp_token_t t;
+    while (pp_expand_next(pp, &t)) {
+        arrput(*list, t);
+    }
+    while (arrlenu(pp->frames) > depth) {
+        pp_pop_frame(pp);
+    }
+    return !pp->failed;
+}
+
+static bool pp_expand_macro(pp_t* pp, const macro_definition_t* m, const pp_token_t* name)
+{
+    bool ret = false;
+    pp_token_t* args[MAX_ARGS + 1] = { 0 };
+    pp_token_t* expansion = NULL;
+    if (m->function_like) {
+        if (!pp_collect_arguments(pp, m, name, args)) goto cleanup;
+        for (int i = 0; i <= m->num_args; ++i) {
+            if (!pp_expand_list(pp, &args[i])) goto cleanup;
+        }
+    }
+    for (int i = 0; i < m->body_len; ++i) {
+        if (m->body[i].token == PP_PARAM) {
+            pp_token_t* arg = args[m->body[i].int_number];
+            for (size_t j = 0; j < arrlenu(arg); ++j) {
+                arrput(expansion, arg[j]);
+            }
+            continue;
+        }
+        // Errors in the expansion are reported at the macro it came from
+        pp_token_t t = m->body[i];
+        t.where = name->where;
+        arrput(expansion, t);
+    }
+    pp_push_frame(pp, expansion, name->string, false);
     ret = true;
-    stb_c_lexer_init(lex, *file_data, *file_data + *size, malloc(128), 128);
 cleanup:
-    shfree(map);
-    free(storage);
-    free(output_buffer.ptr);
-    free(clay_h_data);
-    arena_destory(arena);
-    arena_destory(clay_arena);
+    for (int i = 0; i <= MAX_ARGS; ++i) {
+        arrfree(args[i]);
+    }
     return ret;
 }
+
+static bool pp_expand_next(pp_t* pp, pp_token_t* out)
+{
+    for (;;) {
+        if (!pp_raw_next(pp, out)) return false;
+        if (out->token != CLEX_id) return true;
+        macro_definition_t* found = find_macro(&pp->ctx, out->string);
+        if (found == NULL || pp_macro_active(pp, out->string)) return true;
+        // A #define read while collecting arguments may move the map's entries
+        macro_definition_t m = *found;
+        if (m.function_like) {
+            pp_token_t next;
+            if (!pp_raw_next(pp, &next)) return true;
+            if (next.token != '(') {
+                pp_unread(pp, &next);
+                return true;
+            }
+        }
+        if (!pp_expand_macro(pp, &m, out)) {
+            pp->failed = true;
+            return false;
+        }
+    }
+}
+
+pp_t* pp_open(const char* filename)
+{
+    load_clay_h_macros();
+
+    pp_t* pp = (pp_t*) malloc_assert(sizeof(*pp));
+    memset(pp, 0, sizeof(*pp));
+    if (!source_open(filename, &pp->src)) {
+        free(pp);
+        return NULL;
+    }
+    // The source is lexed straight out of the mapping, only token strings are copied
+    stb_c_lexer_init(&pp->lex, pp->src.data, pp->src.data + pp->src.size,
+        malloc_assert(LEXER_STORAGE_SIZE), LEXER_STORAGE_SIZE);
+    pp->ctx = (ctx_t) {
+        .a = &pp->arena,
+        .lex = &pp->lex,
+        .filename = filename,
+        .map = &pp->map
+    };
+    pp->tok = (pp_token_t) { .token = CLEX_eof, .string = "" };
+    return pp;
+}
+
+void pp_close(pp_t* pp)
+{
+    if (pp == NULL) return;
+    while (arrlenu(pp->frames)) {
+        pp_pop_frame(pp);
+    }
+    arrfree(pp->frames);
+    shfree(pp->map);
+    arena_destory(pp->arena);
+    free(pp->ctx.expression.ptr);
+    free(pp->lex.string_storage);
+    source_close(&pp->src);
+    free(pp);
+}
+
+bool pp_next(pp_t* pp)
+{
+    if (pp->position == pp->produced) {
+        pp_token_t* t = &pp->history[pp->produced % PP_HISTORY_SIZE];
+        if (pp->failed || !pp_expand_next(pp, t)) {
+            pp->tok = (pp_token_t) { .token = CLEX_eof, .string = "", .where = pp->lex.eof };
+            return false;
+        }
+        pp->produced++;
+    }
+    pp->tok = pp->history[pp->position++ % PP_HISTORY_SIZE];
+    return true;
+}
+
+const pp_token_t* pp_token(const pp_t* pp)
+{
+    return &pp->tok;
+}
+
+size_t pp_tell(const pp_t* pp)
+{
+    return pp->position;
+}
+
+void pp_seek(pp_t* pp, size_t position)
+{
+    assert(position <= pp->produced && pp->produced - position <= PP_HISTORY_SIZE);
+    pp->position = position;
+}
+
+void pp_location(const pp_t* pp, stb_lex_location* loc)
+{
+    stb_c_lexer_get_location(&pp->lex, pp->tok.where ? pp->tok.where : pp->lex.parse_point, loc);
+}
@@ -2,10 +2,87 @@
 #define IMPORT_PREPROCESSOR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "stb_c_lexer.h"
 
-bool replace_macros(const char* filename, stb_lexer* lex, char** file_data, int64_t* size);
+/**
+ * @brief A token with any macros already expanded
+ *
+ * Mirrors the fields of `stb_lexer` the parser uses. `string` is always valid, and empty for
+ * tokens other than identifiers and string literals.
+ */
+typedef struct {
+    long token;
+    const char* string;
+    int string_len;
+    long int_number;
+    double real_number;
+    // Position in the source file, for tokens from a macro the position of the macro
+    const char* where;
+} pp_token_t;
+
+typedef struct pp_s pp_t;
+
+/**
+ * @brief Opens a file for reading as a stream of preprocessed tokens
+ *
+ * Macros, those from clay.h and those defined in the file itself, are expanded as the tokens
+ * are read. Other preprocessor directives are skipped.
+ *
+ * @param filename File to read
+ * @return `pp_t*` The token stream or `NULL` if the file couldn't be read
+ */
+pp_t* pp_open(const char* filename);
+
+/**
+ * @brief Closes a token stream opened with pp_open()
+ */
+void pp_close(pp_t* pp);
+
+/**
+ * @brief Reads the next token
+ *
+ * @return `bool` False at the end of the file or on a preprocessing error
+ */
+bool pp_next(pp_t* pp);
+
+/**
+ * @brief Gets the token last read, the pointer stays valid until the stream is closed
+ */
+const pp_token_t* pp_token(const pp_t* pp);
+
+/**
+ * @brief Gets the current position in the token stream, to return to with pp_seek()
+ */
+size_t pp_tell(const pp_t* pp);
+
+/**
+ * @brief Returns to a position from pp_tell(), at most 32 tokens back
+ *
+ * Like resetting `stb_lexer.parse_point`, this leaves the token last read unchanged.
+ */
+void pp_seek(pp_t* pp, size_t position);
+
+/**
+ * @brief Gets the line and column of the token last read
+ */
+void pp_location(const pp_t* pp, stb_lex_location* loc);
+
+/**
+ * @brief Sets a file to store the parsed clay.h macro table in between runs
+ *
+ * The cache is keyed by clay.h's modification time, size, and hash, and is rebuilt when any of
+ * them change. Must be called before the first import to take effect.
+ *
+ * @param path Path of the cache file, `NULL` disables the cache
+ */
+void set_macro_cache_path(const char* path);
+
+/**
+ * @brief Frees the clay.h macro table shared by all imports
+ */
+void free_clay_h_macros(void);
 
 #endif
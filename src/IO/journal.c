@@ -0,0 +1,640 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "journal.h"
+#include "snapshot.h"
+#include "task_queue.h"
+#include "ui_element.h"
+#include "utilities.h"
+
+// The journal is a header followed by records, each a record header and a payload padded to a
+// multiple of 8 bytes. The payload of a base record is a snapshot of the whole tree. Other records
+// start with the path to the element they change, its index under each ancestor from the root,
+// followed by a snapshot of the element, and for inserts everything under it.
+
+#define JOURNAL_MAGIC "CLAYJRNL"
+#define JOURNAL_VERSION 1
+// Rewritten from a new snapshot once the edits since the last one are larger than this, and than
+// the snapshot itself, so rewriting costs about as much as the edits did
+#define JOURNAL_COMPACT_SIZE (1u << 20)
+
+typedef enum {
+    JOURNAL_BASE = 1,
+    JOURNAL_INSERT,
+    JOURNAL_REMOVE,
+    JOURNAL_SET,
+} journal_record_type_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} journal_header_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t checksum;
+    uint32_t reserved;
+} journal_record_t;
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} journal_buffer_t;
+
+// Fonts of the trees the journal decodes itself, when compacting on the background thread and
+// when recovering, numbered in the order they're first seen. The font cache can't be used there,
+// and a recovered tree is given its fonts once all of the edits are replayed.
+typedef struct {
+    snapshot_font_t* fonts;
+    size_t count;
+    size_t capacity;
+} font_table_t;
+
+static struct {
+    char* path;
+    ui_element_t* root;
+    const snapshot_fonts_t* fonts;
+    // Records not yet handed to the background thread
+    journal_buffer_t pending;
+    // Records being written by the background thread, which owns them until its task is done
+    journal_buffer_t writing;
+    task_t* task;
+    // Only used by the background thread
+    FILE* file;
+    // The snapshot the journal starts with, and the records after it, which compacting replays
+    // onto a copy decoded from the snapshot, so the editor's tree is only encoded when replaced
+    journal_buffer_t base;
+    journal_buffer_t since_base;
+    bool failed;
+    // The next write replaces the journal with the pending records, which then start with a base
+    bool pending_rewrite;
+    bool rewrite;
+    time_t last_write;
+    // The last record pending, if it's a property change, which the next change of the same
+    // element replaces
+    ui_element_t* last_set;
+    size_t last_set_offset;
+} journal;
+
+static uint32_t checksum(const char* data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ (unsigned char) data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static size_t padded(size_t size)
+{
+    return (size + 7) & ~(size_t) 7;
+}
+
+static char* buffer_reserve(journal_buffer_t* b, size_t size)
+{
+    if (b->length + size > b->capacity) {
+        size_t capacity = b->capacity ? b->capacity : 4096;
+        while (capacity < b->length + size) {
+            capacity *= 2;
+        }
+        REALLOC_ASSERT(b->data, capacity);
+        b->capacity = capacity;
+    }
+    return b->data + b->length;
+}
+
+static void buffer_append(journal_buffer_t* b, const void* data, size_t size)
+{
+    if (size == 0) return;
+    memcpy(buffer_reserve(b, size), data, size);
+    b->length += size;
+}
+
+static void buffer_pad(journal_buffer_t* b)
+{
+    size_t padding = padded(b->length) - b->length;
+    memset(buffer_reserve(b, padding), 0, padding);
+    b->length += padding;
+}
+
+// Appends a record of `me`, which must be in the tree under the journal's root
+static void journal_append(journal_record_type_t type, ui_element_t* me, bool children)
+{
+    journal_buffer_t* b = &journal.pending;
+    size_t start = b->length;
+    journal_record_t record = { .type = (uint32_t) type };
+    buffer_append(b, &record, sizeof(record));
+
+    if (type != JOURNAL_BASE) {
+        uint32_t depth = 0;
+        for (ui_element_t* e = me; e != journal.root; e = e->parent) {
+            ++depth;
+        }
+        buffer_append(b, &depth, sizeof(depth));
+        uint32_t* path = (uint32_t*) buffer_reserve(b, sizeof(*path) * depth);
+        b->length += sizeof(*path) * depth;
+        for (ui_element_t* e = me; e != journal.root; e = e->parent) {
+            path[--depth] = (uint32_t) ui_element_index(e);
+        }
+        buffer_pad(b);
+    }
+    if (type != JOURNAL_REMOVE) {
+        size_t size;
+        char* snapshot = snapshot_encode(me, children, journal.fonts, &size);
+        buffer_append(b, snapshot, size);
+        free(snapshot);
+    }
+
+    size_t payload = start + sizeof(record);
+    record.size = (uint32_t) (b->length - payload);
+    record.checksum = checksum(b->data + payload, record.size);
+    memcpy(b->data + start, &record, sizeof(record));
+    buffer_pad(b);
+    journal.last_set = NULL;
+}
+
+// Whether `me` is in the journaled tree
+static bool journaled(ui_element_t* me)
+{
+    if (journal.path == NULL) return false;
+    while (me && me != journal.root) {
+        me = me->parent;
+    }
+    return me != NULL;
+}
+
+void journal_insert(ui_element_t* me)
+{
+    if (journaled(me)) {
+        journal_append(JOURNAL_INSERT, me, true);
+    }
+}
+
+void journal_remove(ui_element_t* me)
+{
+    if (journaled(me) && me != journal.root) {
+        journal_append(JOURNAL_REMOVE, me, false);
+    }
+}
+
+void journal_set(ui_element_t* me)
+{
+    if (!journaled(me)) return;
+    // Dragging or typing changes the same element every frame, only the last change matters
+    if (journal.last_set == me) {
+        journal.pending.length = journal.last_set_offset;
+    }
+    size_t offset = journal.pending.length;
+    journal_append(JOURNAL_SET, me, false);
+    journal.last_set = me;
+    journal.last_set_offset = offset;
+}
+
+static void buffer_append_header(journal_buffer_t* b)
+{
+    journal_header_t header = { .magic = JOURNAL_MAGIC, .version = JOURNAL_VERSION };
+    buffer_append(b, &header, sizeof(header));
+}
+
+// Drops the pending records for a base of the whole tree, which already includes them
+static void journal_rebase(void)
+{
+    journal.pending.length = 0;
+    buffer_append_header(&journal.pending);
+    journal_append(JOURNAL_BASE, journal.root, true);
+    journal.pending_rewrite = true;
+}
+
+static bool replay(ui_element_t** root, const journal_record_t* record, const char* payload,
+                   const snapshot_fonts_t* fonts);
+
+static bool table_describe(uint16_t id, snapshot_font_t* font, void* user_data)
+{
+    font_table_t* table = (font_table_t*) user_data;
+    if (id >= table->count || table->fonts[id].path == NULL) return false;
+    *font = table->fonts[id];
+    return true;
+}
+
+static uint16_t table_resolve(snapshot_font_t font, void* user_data)
+{
+    font_table_t* table = (font_table_t*) user_data;
+    for (size_t i = 0; i < table->count; ++i) {
+        const snapshot_font_t* f = &table->fonts[i];
+        if (f->size == font.size && (f->path == font.path
+                || (f->path && font.path && !strcmp(f->path, font.path)))) {
+            return (uint16_t) i;
+        }
+    }
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity ? table->capacity * 2 : 8;
+        REALLOC_ASSERT(table->fonts, sizeof(*table->fonts) * table->capacity);
+    }
+    char* path = NULL;
+    if (font.path) {
+        size_t length = strlen(font.path);
+        path = (char*) malloc_assert(length + 1);
+        memcpy(path, font.path, length + 1);
+    }
+    table->fonts[table->count] = (snapshot_font_t) { .path = path, .size = font.size };
+    return (uint16_t) table->count++;
+}
+
+static void table_free(font_table_t* table)
+{
+    for (size_t i = 0; i < table->count; ++i) {
+        free((char*) table->fonts[i].path);
+    }
+    free(table->fonts);
+}
+
+static bool sync_file(FILE* f)
+{
+    if (fflush(f) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// Replaces the journal with `b`, written beside it and renamed over it, so there's always a whole
+// one to recover
+static bool rewrite_file(const journal_buffer_t* b)
+{
+    if (journal.file) {
+        fclose(journal.file);
+        journal.file = NULL;
+    }
+    size_t length = strlen(journal.path);
+    char* temporary = (char*) malloc_assert(length + sizeof(".tmp"));
+    memcpy(temporary, journal.path, length);
+    memcpy(temporary + length, ".tmp", sizeof(".tmp"));
+    FILE* f = fopen(temporary, "wb");
+    bool ok = f && fwrite(b->data, 1, b->length, f) == b->length && sync_file(f);
+    ok = f && fclose(f) == 0 && ok;
+#ifdef _WIN32
+    // rename() doesn't replace files on Windows
+    remove(journal.path);
+#endif
+    ok = ok && rename(temporary, journal.path) == 0;
+    free(temporary);
+    if (ok) {
+        journal.file = fopen(journal.path, "ab");
+    }
+    return journal.file != NULL;
+}
+
+// Keeps the base a rewrite starts with, and the records after it, for compacting later
+static void keep_base(const journal_buffer_t* b)
+{
+    journal_record_t record;
+    memcpy(&record, b->data + sizeof(journal_header_t), sizeof(record));
+    size_t payload = sizeof(journal_header_t) + sizeof(record);
+    size_t end = payload + padded(record.size);
+    journal.base.length = 0;
+    buffer_append(&journal.base, b->data + payload, record.size);
+    journal.since_base.length = 0;
+    buffer_append(&journal.since_base, b->data + end, b->length - end);
+}
+
+// Replays the records since the base onto a tree decoded from it, which becomes the new base
+static bool compact(void)
+{
+    font_table_t table = { 0 };
+    snapshot_fonts_t table_fonts = { table_describe, table_resolve, &table };
+    const snapshot_fonts_t* fonts = journal.fonts ? &table_fonts : NULL;
+    ui_element_t* root
+        = snapshot_decode(journal.base.data, journal.base.length, fonts, "Autosave journal");
+    for (size_t offset = 0; root && offset < journal.since_base.length;) {
+        journal_record_t record;
+        memcpy(&record, journal.since_base.data + offset, sizeof(record));
+        const char* payload = journal.since_base.data + offset + sizeof(record);
+        if (!replay(&root, &record, payload, fonts)) {
+            ui_element_remove(root);
+            root = NULL;
+        }
+        offset += sizeof(record) + padded(record.size);
+    }
+    if (root == NULL) {
+        table_free(&table);
+        fprintf(stderr, "Unable to compact autosave journal %s\n", journal.path);
+        return false;
+    }
+    size_t size;
+    char* snapshot = snapshot_encode(root, true, fonts, &size);
+    ui_element_remove(root);
+    table_free(&table);
+    journal.base.length = 0;
+    buffer_append(&journal.base, snapshot, size);
+    free(snapshot);
+    journal.since_base.length = 0;
+    return true;
+}
+
+// Runs on the task queue's thread
+static void journal_write_task(void* arg)
+{
+    (void) arg;
+    journal_buffer_t* b = &journal.writing;
+    if (journal.rewrite) {
+        keep_base(b);
+        journal.failed = !rewrite_file(b);
+    } else {
+        buffer_append(&journal.since_base, b->data, b->length);
+        if (journal.failed
+            || (journal.since_base.length > JOURNAL_COMPACT_SIZE
+                && journal.since_base.length > journal.base.length)) {
+            // After a failure the file may be missing or half written, so it's rewritten whole,
+            // and compacted when that works. The records go back to the main thread anyway.
+            compact();
+            b->length = 0;
+            buffer_append_header(b);
+            journal_record_t record = {
+                .type = JOURNAL_BASE,
+                .size = (uint32_t) journal.base.length,
+                .checksum = checksum(journal.base.data, journal.base.length),
+            };
+            buffer_append(b, &record, sizeof(record));
+            buffer_append(b, journal.base.data, journal.base.length);
+            buffer_pad(b);
+            buffer_append(b, journal.since_base.data, journal.since_base.length);
+            journal.failed = !rewrite_file(b);
+        } else if (journal.file) {
+            journal.failed = fwrite(b->data, 1, b->length, journal.file) != b->length
+                || !sync_file(journal.file);
+        }
+    }
+    if (journal.failed) {
+        fprintf(stderr, "Unable to write autosave journal %s\n", journal.path);
+    }
+}
+
+static void journal_wait(void)
+{
+    if (journal.task) {
+        task_wait(journal.task);
+        task_free(journal.task);
+        journal.task = NULL;
+    }
+}
+
+static void journal_submit(void)
+{
+    journal_buffer_t swap = journal.writing;
+    journal.writing = journal.pending;
+    journal.pending = swap;
+    journal.pending.length = 0;
+    journal.rewrite = journal.pending_rewrite;
+    journal.pending_rewrite = false;
+    journal.last_set = NULL;
+    journal.task = task_submit(journal_write_task, NULL);
+}
+
+bool journal_open(const char* filename, ui_element_t* root, const snapshot_fonts_t* fonts)
+{
+    if (journal.path) return false;
+    size_t length = strlen(filename);
+    journal.path = (char*) malloc_assert(length + 1);
+    memcpy(journal.path, filename, length + 1);
+    journal.root = root;
+    journal.fonts = fonts;
+    journal.failed = false;
+    journal_rebase();
+    journal_submit();
+    return true;
+}
+
+void journal_reset(ui_element_t* root)
+{
+    if (journal.path == NULL) return;
+    journal.root = root;
+    journal_rebase();
+}
+
+void journal_flush(void)
+{
+    if (journal.path == NULL) return;
+    if (journal.task) {
+        if (!task_done(journal.task)) return;
+        task_free(journal.task);
+        journal.task = NULL;
+    }
+    if (journal.pending.length == 0) return;
+    time_t now = time(NULL);
+    if (now == journal.last_write) return;
+    journal.last_write = now;
+    journal_submit();
+}
+
+bool journal_busy(void)
+{
+    return journal.path && (journal.task || journal.pending.length);
+}
+
+void journal_close(bool discard)
+{
+    if (journal.path == NULL) return;
+    journal_wait();
+    if (journal.pending.length && !discard) {
+        journal_submit();
+        journal_wait();
+    }
+    if (journal.file) {
+        fclose(journal.file);
+    }
+    if (discard) {
+        remove(journal.path);
+    }
+    free(journal.pending.data);
+    free(journal.writing.data);
+    free(journal.base.data);
+    free(journal.since_base.data);
+    free(journal.path);
+    memset(&journal, 0, sizeof(journal));
+}
+
+static bool read_journal(const char* filename, char** data, size_t* size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) return false;
+    bool ok = false;
+    long length = -1;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        length = ftell(f);
+    }
+    if (length >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+        *size = (size_t) length;
+        *data = (char*) malloc_assert(*size ? *size : 1);
+        ok = fread(*data, 1, *size, f) == *size;
+        if (!ok) {
+            free(*data);
+        }
+    }
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "Unable to read autosave journal %s\n", filename);
+    }
+    return ok;
+}
+
+// Finds the element a record's path leads to, or for inserts, its parent and index
+static ui_element_t* follow_path(
+    ui_element_t* root, const char* payload, size_t size, bool insert, size_t* index, size_t* read)
+{
+    uint32_t depth;
+    if (size < sizeof(depth)) return NULL;
+    memcpy(&depth, payload, sizeof(depth));
+    if (depth > (size - sizeof(depth)) / sizeof(uint32_t) || (insert && depth == 0)) return NULL;
+    *read = padded(sizeof(depth) + sizeof(uint32_t) * (size_t) depth);
+    if (*read > size) return NULL;
+    ui_element_t* me = root;
+    for (uint32_t i = 0; i < depth; ++i) {
+        uint32_t child;
+        memcpy(&child, payload + sizeof(depth) + sizeof(child) * i, sizeof(child));
+        if (me->type != UI_ELEMENT_DECLARATION) return NULL;
+        if (insert && i == depth - 1) {
+            if (child > me->num_children) return NULL;
+            *index = child;
+            return me;
+        }
+        if (child >= me->num_children) return NULL;
+        me = ui_element_child_at(me, child);
+    }
+    return me;
+}
+
+// Takes the properties of `from`, which is then freed along with the properties `me` had
+static bool replace_properties(ui_element_t* me, ui_element_t* from)
+{
+    if (me->type != from->type) {
+        ui_element_remove(from);
+        return false;
+    }
+    if (me->type == UI_ELEMENT_DECLARATION) {
+        Clay_ElementDeclaration* ptr = me->ptr;
+        on_hover_config_t on_hover = me->on_hover;
+        me->ptr = from->ptr;
+        me->on_hover = from->on_hover;
+        from->ptr = ptr;
+        from->on_hover = on_hover;
+    } else {
+        dstring_t text = me->text;
+        Clay_TextElementConfig* text_config = me->text_config;
+        me->text = from->text;
+        me->text_config = from->text_config;
+        from->text = text;
+        from->text_config = text_config;
+    }
+    ui_element_remove(from);
+    ui_element_mark_dirty(me);
+    return true;
+}
+
+static bool replay(ui_element_t** root, const journal_record_t* record, const char* payload,
+                   const snapshot_fonts_t* fonts)
+{
+    if (record->type == JOURNAL_BASE) {
+        ui_element_t* base = snapshot_decode(payload, record->size, fonts, "Autosave journal");
+        if (base == NULL) return false;
+        ui_element_remove(*root);
+        *root = base;
+        return true;
+    }
+    if (*root == NULL) return false;
+    size_t index = 0, read = 0;
+    bool insert = record->type == JOURNAL_INSERT;
+    ui_element_t* me = follow_path(*root, payload, record->size, insert, &index, &read);
+    if (me == NULL) return false;
+    const char* snapshot = payload + read;
+    size_t snapshot_size = record->size - read;
+    if (record->type == JOURNAL_INSERT) {
+        ui_element_t* child = snapshot_decode(snapshot, snapshot_size, fonts, "Autosave journal");
+        if (child == NULL) return false;
+        ui_element_t* pos = index < me->num_children ? ui_element_child_at(me, index) : NULL;
+        ui_element_insert_child_before(me, pos, child);
+        return true;
+    } else if (record->type == JOURNAL_REMOVE) {
+        if (me == *root) return false;
+        ui_element_remove(me);
+        return true;
+    } else if (record->type == JOURNAL_SET) {
+        ui_element_t* from = snapshot_decode(snapshot, snapshot_size, fonts, "Autosave journal");
+        return from && replace_properties(me, from);
+    }
+    return false;
+}
+
+// Gives the text of a recovered tree the caller's font IDs in place of the table's
+static void resolve_fonts(ui_element_t* me, const font_table_t* table,
+                          const snapshot_fonts_t* fonts)
+{
+    if (me->type == UI_ELEMENT_TEXT) {
+        me->text_config->fontId = fonts->resolve(table->fonts[me->text_config->fontId],
+            fonts->user_data);
+        return;
+    }
+    for (ui_element_t* child = me->first_child; child; child = child->next) {
+        resolve_fonts(child, table, fonts);
+    }
+}
+
+ui_element_t* journal_recover(const char* filename, const snapshot_fonts_t* fonts)
+{
+    char* data;
+    size_t size;
+    if (!read_journal(filename, &data, &size)) return NULL;
+    journal_header_t header;
+    if (size < sizeof(header) || (memcpy(&header, data, sizeof(header)),
+            memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)))
+        || header.version != JOURNAL_VERSION) {
+        fprintf(stderr, "%s is not an autosave journal this version can recover\n", filename);
+        free(data);
+        return NULL;
+    }
+
+    font_table_t table = { 0 };
+    snapshot_fonts_t table_fonts = { table_describe, table_resolve, &table };
+    ui_element_t* root = NULL;
+    size_t offset = sizeof(header);
+    size_t replayed = 0;
+    while (size - offset >= sizeof(journal_record_t)) {
+        journal_record_t record;
+        memcpy(&record, data + offset, sizeof(record));
+        const char* payload = data + offset + sizeof(record);
+        // A record cut short by the crash ends the journal
+        if (record.size > size - offset - sizeof(record)
+            || checksum(payload, record.size) != record.checksum) {
+            break;
+        }
+        if (!replay(&root, &record, payload, fonts ? &table_fonts : NULL)) {
+            fprintf(stderr, "Autosave journal %s has an edit that can't be replayed\n", filename);
+            break;
+        }
+        ++replayed;
+        offset += sizeof(record) + padded(record.size);
+        if (offset > size) break;
+    }
+    free(data);
+    if (root) {
+        if (fonts) {
+            resolve_fonts(root, &table, fonts);
+        }
+        fprintf(stderr, "Recovered %zu autosaved edits from %s\n", replayed, filename);
+    }
+    table_free(&table);
+    return root;
+}
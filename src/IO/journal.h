@@ -0,0 +1,77 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+
+#include "snapshot.h"
+#include "ui_element.h"
+
+// Autosaves the editor's tree by appending each edit to a journal file, so work can be recovered
+// after a crash. Edits are queued on the main thread and written, and synced to disk, in batches
+// on the task queue's thread, so recording them never waits on the disk. The journal starts with a
+// snapshot of the whole tree, and is rewritten from a new snapshot once it grows large, made on the
+// background thread by replaying the edits onto a copy decoded from the last one.
+// Doesn't include concurrency.h, so it can be used next to raylib.
+
+/**
+ * @brief Starts journaling edits of `root` to `filename`, replacing any journal already there
+ *
+ * @param fonts Tells which font each text element uses, as snapshot_encode() takes it. Only used
+ * on the main thread, it must stay valid until the journal is closed. Can be NULL.
+ * @return `bool` False if a journal is already open
+ */
+bool journal_open(const char* filename, ui_element_t* root, const snapshot_fonts_t* fonts);
+
+/**
+ * @brief Rebuilds the tree from a journal left behind by a session that didn't close it
+ *
+ * Replays every edit after the last snapshot in the journal. Edits at the end that were only
+ * partly written are ignored.
+ *
+ * @param fonts Gives each recovered text element its font ID once every edit is replayed, can be
+ * NULL if the journal was opened without fonts
+ * @return `ui_element_t*` The recovered tree, or `NULL` if there is no journal or it can't be read
+ */
+ui_element_t* journal_recover(const char* filename, const snapshot_fonts_t* fonts);
+
+/**
+ * @brief Records that `me` and everything under it was added to the tree
+ */
+void journal_insert(ui_element_t* me);
+
+/**
+ * @brief Records that `me` is about to be removed from the tree, call it before removing it
+ */
+void journal_remove(ui_element_t* me);
+
+/**
+ * @brief Records the current properties of `me`, replacing its previous record if nothing was
+ * recorded in between
+ */
+void journal_set(ui_element_t* me);
+
+/**
+ * @brief Starts the journal over from `root`, for when the whole tree is replaced
+ */
+void journal_reset(ui_element_t* root);
+
+/**
+ * @brief Hands recorded edits to the background thread to write, call it once per frame
+ *
+ * Writes at most once a second, and only once the previous write has finished.
+ */
+void journal_flush(void);
+
+/**
+ * @brief Checks whether any edits are still to be written
+ */
+bool journal_busy(void);
+
+/**
+ * @brief Writes any remaining edits and closes the journal
+ *
+ * @param discard Deletes the journal too, for when the session ends normally
+ */
+void journal_close(bool discard);
+
+#endif // JOURNAL_H
@@ -0,0 +1,575 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clay_struct_names.h"
+#include "snapshot.h"
+#include "ui_element.h"
+#include "utilities.h"
+
+// A snapshot is a header followed by five arrays: the nodes, the declarations, the text configs,
+// the fonts and the characters of every string. Nodes are stored breadth first, so the children of
+// a node are the `num_children` nodes from `first_child`. The `fontId` of a stored text config is
+// its index in the fonts. Identical strings are stored once.
+
+#define SNAPSHOT_MAGIC "CLAYSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_HOVER_ENABLED 1u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t declaration_size;
+    uint32_t text_config_size;
+    uint32_t node_count;
+    uint32_t declaration_count;
+    uint32_t text_config_count;
+    uint32_t string_bytes;
+    uint32_t font_count;
+} snapshot_header_t;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} snapshot_string_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t flags;
+    uint32_t first_child;
+    uint32_t num_children;
+    // index into the declarations or text configs, by type
+    uint32_t config;
+    // index of the hover declaration + 1, 0 for none
+    uint32_t hover;
+    // ID of a declaration, or the text of a text element
+    snapshot_string_t string;
+    snapshot_string_t hover_id;
+    snapshot_string_t callback;
+} snapshot_node_t;
+
+typedef struct {
+    // empty if the font's file wasn't known
+    snapshot_string_t path;
+    uint32_t size;
+    // the ID it had when saved, used when loading without a snapshot_fonts_t
+    uint32_t id;
+} snapshot_font_entry_t;
+
+typedef struct {
+    ui_element_t** elements;
+    size_t element_count;
+    snapshot_node_t* nodes;
+    Clay_ElementDeclaration* declarations;
+    uint32_t declaration_count;
+    Clay_TextElementConfig* text_configs;
+    uint32_t text_config_count;
+    const snapshot_fonts_t* fonts;
+    snapshot_font_entry_t* font_entries;
+    uint32_t font_count;
+    uint32_t font_capacity;
+    char* strings;
+    uint32_t string_bytes;
+    uint32_t string_capacity;
+    // open addressing over `interned`, holding index + 1 or 0 for an empty slot
+    uint32_t* table;
+    uint32_t table_size;
+    snapshot_string_t* interned;
+    uint32_t interned_count;
+    bool children;
+} snapshot_writer_t;
+
+static uint32_t hash_chars(const char* chars, uint32_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; ++i) {
+        hash = (hash ^ (unsigned char) chars[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void grow_table(snapshot_writer_t* w)
+{
+    free(w->table);
+    w->table_size = w->table_size ? w->table_size * 2 : 256;
+    // kept at most half full
+    REALLOC_ASSERT(w->interned, sizeof(*w->interned) * (w->table_size / 2));
+    w->table = (uint32_t*) calloc(w->table_size, sizeof(*w->table));
+    assert(w->table);
+    uint32_t mask = w->table_size - 1;
+    for (uint32_t i = 0; i < w->interned_count; ++i) {
+        snapshot_string_t s = w->interned[i];
+        uint32_t slot = hash_chars(w->strings + s.offset, s.length) & mask;
+        while (w->table[slot]) slot = (slot + 1) & mask;
+        w->table[slot] = i + 1;
+    }
+}
+
+static snapshot_string_t intern(snapshot_writer_t* w, Clay_String s)
+{
+    if (s.length <= 0 || s.chars == NULL) {
+        return (snapshot_string_t) { 0 };
+    }
+    uint32_t length = (uint32_t) s.length;
+    if (w->interned_count == w->table_size / 2) {
+        grow_table(w);
+    }
+    uint32_t mask = w->table_size - 1;
+    uint32_t slot = hash_chars(s.chars, length) & mask;
+    for (; w->table[slot]; slot = (slot + 1) & mask) {
+        snapshot_string_t found = w->interned[w->table[slot] - 1];
+        if (found.length == length && !memcmp(w->strings + found.offset, s.chars, length)) {
+            return found;
+        }
+    }
+    if (w->string_bytes + length > w->string_capacity) {
+        uint32_t capacity = w->string_capacity ? w->string_capacity : 4096;
+        while (capacity < w->string_bytes + length) capacity *= 2;
+        REALLOC_ASSERT(w->strings, capacity);
+        w->string_capacity = capacity;
+    }
+    snapshot_string_t interned = { w->string_bytes, length };
+    memcpy(w->strings + w->string_bytes, s.chars, length);
+    w->string_bytes += length;
+    w->interned[w->interned_count++] = interned;
+    w->table[slot] = w->interned_count;
+    return interned;
+}
+
+// Pointers mean nothing in another session, and the ID string is stored separately
+static uint32_t add_declaration(snapshot_writer_t* w, const Clay_ElementDeclaration* d)
+{
+    Clay_ElementDeclaration* copy = &w->declarations[w->declaration_count];
+    memcpy(copy, d, sizeof(*copy));
+    copy->id.stringId = (Clay_String) { 0 };
+    copy->image.imageData = NULL;
+    copy->custom.customData = NULL;
+    copy->userData = NULL;
+    return w->declaration_count++;
+}
+
+// Each font is stored once, there are only ever a few
+static uint32_t add_font(snapshot_writer_t* w, uint16_t id)
+{
+    for (uint32_t i = 0; i < w->font_count; ++i) {
+        if (w->font_entries[i].id == id) return i;
+    }
+    if (w->font_count == w->font_capacity) {
+        w->font_capacity = w->font_capacity ? w->font_capacity * 2 : 8;
+        REALLOC_ASSERT(w->font_entries, sizeof(*w->font_entries) * w->font_capacity);
+    }
+    snapshot_font_entry_t* entry = &w->font_entries[w->font_count];
+    *entry = (snapshot_font_entry_t) { .id = id };
+    snapshot_font_t font;
+    if (w->fonts && w->fonts->describe(id, &font, w->fonts->user_data) && font.path) {
+        Clay_String path = { .length = (int32_t) strlen(font.path), .chars = font.path };
+        entry->path = intern(w, path);
+        entry->size = font.size;
+    }
+    return w->font_count++;
+}
+
+static void add_node(snapshot_writer_t* w, size_t index)
+{
+    ui_element_t* me = w->elements[index];
+    snapshot_node_t* node = &w->nodes[index];
+    memset(node, 0, sizeof(*node));
+    node->type = (uint32_t) me->type;
+    if (me->type == UI_ELEMENT_DECLARATION) {
+        node->config = add_declaration(w, me->ptr);
+        node->string = intern(w, me->ptr->id.stringId);
+        if (me->on_hover.ptr) {
+            node->hover = add_declaration(w, me->on_hover.ptr) + 1;
+            node->hover_id = intern(w, me->on_hover.ptr->id.stringId);
+        }
+        if (me->on_hover.enabled) {
+            node->flags |= SNAPSHOT_HOVER_ENABLED;
+        }
+        node->callback = intern(w, me->on_hover.callback);
+        // queued breadth first, so siblings end up next to each other
+        node->first_child = (uint32_t) w->element_count;
+        if (w->children) {
+            node->num_children = (uint32_t) me->num_children;
+            for (ui_element_t* child = me->first_child; child; child = child->next) {
+                w->elements[w->element_count++] = child;
+            }
+        }
+    } else {
+        Clay_TextElementConfig* copy = &w->text_configs[w->text_config_count];
+        memcpy(copy, me->text_config, sizeof(*copy));
+        copy->fontId = (uint16_t) add_font(w, me->text_config->fontId);
+        node->config = w->text_config_count++;
+        node->string = intern(w, me->text.s);
+    }
+}
+
+static size_t count_elements(ui_element_t* me, bool children, size_t* declarations)
+{
+    if (me->type != UI_ELEMENT_DECLARATION) return 1;
+    *declarations += me->on_hover.ptr ? 2 : 1;
+    size_t count = 1;
+    if (children) {
+        for (ui_element_t* child = me->first_child; child; child = child->next) {
+            count += count_elements(child, children, declarations);
+        }
+    }
+    return count;
+}
+
+char* snapshot_encode(ui_element_t* root, bool children, const snapshot_fonts_t* fonts,
+                      size_t* size)
+{
+    size_t max_declarations = 0;
+    size_t count = count_elements(root, children, &max_declarations);
+    snapshot_writer_t w = { .children = children, .fonts = fonts };
+    w.elements = (ui_element_t**) malloc_assert(sizeof(*w.elements) * count);
+    w.nodes = (snapshot_node_t*) malloc_assert(sizeof(*w.nodes) * count);
+    w.declarations = (Clay_ElementDeclaration*) malloc_assert(
+        sizeof(*w.declarations) * (max_declarations ? max_declarations : 1));
+    w.text_configs = (Clay_TextElementConfig*) malloc_assert(sizeof(*w.text_configs) * count);
+    w.elements[w.element_count++] = root;
+    for (size_t i = 0; i < w.element_count; ++i) {
+        add_node(&w, i);
+    }
+    assert(w.element_count == count);
+
+    snapshot_header_t header = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .declaration_size = sizeof(Clay_ElementDeclaration),
+        .text_config_size = sizeof(Clay_TextElementConfig),
+        .node_count = (uint32_t) count,
+        .declaration_count = w.declaration_count,
+        .text_config_count = w.text_config_count,
+        .string_bytes = w.string_bytes,
+        .font_count = w.font_count,
+    };
+    size_t node_bytes = sizeof(*w.nodes) * count;
+    size_t declaration_bytes = sizeof(*w.declarations) * w.declaration_count;
+    size_t text_config_bytes = sizeof(*w.text_configs) * w.text_config_count;
+    size_t font_bytes = sizeof(*w.font_entries) * w.font_count;
+    *size = sizeof(header) + node_bytes + declaration_bytes + text_config_bytes + font_bytes
+        + w.string_bytes;
+    char* data = (char*) malloc_assert(*size);
+    char* out = data;
+    memcpy(out, &header, sizeof(header));
+    memcpy(out += sizeof(header), w.nodes, node_bytes);
+    memcpy(out += node_bytes, w.declarations, declaration_bytes);
+    memcpy(out += declaration_bytes, w.text_configs, text_config_bytes);
+    if (font_bytes) {
+        memcpy(out + text_config_bytes, w.font_entries, font_bytes);
+    }
+    if (w.string_bytes) {
+        memcpy(out + text_config_bytes + font_bytes, w.strings, w.string_bytes);
+    }
+
+    free(w.elements);
+    free(w.nodes);
+    free(w.declarations);
+    free(w.text_configs);
+    free(w.font_entries);
+    free(w.strings);
+    free(w.table);
+    free(w.interned);
+    return data;
+}
+
+bool snapshot_save(const char* filename, ui_element_t* root, const snapshot_fonts_t* fonts)
+{
+    size_t size;
+    char* data = snapshot_encode(root, true, fonts, &size);
+    // Written beside the file and renamed over it, so a crash while saving keeps the last save
+    size_t length = strlen(filename);
+    char* temporary = (char*) malloc_assert(length + sizeof(".tmp"));
+    memcpy(temporary, filename, length);
+    memcpy(temporary + length, ".tmp", sizeof(".tmp"));
+    bool ok = false;
+    FILE* f = fopen(temporary, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open output file %s\n", temporary);
+    } else {
+        ok = fwrite(data, 1, size, f) == size;
+        ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+        // rename() doesn't replace files on Windows
+        remove(filename);
+#endif
+        ok = ok && rename(temporary, filename) == 0;
+        if (!ok) {
+            remove(temporary);
+            fprintf(stderr, "Unable to write output file %s\n", filename);
+        }
+    }
+    free(temporary);
+    free(data);
+    return ok;
+}
+
+static bool read_snapshot(const char* filename, char** data, size_t* size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open file %s\n", filename);
+        return false;
+    }
+    bool ok = false;
+    long length = -1;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        length = ftell(f);
+    }
+    if (length < 0 || fseek(f, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "Unable to get size of file %s\n", filename);
+    } else {
+        *size = (size_t) length;
+        *data = (char*) malloc(*size ? *size : 1);
+        if (*data == NULL) {
+            fprintf(stderr, "Unable to allocate memory for file data\n");
+        } else if (fread(*data, 1, *size, f) != *size) {
+            fprintf(stderr, "Unable to read %zu bytes from file %s\n", *size, filename);
+            free(*data);
+        } else {
+            ok = true;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+static bool string_valid(snapshot_string_t s, uint32_t string_bytes)
+{
+    return s.offset <= string_bytes && s.length <= string_bytes - s.offset
+        && s.length <= INT32_MAX;
+}
+
+// Enums are used as indices into their names, and bools must be 0 or 1 to be read as bools
+static bool fields_valid(const uint8_t* data, const struct_info_t* info)
+{
+    for (size_t i = 0; i < info->count; ++i) {
+        const uint8_t* member = data + info->offsets[i];
+        switch (info->info[i].type) {
+        case TYPE_BOOL:
+            if (*member > 1) return false;
+            break;
+        case TYPE_ENUM:
+            if (*member >= info->info[i].enum_info->count) return false;
+            break;
+        case TYPE_STRUCT:
+        case TYPE_UNION:
+            if (!fields_valid(member, info->info[i].struct_info)) return false;
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+static bool configs_valid(const snapshot_header_t* header,
+                          const Clay_ElementDeclaration* declarations,
+                          const Clay_TextElementConfig* text_configs,
+                          const snapshot_font_entry_t* font_entries)
+{
+    for (uint32_t i = 0; i < header->font_count; ++i) {
+        if (!string_valid(font_entries[i].path, header->string_bytes)
+            || font_entries[i].size > UINT16_MAX || font_entries[i].id > UINT16_MAX) {
+            return false;
+        }
+    }
+    const struct_info_t* declaration_info = STRUCT_INFO(Clay_ElementDeclaration);
+    const struct_info_t* text_config_info = STRUCT_INFO(Clay_TextElementConfig);
+    for (uint32_t i = 0; i < header->declaration_count; ++i) {
+        if (!fields_valid((const uint8_t*) &declarations[i], declaration_info)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->text_config_count; ++i) {
+        if (!fields_valid((const uint8_t*) &text_configs[i], text_config_info)
+            || text_configs[i].fontId >= header->font_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Everything the nodes refer to is in range, and the child ranges form a single tree
+static bool nodes_valid(const snapshot_header_t* header, const snapshot_node_t* nodes)
+{
+    uint64_t next_child = 1;
+    for (uint32_t i = 0; i < header->node_count; ++i) {
+        const snapshot_node_t* node = &nodes[i];
+        if (!string_valid(node->string, header->string_bytes)
+            || !string_valid(node->hover_id, header->string_bytes)
+            || !string_valid(node->callback, header->string_bytes)) {
+            return false;
+        }
+        if (node->type == UI_ELEMENT_DECLARATION) {
+            if (node->config >= header->declaration_count
+                || node->hover > header->declaration_count) {
+                return false;
+            }
+        } else if (node->type == UI_ELEMENT_TEXT) {
+            if (node->config >= header->text_config_count || node->num_children) {
+                return false;
+            }
+            continue;
+        } else {
+            return false;
+        }
+        if (node->first_child != next_child) {
+            return false;
+        }
+        next_child += node->num_children;
+    }
+    return next_child == header->node_count;
+}
+
+static const char* copy_string(const char* strings, snapshot_string_t s)
+{
+    if (s.length == 0) return NULL;
+    char* copy = (char*) malloc_assert(s.length + 1);
+    memcpy(copy, strings + s.offset, s.length);
+    copy[s.length] = '\0';
+    return copy;
+}
+
+// Font files as the snapshot_fonts_t is given them, indexed like the snapshot's fonts
+static snapshot_font_t* load_fonts(const snapshot_header_t* header,
+                                   const snapshot_font_entry_t* font_entries,
+                                   const char* strings)
+{
+    size_t count = header->font_count ? header->font_count : 1;
+    snapshot_font_t* fonts = (snapshot_font_t*) malloc_assert(sizeof(*fonts) * count);
+    for (uint32_t i = 0; i < header->font_count; ++i) {
+        fonts[i].path = copy_string(strings, font_entries[i].path);
+        fonts[i].size = (uint16_t) font_entries[i].size;
+    }
+    return fonts;
+}
+
+static ui_element_t* load_node(const snapshot_node_t* node,
+                               const Clay_ElementDeclaration* declarations,
+                               const Clay_TextElementConfig* text_configs,
+                               const snapshot_font_entry_t* font_entries,
+                               const snapshot_font_t* font_files,
+                               const snapshot_fonts_t* fonts,
+                               const char* strings)
+{
+    ui_element_t* me = ui_element_create((ui_element_type_t) node->type);
+    if (me->type == UI_ELEMENT_TEXT) {
+        memcpy(me->text_config, &text_configs[node->config], sizeof(*me->text_config));
+        uint16_t font = me->text_config->fontId;
+        me->text_config->fontId = fonts ? fonts->resolve(font_files[font], fonts->user_data)
+                                        : (uint16_t) font_entries[font].id;
+        me->text.s.chars = copy_string(strings, node->string);
+        me->text.s.length = (int32_t) node->string.length;
+        me->text.capacity = (int32_t) node->string.length;
+        return me;
+    }
+    memcpy(me->ptr, &declarations[node->config], sizeof(*me->ptr));
+    me->ptr->id.stringId.chars = copy_string(strings, node->string);
+    me->ptr->id.stringId.length = (int32_t) node->string.length;
+    if (node->hover) {
+        me->on_hover.ptr = ui_element_alloc_declaration();
+        memcpy(me->on_hover.ptr, &declarations[node->hover - 1], sizeof(*me->on_hover.ptr));
+        // Hover declarations start as a copy of the element's, sharing its ID string
+        Clay_String* hover_id = &me->on_hover.ptr->id.stringId;
+        if (!memcmp(&node->hover_id, &node->string, sizeof(node->string))) {
+            *hover_id = me->ptr->id.stringId;
+        } else {
+            hover_id->chars = copy_string(strings, node->hover_id);
+            hover_id->length = (int32_t) node->hover_id.length;
+        }
+    }
+    me->on_hover.enabled = (node->flags & SNAPSHOT_HOVER_ENABLED) != 0;
+    me->on_hover.callback.chars = copy_string(strings, node->callback);
+    me->on_hover.callback.length = (int32_t) node->callback.length;
+    return me;
+}
+
+ui_element_t* snapshot_decode(const char* data, size_t size, const snapshot_fonts_t* fonts,
+                              const char* name)
+{
+    snapshot_header_t header;
+    if (size < sizeof(header)) {
+        fprintf(stderr, "%s is not a layout snapshot\n", name);
+        return NULL;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic))) {
+        fprintf(stderr, "%s is not a layout snapshot\n", name);
+        return NULL;
+    }
+    if (header.version != SNAPSHOT_VERSION
+        || header.declaration_size != sizeof(Clay_ElementDeclaration)
+        || header.text_config_size != sizeof(Clay_TextElementConfig)) {
+        fprintf(stderr, "%s was saved by an incompatible version of clayouter\n", name);
+        return NULL;
+    }
+    // 64 bit sums of 32 bit counts times small sizes can't overflow
+    uint64_t expected = sizeof(header) + (uint64_t) header.node_count * sizeof(snapshot_node_t)
+        + (uint64_t) header.declaration_count * sizeof(Clay_ElementDeclaration)
+        + (uint64_t) header.text_config_count * sizeof(Clay_TextElementConfig)
+        + (uint64_t) header.font_count * sizeof(snapshot_font_entry_t) + header.string_bytes;
+    if (header.node_count == 0 || expected != size) {
+        fprintf(stderr, "Layout snapshot %s is truncated or corrupt\n", name);
+        return NULL;
+    }
+
+    // The header, nodes and declarations are all multiples of 8 bytes long, so each array is
+    // aligned if the data is
+    char* aligned = NULL;
+    if ((uintptr_t) data % sizeof(double)) {
+        aligned = (char*) malloc_assert(size);
+        memcpy(aligned, data, size);
+        data = aligned;
+    }
+    const snapshot_node_t* nodes = (const snapshot_node_t*) (data + sizeof(header));
+    const Clay_ElementDeclaration* declarations
+        = (const Clay_ElementDeclaration*) (nodes + header.node_count);
+    const Clay_TextElementConfig* text_configs
+        = (const Clay_TextElementConfig*) (declarations + header.declaration_count);
+    const snapshot_font_entry_t* font_entries
+        = (const snapshot_font_entry_t*) (text_configs + header.text_config_count);
+    const char* strings = (const char*) (font_entries + header.font_count);
+    if (!nodes_valid(&header, nodes)
+        || !configs_valid(&header, declarations, text_configs, font_entries)) {
+        fprintf(stderr, "Layout snapshot %s is truncated or corrupt\n", name);
+        free(aligned);
+        return NULL;
+    }
+
+    snapshot_font_t* font_files = load_fonts(&header, font_entries, strings);
+    ui_element_t** elements
+        = (ui_element_t**) malloc_assert(sizeof(*elements) * header.node_count);
+    for (uint32_t i = 0; i < header.node_count; ++i) {
+        elements[i] = load_node(
+            &nodes[i], declarations, text_configs, font_entries, font_files, fonts, strings);
+    }
+    for (uint32_t i = 0; i < header.font_count; ++i) {
+        free((char*) font_files[i].path);
+    }
+    free(font_files);
+    for (uint32_t i = 0; i < header.node_count; ++i) {
+        for (uint32_t j = 0; j < nodes[i].num_children; ++j) {
+            ui_element_append_child(elements[i], elements[nodes[i].first_child + j]);
+        }
+    }
+    ui_element_t* root = elements[0];
+    free(elements);
+    free(aligned);
+    return root;
+}
+
+ui_element_t* snapshot_load(const char* filename, const snapshot_fonts_t* fonts)
+{
+    char* data;
+    size_t size;
+    if (!read_snapshot(filename, &data, &size)) return NULL;
+    ui_element_t* root = snapshot_decode(data, size, fonts, filename);
+    free(data);
+    return root;
+}
@@ -0,0 +1,68 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ui_element.h"
+
+// Snapshots save an editor session in a binary form that loads without going through the
+// preprocessor and parser. Declarations and text configs are stored as they are laid out in
+// memory, so a snapshot only loads in a build of clayouter whose Clay structs match the one that
+// saved it. Export the layout as C code to keep it across versions.
+
+// A font by the file it's loaded from and the size it's loaded at
+typedef struct {
+    const char* path;
+    uint16_t size;
+} snapshot_font_t;
+
+// Font IDs only mean something to the run that loaded the fonts, so snapshots store the file and
+// size of each font instead, and look the IDs up again when decoded. Without this, font IDs are
+// stored as they are, the same as in exported layouts.
+typedef struct {
+    // Gets the font `id` refers to, false if there's none
+    bool (*describe)(uint16_t id, snapshot_font_t* font, void* user_data);
+    // Gets the font ID of a decoded text element, `font.path` is NULL if it wasn't known
+    uint16_t (*resolve)(snapshot_font_t font, void* user_data);
+    void* user_data;
+} snapshot_fonts_t;
+
+/**
+ * @brief Saves `root` and everything under it to `filename`
+ *
+ * @param fonts Tells which font each text element uses, can be NULL
+ * @return `bool` False if the file couldn't be written
+ */
+bool snapshot_save(const char* filename, ui_element_t* root, const snapshot_fonts_t* fonts);
+
+/**
+ * @brief Loads a tree saved by snapshot_save()
+ *
+ * @param fonts Gives each text element its font ID, can be NULL
+ * @return `ui_element_t*` Root of the loaded tree, without a parent, or `NULL` if the file couldn't
+ * be read or isn't a snapshot this build can load
+ */
+ui_element_t* snapshot_load(const char* filename, const snapshot_fonts_t* fonts);
+
+/**
+ * @brief Encodes `root` as a snapshot in memory, as snapshot_save() would write it
+ *
+ * @param children Whether to include the elements under `root`, or only `root` itself
+ * @param size Receives the size of the snapshot
+ * @return `char*` The snapshot, free it with free()
+ */
+char* snapshot_encode(ui_element_t* root, bool children, const snapshot_fonts_t* fonts,
+                      size_t* size);
+
+/**
+ * @brief Decodes a snapshot made by snapshot_encode()
+ *
+ * @param name What to call the snapshot in error messages
+ * @return `ui_element_t*` Root of the decoded tree, or `NULL` if it isn't a valid snapshot
+ */
+ui_element_t* snapshot_decode(const char* data, size_t size, const snapshot_fonts_t* fonts,
+                              const char* name);
+
+#endif // SNAPSHOT_H
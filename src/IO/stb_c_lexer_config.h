@@ -41,8 +41,9 @@
 #define STB_C_LEX_DEFINE_ALL_TOKEN_NAMES  N   // if Y, all CLEX_ token names are defined, even if never returned
                                               // leaving it as N should help you catch config bugs
 
-#define STB_C_LEX_DISCARD_PREPROCESSOR    Y   // discard C-preprocessor directives (e.g. after prepocess
+#define STB_C_LEX_DISCARD_PREPROCESSOR    N   // discard C-preprocessor directives (e.g. after prepocess
                                               // still have #line, #pragma, etc)
+                                              // (handled by import_preprocessor.c instead)
 
 //#define STB_C_LEX_ISWHITE(str)    ... // return length in bytes of whitespace characters if first char is whitespace
 
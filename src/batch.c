@@ -0,0 +1,397 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "clay.h"
+#include "clay_renderer_software.h"
+#include "clay_utf8.h"
+#include "batch.h"
+#include "tiled_render.h"
+#include "ui_element.h"
+#include "IO/export_layout.h"
+#include "IO/import_layout.h"
+#include "IO/import_preprocessor.h"
+#include "utilities.h"
+
+#define BATCH_LAYOUT_WIDTH (1600)
+#define BATCH_LAYOUT_HEIGHT (900)
+// Rasterized from codepoint 32 on, like LoadFontEx() with no codepoints given
+#define BATCH_FONT_GLYPH_COUNT (400)
+
+typedef struct {
+    const char* output_dir;
+    bool layout;
+    bool thumbnails;
+    const char* font_path;
+    size_t jobs;
+} batch_options_t;
+
+typedef struct {
+    char** paths;
+    size_t count;
+} batch_files_t;
+
+typedef struct {
+    void* memory;
+    size_t errors;
+} batch_clay_t;
+
+static batch_clay_t clay;
+
+typedef struct {
+    uint16_t size;
+    GlyphInfo* glyphs;
+    Clay_Software_Glyph* software;
+} batch_font_size_t;
+
+// Every font ID is drawn with the one font, rasterized on the CPU at each size used
+static struct {
+    unsigned char* data;
+    int data_size;
+    batch_font_size_t* sizes;
+    size_t count;
+} font;
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "Usage: clayouter --batch [options] <file or directory>...\n"
+        "  -o, --output <dir>    write exported layouts to <dir> (default: working directory)\n"
+        "  --layout              run a Clay layout pass over each imported layout\n"
+        "  -j, --jobs <n>        import on <n> threads (default: one per processor)\n"
+        "  --macro-cache <file>  keep the parsed clay.h macros in <file> between runs\n"
+        "  --thumbnails          also render each layout to a PNG next to it, implies --layout\n"
+        "  --font <file>         font to measure and draw text with for thumbnails\n"
+        "                        (default: resources/Roboto-Regular.ttf)\n");
+}
+
+static void batch_clay_error(Clay_ErrorData err)
+{
+    fprintf(stderr, "CLAY ERROR: %d, %.*s\n", (int) err.errorType, (int) err.errorText.length,
+        err.errorText.chars);
+    clay.errors++;
+}
+
+// Stands in for Raylib_MeasureText, which needs a font loaded on the GPU. Every glyph is
+// assumed to be half an em wide, which is close to Roboto's average advance.
+static Clay_Dimensions batch_measure_text(Clay_StringSlice text,
+                                          Clay_TextElementConfig* config,
+                                          void* user_data)
+{
+    (void) user_data;
+    float advance = (float) config->fontSize / 2 + config->letterSpacing;
+    float max_width = 0;
+    float line_width = 0;
+    for (int32_t i = 0; i < text.length; ++i) {
+        if (text.chars[i] == '\n') {
+            max_width = max_width > line_width ? max_width : line_width;
+            line_width = 0;
+            continue;
+        }
+        line_width += advance;
+    }
+    max_width = max_width > line_width ? max_width : line_width;
+    return (Clay_Dimensions) { max_width, (float) config->fontSize };
+}
+
+static const batch_font_size_t* font_size(uint16_t size)
+{
+    for (size_t i = 0; i < font.count; ++i) {
+        if (font.sizes[i].size == size) return &font.sizes[i];
+    }
+    if (font.data == NULL || size == 0) return NULL;
+    GlyphInfo* glyphs
+        = LoadFontData(font.data, font.data_size, size, NULL, BATCH_FONT_GLYPH_COUNT, FONT_DEFAULT);
+    if (glyphs == NULL) return NULL;
+    Clay_Software_Glyph* software
+        = (Clay_Software_Glyph*) malloc_assert(sizeof(*software) * BATCH_FONT_GLYPH_COUNT);
+    for (int i = 0; i < BATCH_FONT_GLYPH_COUNT; ++i) {
+        // Glyph images are greyscale, one byte of coverage per pixel
+        software[i] = (Clay_Software_Glyph) {
+            .alpha = (const unsigned char*) glyphs[i].image.data,
+            .width = glyphs[i].image.width,
+            .height = glyphs[i].image.height,
+            .offsetX = glyphs[i].offsetX,
+            .offsetY = glyphs[i].offsetY,
+            .advanceX = glyphs[i].advanceX,
+        };
+    }
+    REALLOC_ASSERT(font.sizes, sizeof(*font.sizes) * (font.count + 1));
+    font.sizes[font.count] = (batch_font_size_t) { size, glyphs, software };
+    return &font.sizes[font.count++];
+}
+
+static const Clay_Software_Glyph* font_glyph(uint16_t font_id,
+                                             uint16_t size,
+                                             int codepoint,
+                                             void* user_data)
+{
+    (void) font_id;
+    (void) user_data;
+    const batch_font_size_t* sized = font_size(size);
+    if (sized == NULL) return NULL;
+    int index = codepoint - 32;
+    if (index < 0 || index >= BATCH_FONT_GLYPH_COUNT) index = '?' - 32;
+    return &sized->software[index];
+}
+
+static void font_free(void)
+{
+    for (size_t i = 0; i < font.count; ++i) {
+        UnloadFontData(font.sizes[i].glyphs, BATCH_FONT_GLYPH_COUNT);
+        free(font.sizes[i].software);
+    }
+    free(font.sizes);
+    UnloadFileData(font.data);
+    memset(&font, 0, sizeof(font));
+}
+
+// Measures with the glyphs thumbnails are drawn with, so text fits the boxes laid out for it
+static Clay_Dimensions batch_measure_glyphs(Clay_StringSlice text,
+                                            Clay_TextElementConfig* config,
+                                            void* user_data)
+{
+    (void) user_data;
+    float max_width = 0;
+    float line_width = 0;
+    for (int32_t i = 0; i < text.length;) {
+        int size = 0;
+        int codepoint = Clay_DecodeCodepoint(text.chars + i, text.length - i, &size);
+        i += size;
+        if (codepoint == '\n') {
+            max_width = max_width > line_width ? max_width : line_width;
+            line_width = 0;
+            continue;
+        }
+        const Clay_Software_Glyph* glyph = font_glyph(config->fontId, config->fontSize, codepoint, NULL);
+        if (glyph) {
+            line_width += (float) (glyph->advanceX ? glyph->advanceX : glyph->width);
+        }
+        line_width += config->letterSpacing;
+    }
+    max_width = max_width > line_width ? max_width : line_width;
+    return (Clay_Dimensions) { max_width, (float) config->fontSize };
+}
+
+static int32_t count_elements(const ui_element_t* me)
+{
+    int32_t count = 1;
+    if (me->type == UI_ELEMENT_DECLARATION) {
+        for (ui_element_t* child = me->first_child; child; child = child->next) {
+            count += count_elements(child);
+        }
+    }
+    return count;
+}
+
+static void configure_element(ui_element_t* me)
+{
+    if (me->type == UI_ELEMENT_DECLARATION) {
+        Clay__OpenElement();
+        Clay__ConfigureOpenElement(*me->ptr);
+        for (ui_element_t* child = me->first_child; child; child = child->next) {
+            configure_element(child);
+        }
+        Clay__CloseElement();
+    } else if (me->type == UI_ELEMENT_TEXT) {
+        Clay__OpenTextElement(me->text.s, me->text_config);
+    }
+}
+
+static void batch_clay_initialize(void)
+{
+    // The new context copies its limits from the current one, so the old memory can only be
+    // released once Clay_Initialize() has returned
+    void* old_memory = clay.memory;
+    uint32_t size = Clay_MinMemorySize();
+    clay.memory = malloc_assert(size);
+    Clay_ErrorHandler err = { .errorHandlerFunction = batch_clay_error, .userData = NULL };
+    Clay_Initialize(Clay_CreateArenaWithCapacityAndMemory(size, clay.memory),
+        (Clay_Dimensions) { BATCH_LAYOUT_WIDTH, BATCH_LAYOUT_HEIGHT }, err);
+    Clay_SetMeasureTextFunction(font.data ? batch_measure_glyphs : batch_measure_text, NULL);
+    free(old_memory);
+}
+
+static void batch_clay_reserve(int32_t element_count)
+{
+    if (clay.memory == NULL) {
+        batch_clay_initialize();
+    }
+    if (element_count > Clay_GetMaxElementCount()) {
+        Clay_SetMaxElementCount(element_count * 2);
+        Clay_SetMaxMeasureTextCacheWordCount(element_count * 4);
+        batch_clay_initialize();
+    }
+}
+
+static bool batch_layout(ui_element_t* root, Clay_RenderCommandArray* commands)
+{
+    batch_clay_reserve(count_elements(root));
+    size_t errors_before = clay.errors;
+    Clay_BeginLayout();
+    configure_element(root);
+    *commands = Clay_EndLayout();
+    return clay.errors == errors_before;
+}
+
+static bool batch_thumbnail(const char* path,
+                            Clay_RenderCommandArray commands,
+                            const batch_options_t* options)
+{
+    char output[4096];
+    int length = snprintf(output, sizeof(output), "%s/%s.png", options->output_dir,
+        GetFileNameWithoutExt(path));
+    if (length < 0 || (size_t) length >= sizeof(output)) {
+        fprintf(stderr, "Thumbnail path for %s is too long\n", path);
+        return false;
+    }
+    Clay_Software_Canvas canvas = { .width = BATCH_LAYOUT_WIDTH, .height = BATCH_LAYOUT_HEIGHT };
+    canvas.pixels = (unsigned char*) malloc_assert((size_t) canvas.width * canvas.height * 4);
+    Clay_Software_Resources resources = { .getGlyph = font_glyph };
+    tiled_render(&canvas, commands, &resources, (Clay_Color) { 0, 0, 0, 255 }, options->jobs);
+    Image image = {
+        .data = canvas.pixels,
+        .width = canvas.width,
+        .height = canvas.height,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+    bool ok = ExportImage(image, output);
+    if (!ok) {
+        fprintf(stderr, "Unable to write thumbnail %s\n", output);
+    }
+    free(canvas.pixels);
+    return ok;
+}
+
+static bool batch_file(const char* path, ui_element_t* root, const batch_options_t* options)
+{
+    if (root == NULL) {
+        fprintf(stderr, "Unable to import %s\n", path);
+        return false;
+    }
+    bool ok = true;
+    Clay_RenderCommandArray commands = { 0 };
+    if (options->layout && !batch_layout(root, &commands)) {
+        fprintf(stderr, "Layout of %s reported errors\n", path);
+        ok = false;
+    }
+    // Drawn straight away, the commands are only valid until the next layout
+    if (options->thumbnails && !batch_thumbnail(path, commands, options)) {
+        ok = false;
+    }
+    char output[4096];
+    int length = snprintf(output, sizeof(output), "%s/%s", options->output_dir, GetFileName(path));
+    if (length < 0 || (size_t) length >= sizeof(output)) {
+        fprintf(stderr, "Output path for %s is too long\n", path);
+        ok = false;
+    } else if (!export_layout(output, root)) {
+        ok = false;
+    }
+    ui_element_remove(root);
+    return ok;
+}
+
+static void batch_add_file(batch_files_t* files, const char* path)
+{
+    REALLOC_ASSERT(files->paths, sizeof(*files->paths) * (files->count + 1));
+    files->paths[files->count] = (char*) malloc_assert(strlen(path) + 1);
+    strcpy(files->paths[files->count], path);
+    files->count++;
+}
+
+int batch_main(int argc, char** argv)
+{
+    batch_options_t options = {
+        .output_dir = ".",
+        .layout = false,
+        .thumbnails = false,
+        .font_path = "resources/Roboto-Regular.ttf",
+        .jobs = 0,
+    };
+    int first_path = argc;
+    for (int i = 0; i < argc; ++i) {
+        if (!strcmp(argv[i], "--layout")) {
+            options.layout = true;
+        } else if (!strcmp(argv[i], "--thumbnails")) {
+            options.layout = true;
+            options.thumbnails = true;
+        } else if (!strcmp(argv[i], "--font")) {
+            if (++i == argc) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            options.font_path = argv[i];
+        } else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
+            if (++i == argc) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            options.output_dir = argv[i];
+        } else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) {
+            if (++i == argc) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            options.jobs = (size_t) strtoul(argv[i], NULL, 10);
+        } else if (!strcmp(argv[i], "--macro-cache")) {
+            if (++i == argc) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            set_macro_cache_path(argv[i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            usage();
+            return EXIT_FAILURE;
+        } else {
+            first_path = i;
+            break;
+        }
+    }
+    if (first_path == argc) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    SetTraceLogLevel(LOG_WARNING);
+    if (options.thumbnails) {
+        font.data = LoadFileData(options.font_path, &font.data_size);
+        if (font.data == NULL) {
+            fprintf(stderr, "Unable to load font %s, thumbnails will have no text\n",
+                options.font_path);
+        }
+    }
+    batch_files_t files = { 0 };
+    for (int i = first_path; i < argc; ++i) {
+        if (DirectoryExists(argv[i])) {
+            FilePathList list = LoadDirectoryFilesEx(argv[i], ".c;.h", false);
+            for (unsigned int j = 0; j < list.count; ++j) {
+                batch_add_file(&files, list.paths[j]);
+            }
+            UnloadDirectoryFiles(list);
+        } else {
+            batch_add_file(&files, argv[i]);
+        }
+    }
+
+    // Files are imported in parallel, Clay's layout and exporting stay on this thread
+    ui_element_t** roots = (ui_element_t**) malloc_assert(sizeof(*roots) * (files.count + 1));
+    import_layouts((const char**) files.paths, files.count, NULL, roots, options.jobs);
+    size_t failures = 0;
+    for (size_t i = 0; i < files.count; ++i) {
+        failures += !batch_file(files.paths[i], roots[i], &options);
+        free(files.paths[i]);
+    }
+    free(files.paths);
+    free(roots);
+    free(clay.memory);
+    font_free();
+    free_clay_h_macros();
+    fprintf(stderr, "%zu of %zu layouts converted\n", files.count - failures, files.count);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,16 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/**
+ * @brief Runs clayouter without a window, importing and re-exporting each file given
+ *
+ * Usage: clayouter --batch [options] <file or directory>...
+ * Directories are searched (non-recursively) for `.c` and `.h` files.
+ *
+ * @param argc Number of arguments following `--batch`
+ * @param argv Arguments following `--batch`
+ * @return `int` Process exit code, non-zero if any file failed
+ */
+int batch_main(int argc, char** argv);
+
+#endif // BATCH_H
@@ -50,7 +50,8 @@ const char* _Clay_TextElementConfig_Members[] = {
     "letterSpacing",
     "lineHeight",
     "wrapMode",
-    "textAlignment"
+    "textAlignment",
+    "hashStringContents",
 };
 const size_t _Clay_TextElementConfig_Sizes[] = {
     sizeof(((Clay_TextElementConfig*) 0)->textColor),
@@ -554,6 +555,7 @@ const size_t _Clay_ElementDeclaration_Sizes[] = {
     sizeof(((Clay_ElementDeclaration*) 0)->custom),
     sizeof(((Clay_ElementDeclaration*) 0)->scroll),
     sizeof(((Clay_ElementDeclaration*) 0)->border),
+    sizeof(((Clay_ElementDeclaration*) 0)->userData),
 };
 const size_t _Clay_ElementDeclaration_Offsets[] = {
     offsetof(Clay_ElementDeclaration, id),
@@ -565,6 +567,7 @@ const size_t _Clay_ElementDeclaration_Offsets[] = {
     offsetof(Clay_ElementDeclaration, custom),
     offsetof(Clay_ElementDeclaration, scroll),
     offsetof(Clay_ElementDeclaration, border),
+    offsetof(Clay_ElementDeclaration, userData),
 };
 const member_info_t _Clay_ElementDeclaration_Member_Info[] = {
     { .type = TYPE_CUSTOM, .struct_info = &_Clay_ElementId_Info },
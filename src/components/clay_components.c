@@ -196,6 +196,7 @@ static void load_float(dstring_t* dst, float src)
         dst->s.chars = tmp;
     }
     dst->s.length = sprintf((char*) dst->s.chars, "%.1f", src);
+    dst->edited = true;
 }
 
 static void load_color(size_t index, Clay_Color src)
@@ -363,6 +364,25 @@ Clay_Color cc_parse_color(const color_string_t* c)
     return ret;
 }
 
+static void apply_channel_edit(float* dst, dstring_t* channel, float empty)
+{
+    if (!channel->edited) return;
+    channel->edited = false;
+    *dst = empty;
+    if (channel->s.length) {
+        *dst = strtof(channel->s.chars, NULL);
+        clamp_color(dst);
+    }
+}
+
+void cc_apply_color_edits(Clay_Color* dst, color_string_t* c)
+{
+    apply_channel_edit(&dst->r, &c->r, 0);
+    apply_channel_edit(&dst->g, &c->g, 0);
+    apply_channel_edit(&dst->b, &c->b, 0);
+    apply_channel_edit(&dst->a, &c->a, 255);
+}
+
 /**************
  * Components *
  **************/
@@ -436,6 +456,7 @@ void cc_text_box_append(dstring_t* text, char c)
         if (text->s.length) {
             text->s.length--;
             ((char*) text->s.chars)[text->s.length] = '\0';
+            text->edited = true;
         }
         return;
     }
@@ -452,6 +473,7 @@ void cc_text_box_append(dstring_t* text, char c)
     }
     ((char*) text->s.chars)[text->s.length++] = c;
     ((char*) text->s.chars)[text->s.length] = '\0';
+    text->edited = true;
 }
 
 dstring_t* cc_get_selected_text_box(void) { return selected_text_box; }
@@ -13,6 +13,8 @@ typedef enum { TT_BODY, TT_HEADER, TT_TITLE } text_types_t;
 typedef struct {
     int32_t capacity;
     Clay_String s;
+    // Set when a text box or color picker changes the string, cleared by whoever applies the change
+    bool edited;
 } dstring_t;
 
 typedef struct {
@@ -71,5 +73,7 @@ void cc_text_box_advance(void);
 void cc_selection_menu(cc_selection_menu_t* menu);
 void cc_color_selector(Clay_ImageElementConfig im, color_string_t* color);
 Clay_Color cc_parse_color(const color_string_t* c);
+// Parses only the channels of `c` edited since the last call into `dst`
+void cc_apply_color_edits(Clay_Color* dst, color_string_t* c);
 
 #endif // CLAY_COMPONENTS_H
@@ -0,0 +1,176 @@
+#ifndef CONCURRENCY_H
+#define CONCURRENCY_H
+
+// Minimal threads and mutexes over pthreads and Win32.
+// windows.h clashes with raylib.h, so this must not be included next to raylib.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "utilities.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+typedef HANDLE thread_t;
+typedef SRWLOCK mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#define MUTEX_INITIALIZER SRWLOCK_INIT
+#define COND_INITIALIZER CONDITION_VARIABLE_INIT
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define COND_INITIALIZER PTHREAD_COND_INITIALIZER
+#endif
+
+typedef void (*thread_func_t)(void* arg);
+
+typedef struct {
+    thread_func_t func;
+    void* arg;
+} thread_start_t;
+
+#ifdef _WIN32
+static inline DWORD WINAPI thread_trampoline(LPVOID arg)
+#else
+static inline void* thread_trampoline(void* arg)
+#endif
+{
+    thread_start_t start = *(thread_start_t*) arg;
+    free(arg);
+    start.func(start.arg);
+    return 0;
+}
+
+/**
+ * @brief Starts a thread running `func(arg)`
+ *
+ * @return `bool` False if the thread couldn't be started
+ */
+static inline bool thread_create(thread_t* thread, thread_func_t func, void* arg)
+{
+    thread_start_t* start = (thread_start_t*) malloc_assert(sizeof(*start));
+    start->func = func;
+    start->arg = arg;
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (*thread != NULL) return true;
+#else
+    if (pthread_create(thread, NULL, thread_trampoline, start) == 0) return true;
+#endif
+    free(start);
+    return false;
+}
+
+static inline void thread_join(thread_t thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+static inline void mutex_init(mutex_t* mutex)
+{
+#ifdef _WIN32
+    InitializeSRWLock(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static inline void mutex_destroy(mutex_t* mutex)
+{
+#ifdef _WIN32
+    (void) mutex;
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+static inline void mutex_lock(mutex_t* mutex)
+{
+#ifdef _WIN32
+    AcquireSRWLockExclusive(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+static inline void mutex_unlock(mutex_t* mutex)
+{
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+/**
+ * @brief Releases `mutex`, which must be held, until `cond` is signalled, then takes it again
+ *
+ * Wakeups can be spurious, so wait in a loop checking the condition.
+ */
+static inline void cond_wait(cond_t* cond, mutex_t* mutex)
+{
+#ifdef _WIN32
+    SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+static inline void cond_signal(cond_t* cond)
+{
+#ifdef _WIN32
+    WakeConditionVariable(cond);
+#else
+    pthread_cond_signal(cond);
+#endif
+}
+
+static inline void cond_broadcast(cond_t* cond)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+// Gives each thread its own copy of a static variable
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/**
+ * @brief Gets the number of processors available, at least 1
+ */
+static inline size_t processor_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t) count : 1;
+#endif
+}
+
+#endif // CONCURRENCY_H
@@ -0,0 +1,397 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "font_cache.h"
+#include "stb_ds.h"
+#include "task_queue.h"
+#include "utilities.h"
+
+#define FONT_CACHE_GLYPH_COUNT (400)
+// Same as LoadFontEx()
+#define FONT_CACHE_GLYPH_PADDING (4)
+#define FONT_CACHE_NONE (-1)
+
+typedef enum {
+    FONT_PENDING,
+    // Being rasterized on the task queue, measured and drawn with the fallback font meanwhile
+    FONT_LOADING,
+    FONT_LOADED,
+} font_state_t;
+
+// Rasterized glyphs, handed back to the main thread to upload the atlas
+typedef struct {
+    char* path;
+    int size;
+    bool sdf;
+    GlyphInfo* glyphs;
+    Rectangle* recs;
+    Image atlas;
+    task_t* task;
+} font_job_t;
+
+typedef struct {
+    char* path; // NULL for a free slot
+    Clay_String name;
+    uint16_t size;
+    uint32_t refs;
+    font_state_t state;
+    font_job_t* job;
+    // Loaded fonts without references are listed most recently released first, free slots are
+    // listed through `next`
+    int32_t prev;
+    int32_t next;
+} font_entry_t;
+
+typedef struct {
+    char* key;
+    uint16_t value;
+} font_id_map_t;
+
+static struct {
+    font_entry_t* entries;
+    // Kept apart from the entries, as the renderer and Raylib_MeasureText() index them by font ID
+    Raylib_Font* fonts;
+    size_t count;
+    size_t capacity;
+    int32_t free_head;
+    int32_t unused_head;
+    int32_t unused_tail;
+    size_t unused_count;
+    // Fonts acquired but not loaded yet
+    size_t pending_count;
+    size_t loading_count;
+    // Loaded synchronously, the cache keeps a reference to it
+    int32_t fallback;
+    // "size:path" to font ID
+    font_id_map_t* ids;
+    bool sdf;
+} cache = {
+    .free_head = FONT_CACHE_NONE,
+    .unused_head = FONT_CACHE_NONE,
+    .unused_tail = FONT_CACHE_NONE,
+    .fallback = FONT_CACHE_NONE,
+};
+
+static char* make_key(const char* path, uint16_t size)
+{
+    size_t length = strlen(path) + sizeof("65535:");
+    char* key = (char*) malloc_assert(length);
+    snprintf(key, length, "%u:%s", (unsigned) size, path);
+    return key;
+}
+
+static bool is_font(uint16_t id)
+{
+    return id < cache.count && cache.entries[id].path != NULL;
+}
+
+static void unused_unlink(int32_t id)
+{
+    font_entry_t* e = &cache.entries[id];
+    if (e->prev != FONT_CACHE_NONE) {
+        cache.entries[e->prev].next = e->next;
+    } else {
+        cache.unused_head = e->next;
+    }
+    if (e->next != FONT_CACHE_NONE) {
+        cache.entries[e->next].prev = e->prev;
+    } else {
+        cache.unused_tail = e->prev;
+    }
+    cache.unused_count--;
+}
+
+static void unused_push(int32_t id)
+{
+    font_entry_t* e = &cache.entries[id];
+    e->prev = FONT_CACHE_NONE;
+    e->next = cache.unused_head;
+    if (cache.unused_head != FONT_CACHE_NONE) {
+        cache.entries[cache.unused_head].prev = id;
+    } else {
+        cache.unused_tail = id;
+    }
+    cache.unused_head = id;
+    cache.unused_count++;
+}
+
+// Runs on the task queue, no GPU calls here
+static void rasterize(void* arg)
+{
+    font_job_t* job = (font_job_t*) arg;
+    int data_size = 0;
+    unsigned char* data = LoadFileData(job->path, &data_size);
+    if (data == NULL) return;
+    job->glyphs = LoadFontData(data, data_size, job->size, NULL, FONT_CACHE_GLYPH_COUNT,
+        job->sdf ? FONT_SDF : FONT_DEFAULT);
+    UnloadFileData(data);
+    if (job->glyphs) {
+        // Distance fields already pad their glyphs, and pack tighter with skyline packing
+        job->atlas = GenImageFontAtlas(job->glyphs, &job->recs, FONT_CACHE_GLYPH_COUNT, job->size,
+            job->sdf ? 0 : FONT_CACHE_GLYPH_PADDING, job->sdf ? 1 : 0);
+    }
+}
+
+static void free_job(font_job_t* job)
+{
+    task_free(job->task);
+    free(job->path);
+    free(job);
+}
+
+// Uploads the atlas of a finished job, falling back to LoadFontEx() if rasterizing failed
+static void finish_loading(uint16_t id)
+{
+    font_entry_t* e = &cache.entries[id];
+    font_job_t* job = e->job;
+    Font font = { 0 };
+    bool sdf = false;
+    if (job->glyphs && job->atlas.data) {
+        font.baseSize = job->size;
+        font.glyphCount = FONT_CACHE_GLYPH_COUNT;
+        font.glyphPadding = job->sdf ? 0 : FONT_CACHE_GLYPH_PADDING;
+        font.glyphs = job->glyphs;
+        font.recs = job->recs;
+        font.texture = LoadTextureFromImage(job->atlas);
+        UnloadImage(job->atlas);
+        sdf = job->sdf;
+        // The shader needs interpolated distances
+        if (sdf) SetTextureFilter(font.texture, TEXTURE_FILTER_BILINEAR);
+    } else {
+        UnloadFontData(job->glyphs, FONT_CACHE_GLYPH_COUNT);
+        MemFree(job->recs);
+        font = LoadFontEx(e->path, e->size, NULL, FONT_CACHE_GLYPH_COUNT);
+    }
+    cache.fonts[id] = Raylib_WrapFont(font);
+    cache.fonts[id].sdf = sdf;
+    free_job(job);
+    e->job = NULL;
+    e->state = FONT_LOADED;
+    if (e->refs == 0) {
+        unused_push(id);
+    }
+}
+
+// Starts loading a font, in the background unless there's no fallback to show meanwhile
+static void load(uint16_t id)
+{
+    font_entry_t* e = &cache.entries[id];
+    cache.pending_count--;
+    font_job_t* job = (font_job_t*) malloc_assert(sizeof(*job));
+    memset(job, 0, sizeof(*job));
+    job->path = (char*) malloc_assert(strlen(e->path) + 1);
+    strcpy(job->path, e->path);
+    job->size = e->size;
+    job->sdf = cache.sdf;
+    e->job = job;
+    if (cache.fallback == FONT_CACHE_NONE) {
+        rasterize(job);
+        finish_loading(id);
+        e->refs++;
+        cache.fallback = id;
+        return;
+    }
+    // Shares the fallback's glyphs and tables until the font is loaded
+    cache.fonts[id] = cache.fonts[cache.fallback];
+    e->state = FONT_LOADING;
+    cache.loading_count++;
+    job->task = task_submit(rasterize, job);
+}
+
+// Frees the slot of a font without references
+static void drop(uint16_t id)
+{
+    font_entry_t* e = &cache.entries[id];
+    if (e->state == FONT_LOADED) {
+        Raylib_UnloadFont(cache.fonts[id]);
+    } else {
+        cache.pending_count--;
+    }
+    char* key = make_key(e->path, e->size);
+    shdel(cache.ids, key);
+    free(key);
+    free(e->path);
+    free((char*) e->name.chars);
+    memset(e, 0, sizeof(*e));
+    memset(&cache.fonts[id], 0, sizeof(cache.fonts[id]));
+    e->next = cache.free_head;
+    cache.free_head = id;
+}
+
+void font_cache_set_sdf(bool sdf)
+{
+    assert(cache.count == 0);
+    cache.sdf = sdf;
+}
+
+uint16_t font_cache_acquire(const char* path, uint16_t size)
+{
+    if (cache.sdf) {
+        size = FONT_CACHE_SDF_SIZE;
+    }
+    if (cache.ids == NULL) {
+        sh_new_strdup(cache.ids);
+    }
+    char* key = make_key(path, size);
+    ptrdiff_t index = shgeti(cache.ids, key);
+    if (index >= 0) {
+        free(key);
+        uint16_t id = cache.ids[index].value;
+        font_cache_retain(id);
+        return id;
+    }
+
+    uint16_t id;
+    if (cache.free_head != FONT_CACHE_NONE) {
+        id = (uint16_t) cache.free_head;
+        cache.free_head = cache.entries[id].next;
+    } else {
+        assert(cache.count < UINT16_MAX);
+        if (cache.count == cache.capacity) {
+            cache.capacity = cache.capacity ? cache.capacity * 2 : 8;
+            REALLOC_ASSERT(cache.entries, sizeof(*cache.entries) * cache.capacity);
+            REALLOC_ASSERT(cache.fonts, sizeof(*cache.fonts) * cache.capacity);
+        }
+        id = (uint16_t) cache.count++;
+    }
+    font_entry_t* e = &cache.entries[id];
+    memset(e, 0, sizeof(*e));
+    memset(&cache.fonts[id], 0, sizeof(cache.fonts[id]));
+    e->path = (char*) malloc_assert(strlen(path) + 1);
+    strcpy(e->path, path);
+    const char* name = GetFileNameWithoutExt(path);
+    size_t name_length = strlen(name);
+    e->name.chars = (const char*) malloc_assert(name_length + 1);
+    memcpy((char*) e->name.chars, name, name_length + 1);
+    e->name.length = (int32_t) name_length;
+    e->size = size;
+    e->refs = 1;
+    cache.pending_count++;
+    shput(cache.ids, key, id);
+    free(key);
+    return id;
+}
+
+bool font_cache_retain(uint16_t id)
+{
+    if (!is_font(id)) return false;
+    font_entry_t* e = &cache.entries[id];
+    if (e->refs++ == 0 && e->state == FONT_LOADED) {
+        unused_unlink(id);
+    }
+    return true;
+}
+
+void font_cache_release(uint16_t id)
+{
+    if (!is_font(id)) return;
+    font_entry_t* e = &cache.entries[id];
+    assert(e->refs > 0);
+    if (--e->refs > 0) return;
+    if (e->state == FONT_LOADED) {
+        unused_push(id);
+    } else if (e->state == FONT_PENDING) {
+        drop(id);
+    }
+    // Fonts still loading are listed as unused once they're loaded
+}
+
+Clay_String font_cache_name(uint16_t id)
+{
+    if (!is_font(id)) return (Clay_String) { 0, "" };
+    return cache.entries[id].name;
+}
+
+bool font_cache_lookup(uint16_t id, const char** path, uint16_t* size)
+{
+    if (!is_font(id)) return false;
+    *path = cache.entries[id].path;
+    *size = cache.entries[id].size;
+    return true;
+}
+
+bool font_cache_has_size(uint16_t id, uint16_t size)
+{
+    if (!is_font(id)) return false;
+    return cache.sdf || cache.entries[id].size == size;
+}
+
+bool font_cache_update(void)
+{
+    bool changed = false;
+    for (size_t id = 0; cache.loading_count && id < cache.count; ++id) {
+        font_entry_t* e = &cache.entries[id];
+        if (e->state == FONT_LOADING && task_done(e->job->task)) {
+            cache.loading_count--;
+            finish_loading((uint16_t) id);
+            changed = true;
+        }
+    }
+    // Evicted IDs will be reused for other fonts
+    while (cache.unused_count > FONT_CACHE_MAX_UNUSED) {
+        int32_t id = cache.unused_tail;
+        unused_unlink(id);
+        drop((uint16_t) id);
+        changed = true;
+    }
+    // Text was measured with the fallback font, or with fonts that are gone
+    if (changed) {
+        Clay_ResetMeasureTextCache();
+    }
+    return changed;
+}
+
+bool font_cache_loading(void)
+{
+    return cache.loading_count > 0;
+}
+
+Clay_Dimensions font_cache_measure_text(Clay_StringSlice text,
+                                        Clay_TextElementConfig* config,
+                                        void* user_data)
+{
+    (void) user_data;
+    if (!is_font(config->fontId)) return (Clay_Dimensions) { 0 };
+    if (cache.entries[config->fontId].state == FONT_PENDING) {
+        load(config->fontId);
+    }
+    return Raylib_MeasureText(text, config, cache.fonts);
+}
+
+Raylib_Font* font_cache_fonts(void)
+{
+    for (size_t id = 0; cache.pending_count && id < cache.count; ++id) {
+        if (cache.entries[id].path && cache.entries[id].state == FONT_PENDING) {
+            load((uint16_t) id);
+        }
+    }
+    return cache.fonts;
+}
+
+void font_cache_free(void)
+{
+    for (size_t id = 0; id < cache.count; ++id) {
+        font_entry_t* e = &cache.entries[id];
+        if (e->path == NULL) continue;
+        if (e->state == FONT_LOADED) {
+            Raylib_UnloadFont(cache.fonts[id]);
+        } else if (e->state == FONT_LOADING) {
+            task_wait(e->job->task);
+            UnloadFontData(e->job->glyphs, FONT_CACHE_GLYPH_COUNT);
+            MemFree(e->job->recs);
+            UnloadImage(e->job->atlas);
+            free_job(e->job);
+        }
+        free(e->path);
+        free((char*) e->name.chars);
+    }
+    shfree(cache.ids);
+    free(cache.entries);
+    free(cache.fonts);
+    memset(&cache, 0, sizeof(cache));
+    cache.free_head = cache.unused_head = cache.unused_tail = cache.fallback = FONT_CACHE_NONE;
+}
@@ -0,0 +1,98 @@
+#ifndef FONT_CACHE_H
+#define FONT_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clay.h"
+#include "clay_renderer_raylib.h"
+
+// Fonts are shared by (path, size) and identified by the `fontId` of the text configs using them.
+// A font is loaded the first time text is measured or drawn with it. The first font is loaded
+// right away and kept as the fallback, later ones are rasterized on the task queue and measured and
+// drawn with the fallback until font_cache_update() uploads them. Fonts nobody holds a reference
+// to stay loaded until more than FONT_CACHE_MAX_UNUSED of them pile up, then the least recently
+// released ones are unloaded by font_cache_update() and their IDs reused.
+
+#define FONT_CACHE_MAX_UNUSED (8)
+// Size signed distance field fonts are rasterized at, whatever size they're drawn at
+#define FONT_CACHE_SDF_SIZE (32)
+
+/**
+ * @brief Rasterizes fonts as signed distance fields, so each typeface is loaded once for every size
+ *
+ * Must be called before the first font is acquired.
+ */
+void font_cache_set_sdf(bool sdf);
+
+/**
+ * @brief Gets the ID of the font at `path` rendered at `size`, and takes a reference to it
+ *
+ * @param path TrueType font file
+ * @param size Font size in pixels
+ * @return `uint16_t` Font ID, to be released with font_cache_release()
+ */
+uint16_t font_cache_acquire(const char* path, uint16_t size);
+
+/**
+ * @brief Takes another reference to a font
+ *
+ * @return `bool` False if `id` isn't a font in the cache
+ */
+bool font_cache_retain(uint16_t id);
+void font_cache_release(uint16_t id);
+
+/**
+ * @brief Gets a font's file name without its extension, or an empty string for an unknown ID
+ */
+Clay_String font_cache_name(uint16_t id);
+
+/**
+ * @brief Gets the file and size a font was acquired with
+ *
+ * @return `bool` False if `id` isn't a font in the cache
+ */
+bool font_cache_lookup(uint16_t id, const char** path, uint16_t* size);
+
+/**
+ * @brief Checks whether a font can be drawn at `size` without acquiring another one
+ */
+bool font_cache_has_size(uint16_t id, uint16_t size);
+
+/**
+ * @brief Uploads fonts that finished rasterizing and unloads fonts over the FONT_CACHE_MAX_UNUSED
+ * limit
+ *
+ * Clay's text measurements are cached by font ID, so this must not be called during a layout.
+ *
+ * @return `bool` True if any font changed, and the layout needs redoing
+ */
+bool font_cache_update(void);
+
+/**
+ * @brief Checks whether any font is still rasterizing
+ */
+bool font_cache_loading(void);
+
+/**
+ * @brief Measures text for Clay, loading the font first if needed
+ *
+ * Pass it to Clay_SetMeasureTextFunction(), `user_data` is unused.
+ */
+Clay_Dimensions font_cache_measure_text(Clay_StringSlice text,
+                                        Clay_TextElementConfig* config,
+                                        void* user_data);
+
+/**
+ * @brief Gets the fonts to render with, indexed by font ID
+ *
+ * Starts loading any font still waiting to be. The array moves when fonts are acquired.
+ */
+Raylib_Font* font_cache_fonts(void);
+
+/**
+ * @brief Unloads every font, waiting for any still rasterizing
+ */
+void font_cache_free(void);
+
+#endif // FONT_CACHE_H
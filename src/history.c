@@ -0,0 +1,537 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clay_struct_names.h"
+#include "history.h"
+#include "ui_element.h"
+#include "utilities.h"
+
+typedef enum {
+    HISTORY_PROPERTIES,
+    HISTORY_INSERT,
+    HISTORY_REMOVE,
+} history_entry_type_t;
+
+// What a changed field is part of
+typedef enum {
+    FIELD_DECLARATION,
+    FIELD_HOVER,
+    FIELD_HOVER_ENABLED,
+    FIELD_TEXT_CONFIG,
+    // Strings are stored whole
+    FIELD_ID,
+    FIELD_HOVER_ID,
+    FIELD_CALLBACK,
+    FIELD_TEXT,
+} field_target_t;
+
+#define FIELD_STRINGS 4
+
+typedef struct {
+    field_target_t target;
+    size_t offset;
+    size_t old_size;
+    size_t new_size;
+    // The old value followed by the new one
+    char* values;
+} history_field_t;
+
+typedef struct {
+    history_entry_type_t type;
+    ui_element_t* element;
+    // Where an inserted or removed element goes, `next` is NULL if it's the last child
+    ui_element_t* parent;
+    ui_element_t* next;
+    history_field_t* fields;
+    size_t field_count;
+    size_t field_capacity;
+    size_t memory;
+} history_entry_t;
+
+static struct {
+    // Ring buffer of entries, oldest first
+    history_entry_t* entries;
+    size_t first;
+    size_t count;
+    size_t capacity;
+    // Entries before this one are applied, the rest were undone and can be redone
+    size_t done;
+    size_t memory;
+    size_t limit;
+    // The last entry takes in further edits of its element
+    bool open;
+    history_callbacks_t callbacks;
+} history = { .limit = HISTORY_DEFAULT_LIMIT };
+
+// The element being edited as it was in history_edit_begin()
+static struct {
+    ui_element_t* element;
+    Clay_ElementDeclaration declaration;
+    Clay_ElementDeclaration hover;
+    Clay_ElementDeclaration* hover_ptr;
+    bool hover_enabled;
+    Clay_TextElementConfig text_config;
+    dstring_t strings[FIELD_STRINGS];
+    bool changed;
+} before;
+
+void history_set_callbacks(history_callbacks_t callbacks)
+{
+    history.callbacks = callbacks;
+}
+
+static void retain_font(uint16_t id)
+{
+    if (history.callbacks.retain_font) history.callbacks.retain_font(id);
+}
+
+static void release_font(uint16_t id)
+{
+    if (history.callbacks.release_font) history.callbacks.release_font(id);
+}
+
+// Takes or drops the references to the fonts under an element the history keeps out of the tree,
+// which can't change while it's out
+static void hold_fonts(ui_element_t* me, bool hold)
+{
+    if (me->type == UI_ELEMENT_TEXT) {
+        if (hold) {
+            retain_font(me->text_config->fontId);
+        } else {
+            release_font(me->text_config->fontId);
+        }
+        return;
+    }
+    for (ui_element_t* child = me->first_child; child; child = child->next) {
+        hold_fonts(child, hold);
+    }
+}
+
+static bool is_font_field(field_target_t target, size_t offset)
+{
+    return target == FIELD_TEXT_CONFIG && offset == offsetof(Clay_TextElementConfig, fontId);
+}
+
+static uint16_t font_value(const char* value)
+{
+    uint16_t id;
+    memcpy(&id, value, sizeof(id));
+    return id;
+}
+
+static history_entry_t* entry_at(size_t index)
+{
+    return &history.entries[(history.first + index) % history.capacity];
+}
+
+static size_t subtree_memory(ui_element_t* me)
+{
+    size_t size = sizeof(*me);
+    if (me->type == UI_ELEMENT_TEXT) {
+        return size + sizeof(*me->text_config) + (size_t) me->text.capacity;
+    }
+    size += sizeof(*me->ptr) + (size_t) me->ptr->id.stringId.length
+        + (size_t) me->on_hover.callback.length;
+    if (me->on_hover.ptr) {
+        size += sizeof(*me->on_hover.ptr);
+    }
+    for (ui_element_t* child = me->first_child; child; child = child->next) {
+        size += subtree_memory(child);
+    }
+    return size;
+}
+
+// Frees an entry dropped from the history, along with the subtree it holds if it's out of the tree
+static void free_entry(history_entry_t* entry, bool applied)
+{
+    for (size_t i = 0; i < entry->field_count; ++i) {
+        history_field_t* field = &entry->fields[i];
+        if (is_font_field(field->target, field->offset)) {
+            release_font(font_value(field->values));
+            release_font(font_value(field->values + field->old_size));
+        }
+        free(field->values);
+    }
+    free(entry->fields);
+    if ((entry->type == HISTORY_REMOVE && applied) || (entry->type == HISTORY_INSERT && !applied)) {
+        hold_fonts(entry->element, false);
+        ui_element_remove(entry->element);
+    }
+    history.memory -= entry->memory;
+}
+
+static void drop_redo(void)
+{
+    while (history.count > history.done) {
+        free_entry(entry_at(--history.count), false);
+    }
+}
+
+static void trim(void)
+{
+    while (history.memory > history.limit && history.count) {
+        free_entry(entry_at(0), history.done > 0);
+        history.first = (history.first + 1) % history.capacity;
+        history.count--;
+        if (history.done) history.done--;
+    }
+}
+
+static history_entry_t* push(history_entry_type_t type, ui_element_t* me)
+{
+    drop_redo();
+    if (history.count == history.capacity) {
+        size_t capacity = history.capacity ? history.capacity * 2 : 64;
+        REALLOC_ASSERT(history.entries, capacity * sizeof(*history.entries));
+        // The buffer is full, so the entries before `first` wrapped around, move them after the
+        // others
+        memcpy(history.entries + history.capacity, history.entries,
+            history.first * sizeof(*history.entries));
+        history.capacity = capacity;
+    }
+    history_entry_t* entry = entry_at(history.count++);
+    history.done = history.count;
+    *entry = (history_entry_t) { .type = type, .element = me, .memory = sizeof(*entry) };
+    history.memory += entry->memory;
+    history.open = type == HISTORY_PROPERTIES;
+    return entry;
+}
+
+void history_set_limit(size_t bytes)
+{
+    history.limit = bytes;
+    trim();
+}
+
+static void save_string(dstring_t* dst, Clay_String src)
+{
+    char* chars = (char*) dst->s.chars;
+    if (dst->capacity < src.length) {
+        dst->capacity = src.length;
+        REALLOC_ASSERT(chars, (size_t) dst->capacity);
+    }
+    if (src.length) {
+        memcpy(chars, src.chars, (size_t) src.length);
+    }
+    dst->s.chars = chars;
+    dst->s.length = src.length;
+}
+
+static Clay_String* field_string(ui_element_t* me, field_target_t target)
+{
+    switch (target) {
+    case FIELD_ID:
+        return &me->ptr->id.stringId;
+    case FIELD_HOVER_ID:
+        return &me->on_hover.ptr->id.stringId;
+    case FIELD_CALLBACK:
+        return &me->on_hover.callback;
+    case FIELD_TEXT:
+        return &me->text.s;
+    default:
+        return NULL;
+    }
+}
+
+static char* field_base(ui_element_t* me, field_target_t target)
+{
+    switch (target) {
+    case FIELD_DECLARATION:
+        return (char*) me->ptr;
+    case FIELD_HOVER:
+        return (char*) me->on_hover.ptr;
+    case FIELD_HOVER_ENABLED:
+        return (char*) &me->on_hover.enabled;
+    case FIELD_TEXT_CONFIG:
+        return (char*) me->text_config;
+    default:
+        return NULL;
+    }
+}
+
+void history_edit_begin(ui_element_t* me)
+{
+    before.element = me;
+    before.changed = false;
+    if (me->type == UI_ELEMENT_TEXT) {
+        before.text_config = *me->text_config;
+        retain_font(before.text_config.fontId);
+        save_string(&before.strings[FIELD_TEXT - FIELD_ID], me->text.s);
+        return;
+    }
+    before.declaration = *me->ptr;
+    before.hover_ptr = me->on_hover.ptr;
+    if (me->on_hover.ptr) {
+        before.hover = *me->on_hover.ptr;
+        save_string(&before.strings[FIELD_HOVER_ID - FIELD_ID], me->on_hover.ptr->id.stringId);
+    }
+    before.hover_enabled = me->on_hover.enabled;
+    save_string(&before.strings[FIELD_ID - FIELD_ID], me->ptr->id.stringId);
+    save_string(&before.strings[FIELD_CALLBACK - FIELD_ID], me->on_hover.callback);
+}
+
+// Adds a changed field to the entry for `me`, or updates the new value if it already has the field
+static void record_field(ui_element_t* me, field_target_t target, size_t offset,
+    const char* old_value, size_t old_size, const char* new_value, size_t new_size)
+{
+    history_entry_t* entry = NULL;
+    if (history.open && history.count) {
+        entry = entry_at(history.count - 1);
+        if (entry->element != me) entry = NULL;
+    }
+    if (entry == NULL) {
+        entry = push(HISTORY_PROPERTIES, me);
+    }
+    before.changed = true;
+
+    history_field_t* field = NULL;
+    for (size_t i = 0; i < entry->field_count; ++i) {
+        if (entry->fields[i].target == target && entry->fields[i].offset == offset) {
+            field = &entry->fields[i];
+            break;
+        }
+    }
+    size_t memory = entry->memory;
+    if (field == NULL) {
+        if (entry->field_count == entry->field_capacity) {
+            entry->memory -= entry->field_capacity * sizeof(*entry->fields);
+            entry->field_capacity = entry->field_capacity ? entry->field_capacity * 2 : 4;
+            REALLOC_ASSERT(entry->fields, entry->field_capacity * sizeof(*entry->fields));
+            entry->memory += entry->field_capacity * sizeof(*entry->fields);
+        }
+        field = &entry->fields[entry->field_count++];
+        *field = (history_field_t) { .target = target, .offset = offset, .old_size = old_size };
+        field->values = malloc_assert(old_size + new_size + 1);
+        if (old_size) {
+            memcpy(field->values, old_value, old_size);
+        }
+        entry->memory += old_size;
+        if (is_font_field(target, offset)) {
+            retain_font(font_value(old_value));
+        }
+    } else {
+        entry->memory -= field->new_size;
+        if (is_font_field(target, offset)) {
+            release_font(font_value(field->values + field->old_size));
+        }
+        REALLOC_ASSERT(field->values, field->old_size + new_size + 1);
+    }
+    if (new_size) {
+        memcpy(field->values + field->old_size, new_value, new_size);
+    }
+    if (is_font_field(target, offset)) {
+        retain_font(font_value(new_value));
+    }
+    field->new_size = new_size;
+    entry->memory += new_size;
+    history.memory += entry->memory - memory;
+}
+
+// Records the leaf members of a struct that differ, Clay_ElementId's string is compared separately
+static void diff_struct(ui_element_t* me, field_target_t target, const struct_info_t* info,
+    const char* old_struct, const char* new_struct, size_t offset)
+{
+    for (size_t i = 0; i < info->count; ++i) {
+        size_t at = offset + info->offsets[i];
+        size_t size = info->sizes[i];
+        if (info->info[i].type == TYPE_STRUCT) {
+            diff_struct(me, target, info->info[i].struct_info, old_struct, new_struct, at);
+            continue;
+        }
+        if (info->info[i].type == TYPE_CUSTOM) {
+            size = offsetof(Clay_ElementId, stringId);
+        }
+        if (memcmp(old_struct + at, new_struct + at, size)) {
+            record_field(me, target, at, old_struct + at, size, new_struct + at, size);
+        }
+    }
+}
+
+static void diff_string(ui_element_t* me, field_target_t target)
+{
+    Clay_String old_string = before.strings[target - FIELD_ID].s;
+    Clay_String new_string = *field_string(me, target);
+    if (old_string.length != new_string.length
+        || (new_string.length
+            && memcmp(old_string.chars, new_string.chars, (size_t) new_string.length))) {
+        record_field(me, target, 0, old_string.chars, (size_t) old_string.length,
+            new_string.chars, (size_t) new_string.length);
+    }
+}
+
+bool history_edit_end(void)
+{
+    ui_element_t* me = before.element;
+    if (me == NULL) return false;
+    before.element = NULL;
+    if (me->type == UI_ELEMENT_TEXT) {
+        diff_struct(me, FIELD_TEXT_CONFIG, STRUCT_INFO(Clay_TextElementConfig),
+            (const char*) &before.text_config, (const char*) me->text_config, 0);
+        diff_string(me, FIELD_TEXT);
+        release_font(before.text_config.fontId);
+    } else {
+        diff_struct(me, FIELD_DECLARATION, STRUCT_INFO(Clay_ElementDeclaration),
+            (const char*) &before.declaration, (const char*) me->ptr, 0);
+        diff_string(me, FIELD_ID);
+        // A hover declaration allocated during the edit was copied from the element
+        if (before.hover_ptr && before.hover_ptr == me->on_hover.ptr) {
+            diff_struct(me, FIELD_HOVER, STRUCT_INFO(Clay_ElementDeclaration),
+                (const char*) &before.hover, (const char*) me->on_hover.ptr, 0);
+            diff_string(me, FIELD_HOVER_ID);
+        }
+        if (before.hover_enabled != me->on_hover.enabled) {
+            record_field(me, FIELD_HOVER_ENABLED, 0, (const char*) &before.hover_enabled,
+                sizeof(bool), (const char*) &me->on_hover.enabled, sizeof(bool));
+        }
+        diff_string(me, FIELD_CALLBACK);
+    }
+    trim();
+    return before.changed;
+}
+
+void history_seal(void)
+{
+    history.open = false;
+}
+
+void history_inserted(ui_element_t* me)
+{
+    history_entry_t* entry = push(HISTORY_INSERT, me);
+    entry->parent = me->parent;
+    entry->next = me->next;
+    entry->memory += subtree_memory(me);
+    history.memory += entry->memory - sizeof(*entry);
+    trim();
+}
+
+void history_remove(ui_element_t* me)
+{
+    history_entry_t* entry = push(HISTORY_REMOVE, me);
+    entry->parent = me->parent;
+    entry->next = me->next;
+    entry->memory += subtree_memory(me);
+    history.memory += entry->memory - sizeof(*entry);
+    hold_fonts(me, true);
+    ui_element_detach(me);
+    trim();
+}
+
+static void restore_string(ui_element_t* me, field_target_t target, const char* value, size_t size)
+{
+    if (target == FIELD_TEXT) {
+        dstring_t* text = &me->text;
+        char* chars = (char*) text->s.chars;
+        if ((size_t) text->capacity <= size) {
+            text->capacity = (int32_t) size;
+            REALLOC_ASSERT(chars, size + 1);
+        }
+        memcpy(chars, value, size);
+        chars[size] = '\0';
+        text->s.chars = chars;
+        text->s.length = (int32_t) size;
+        return;
+    }
+    Clay_String* s = field_string(me, target);
+    Clay_String* other = NULL;
+    if (target == FIELD_ID && me->on_hover.ptr) {
+        other = &me->on_hover.ptr->id.stringId;
+    } else if (target == FIELD_HOVER_ID) {
+        other = &me->ptr->id.stringId;
+    }
+    char* chars = (char*) s->chars;
+    // The hover declaration's ID usually shares its string with the element's, this one gets a
+    // string of its own then, and ui_element_remove() frees both
+    if (other && other->chars == s->chars) {
+        chars = NULL;
+    }
+    if (size) {
+        REALLOC_ASSERT(chars, size);
+        memcpy(chars, value, size);
+    }
+    s->chars = chars;
+    s->length = (int32_t) size;
+}
+
+static void apply_properties(history_entry_t* entry, bool undo)
+{
+    ui_element_t* me = entry->element;
+    if (history.callbacks.changing) history.callbacks.changing(me);
+    for (size_t i = 0; i < entry->field_count; ++i) {
+        history_field_t* field = &entry->fields[i];
+        const char* value = undo ? field->values : field->values + field->old_size;
+        size_t size = undo ? field->old_size : field->new_size;
+        if (field->target >= FIELD_ID) {
+            restore_string(me, field->target, value, size);
+        } else {
+            memcpy(field_base(me, field->target) + field->offset, value, size);
+        }
+    }
+    ui_element_mark_dirty(me);
+    if (history.callbacks.changed) history.callbacks.changed(me);
+}
+
+// The tree takes its references to the fonts before the history drops its own, and the other
+// way around, so a font without others is never dropped in between
+static void put_back(history_entry_t* entry)
+{
+    ui_element_insert_child_before(entry->parent, entry->next, entry->element);
+    ui_element_mark_dirty(entry->element);
+    if (history.callbacks.attached) history.callbacks.attached(entry->element);
+    hold_fonts(entry->element, false);
+}
+
+static void take_out(history_entry_t* entry)
+{
+    hold_fonts(entry->element, true);
+    if (history.callbacks.detaching) history.callbacks.detaching(entry->element);
+    ui_element_detach(entry->element);
+}
+
+bool history_undo(void)
+{
+    history.open = false;
+    if (history.done == 0) return false;
+    history_entry_t* entry = entry_at(--history.done);
+    if (entry->type == HISTORY_PROPERTIES) {
+        apply_properties(entry, true);
+    } else if (entry->type == HISTORY_INSERT) {
+        take_out(entry);
+    } else {
+        put_back(entry);
+    }
+    return true;
+}
+
+bool history_redo(void)
+{
+    history.open = false;
+    if (history.done == history.count) return false;
+    history_entry_t* entry = entry_at(history.done++);
+    if (entry->type == HISTORY_PROPERTIES) {
+        apply_properties(entry, false);
+    } else if (entry->type == HISTORY_INSERT) {
+        put_back(entry);
+    } else {
+        take_out(entry);
+    }
+    return true;
+}
+
+void history_clear(void)
+{
+    size_t limit = history.limit;
+    drop_redo();
+    history.limit = 0;
+    trim();
+    history.limit = limit;
+    free(history.entries);
+    history.entries = NULL;
+    history.first = history.capacity = 0;
+    history.open = false;
+    for (size_t i = 0; i < FIELD_STRINGS; ++i) {
+        free((char*) before.strings[i].s.chars);
+        before.strings[i] = (dstring_t) { 0 };
+    }
+}
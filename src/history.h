@@ -0,0 +1,96 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ui_element.h"
+
+// Undo history of the editor's tree. A property edit is recorded as only the fields it changed,
+// found by comparing the element before and after the edit through the reflection tables in
+// clay_struct_names.h. Inserts and removes keep the subtree they take out of the tree instead of
+// copying it, so undoing or redoing an edit costs about as much as the edit did.
+
+#define HISTORY_DEFAULT_LIMIT ((size_t) 64 << 20)
+
+// Called when undo or redo changes the tree, any of them can be NULL
+typedef struct {
+    // After `me` and everything under it were put back in the tree
+    void (*attached)(ui_element_t* me);
+    // Before `me` and everything under it are taken out of the tree
+    void (*detaching)(ui_element_t* me);
+    // Before and after the properties of `me` are changed
+    void (*changing)(ui_element_t* me);
+    void (*changed)(ui_element_t* me);
+    // Take and drop a reference to a font. The history holds one to every font it may put back,
+    // those of the text under elements it keeps out of the tree, and those in the text configs
+    // it records, so their IDs aren't given to other fonts meanwhile.
+    void (*retain_font)(uint16_t font_id);
+    void (*release_font)(uint16_t font_id);
+} history_callbacks_t;
+
+void history_set_callbacks(history_callbacks_t callbacks);
+
+/**
+ * @brief Sets how many bytes the history may hold, the oldest edits are dropped to stay below it
+ *
+ * Removed elements, and inserted ones, count with everything under them. Defaults to
+ * HISTORY_DEFAULT_LIMIT.
+ */
+void history_set_limit(size_t bytes);
+
+/**
+ * @brief Remembers the properties of `me` before they are edited, call history_edit_end() after
+ *
+ * Holds a reference to the font of a text element until then, so the edit can release it.
+ */
+void history_edit_begin(ui_element_t* me);
+
+/**
+ * @brief Records the properties that changed since history_edit_begin(), if any did
+ *
+ * Edits of the same element are recorded as one until history_seal() is called, or something
+ * else is recorded, so a drag or a run of typing is undone at once.
+ *
+ * @return `bool` Whether any property changed
+ */
+bool history_edit_end(void);
+
+/**
+ * @brief Ends the edit further changes of the last edited element would be merged into
+ */
+void history_seal(void);
+
+/**
+ * @brief Records that `me` and everything under it was added to the tree
+ */
+void history_inserted(ui_element_t* me);
+
+/**
+ * @brief Takes `me` out of the tree and records it, the history frees it once it's dropped
+ *
+ * Holds references to the fonts under `me`, so the tree's can be released after.
+ */
+void history_remove(ui_element_t* me);
+
+/**
+ * @brief Reverts the last edit
+ *
+ * @return `bool` False if there is nothing to undo
+ */
+bool history_undo(void);
+
+/**
+ * @brief Applies the last undone edit again
+ *
+ * @return `bool` False if there is nothing to redo
+ */
+bool history_redo(void);
+
+/**
+ * @brief Drops every edit, and frees the elements removed by them, for when the tree is replaced
+ */
+void history_clear(void);
+
+#endif // HISTORY_H
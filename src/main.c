@@ -11,15 +11,28 @@
 
 #include "clay.h"
 #include "clay_enum_names.h"
+#include "batch.h"
 #include "clay_renderer_raylib.h"
 #include "components/clay_components.h"
+#include "font_cache.h"
+#include "history.h"
+#include "task_queue.h"
 #include "ui_element.h"
 #include "IO/export_layout.h"
 #include "IO/import_layout.h"
+#include "IO/journal.h"
+#include "IO/snapshot.h"
+#include "IO/import_preprocessor.h"
 #include "utilities.h"
 
 #define WINDOW_WIDTH (1600)
 #define WINDOW_HEIGHT (900)
+// Frames to keep laying out after the last input, Clay needs a frame to turn pressed/released
+// this frame into pressed/released
+#define SETTLE_FRAMES (2)
+// Edits are journaled here as they're made, and recovered from it on the next start if clayouter
+// didn't exit normally
+#define AUTOSAVE_PATH "autosave.journal"
 
 typedef struct {
     dstring_t id;
@@ -100,22 +113,12 @@ typedef struct {
     on_hover_properties_t on_hover;
 } declaration_properties_t;
 
-typedef struct {
-    Clay_String id;
-    uint16_t size;
-} font_info_t;
-
-typedef struct {
-    font_info_t* info;
-    Font* fonts;
-    size_t count;
-    size_t capacity;
-} fonts_t;
-
 typedef enum {
     FSV_NONE,
     FSV_IMPORT,
-    FSV_EXPORT
+    FSV_EXPORT,
+    FSV_SAVE,
+    FSV_OPEN
 } file_selection_visibility_t;
 
 typedef enum {
@@ -140,6 +143,9 @@ static declaration_properties_t selected_d_properties;
 static text_properties_t selected_t_properties;
 static ui_element_t* selected_ui_element = NULL;
 static ui_element_t* root;
+// A session opened from a snapshot, swapped in for `root` at the start of the next frame, as the
+// current frame's render commands still point at the old tree's strings
+static ui_element_t* opened_root = NULL;
 static Clay_ImageElementConfig color_picker_im;
 static file_selection_visibility_t file_selection_visible = FSV_NONE;
 static cc_selection_menu_t child_selection_menu = {
@@ -147,7 +153,6 @@ static cc_selection_menu_t child_selection_menu = {
 };
 static ui_element_t* selection_box_parent = NULL;
 
-static fonts_t fonts;
 static FilePathList font_files;
 static cc_selection_menu_t font_selection_menu = {
     .label = CLAY_STRING_CONST("Fonts")
@@ -246,6 +251,8 @@ static void dynamic_string_copy(dstring_t* dst, Clay_String src)
         memcpy((char*) dst->s.chars, src.chars, src.length);
     ((char*)dst->s.chars)[src.length] = '\0';
     dst->s.length = src.length;
+    // What's copied in is the value to compare edits against
+    dst->edited = false;
 }
 
 static void clay_string_copy(Clay_String* dst, dstring_t src)
@@ -321,10 +328,14 @@ static void adjust_element(ui_element_t* element,
                            adjustment_t adjustment,
                            Clay_Vector2 pos)
 {
+    history_edit_begin(element);
     adjust_element_(element->ptr, data, adjustment, pos);
     if (element->on_hover.ptr) {
         adjust_element_(element->on_hover.ptr, data, adjustment, pos);
     }
+    history_edit_end();
+    ui_element_mark_dirty(element);
+    journal_set(element);
 }
 
 static adjustment_t get_adjust_type(Clay_Vector2 mouse_pos, Clay_BoundingBox element)
@@ -389,29 +400,14 @@ static void select_font_callback(Clay_ElementId id, Clay_PointerData data, intpt
 
     assert(selected_ui_element);
     assert(selected_ui_element->type == UI_ELEMENT_TEXT);
-    uint16_t current_size = selected_ui_element->text_config->fontSize;
-    for (size_t i = 0; i < fonts.count; ++i) {
-        if (fonts.info[i].size == current_size &&
-            strcmp(fonts.info[i].id.chars, font_selection_menu.options[font_index].chars) == 0)
-        {
-            selected_ui_element->text_config->fontId = i;
-            load_properties();
-            return;
-        }
-    }
-
-    if (fonts.count == fonts.capacity) {
-        fonts.capacity *= 2;
-        REALLOC_ASSERT(fonts.fonts, sizeof(*fonts.fonts) * fonts.capacity);
-        REALLOC_ASSERT(fonts.info, sizeof(*fonts.info) * fonts.capacity);
-        Clay_SetMeasureTextFunction(Raylib_MeasureText, fonts.fonts);
-    }
-    size_t index = fonts.count;
-    fonts.count++;
-    fonts.fonts[index] = LoadFontEx(font_files.paths[font_index], current_size, NULL, 400);
-    fonts.info[index].id = font_selection_menu.options[font_index];
-    fonts.info[index].size = current_size;
-    selected_ui_element->text_config->fontId = index;
+    Clay_TextElementConfig* config = selected_ui_element->text_config;
+    history_edit_begin(selected_ui_element);
+    uint16_t font_id = font_cache_acquire(font_files.paths[font_index], config->fontSize);
+    font_cache_release(config->fontId);
+    config->fontId = font_id;
+    history_edit_end();
+    ui_element_mark_dirty(selected_ui_element);
+    journal_set(selected_ui_element);
     load_properties();
 }
 
@@ -427,32 +423,44 @@ static void toggle_edit_hovered(Clay_ElementId id, Clay_PointerData data, intptr
     load_properties();
 }
 
-static Clay_LayoutConfig save_layout(layout_properties_t* layout)
+// Text boxes are only parsed when they were edited since the last save, so holding a key or mouse
+// button down, as when dragging, doesn't parse every property each frame. A cleared text box saves
+// as 0, and `edited` is cleared as the value is saved.
+static bool take_edit(dstring_t* text)
 {
-    Clay_LayoutConfig ret = { 0 };
-    ret.sizing.width.type = layout->sizing_width_type;
-    if (layout->sizing_width.s.length)
-        ret.sizing.width.size.percent = strtof(layout->sizing_width.s.chars, NULL);
-    ret.sizing.height.type = layout->sizing_height_type;
-    if (layout->sizing_height.s.length)
-        ret.sizing.height.size.percent = strtof(layout->sizing_height.s.chars, NULL);
+    bool edited = text->edited;
+    text->edited = false;
+    return edited;
+}
+
+#define SAVE(dst, src, parse)                                                                      \
+    do {                                                                                           \
+        if (take_edit(&(src))) {                                                                   \
+            (dst) = (src).s.length ? parse : 0;                                                    \
+        }                                                                                          \
+    } while (0)
 
-    if (layout->padding_top.s.length)
-        ret.padding.top = (uint16_t) strtoul(layout->padding_top.s.chars, NULL, 0);
-    if (layout->padding_bottom.s.length)
-        ret.padding.bottom = (uint16_t) strtoul(layout->padding_bottom.s.chars, NULL, 0);
-    if (layout->padding_right.s.length)
-        ret.padding.right = (uint16_t) strtoul(layout->padding_right.s.chars, NULL, 0);
-    if (layout->padding_left.s.length)
-        ret.padding.left = (uint16_t) strtoul(layout->padding_left.s.chars, NULL, 0);
+#define SAVE_FLOAT(dst, src) SAVE(dst, src, strtof((src).s.chars, NULL))
+#define SAVE_UINT(dst, src, type) SAVE(dst, src, (type) strtoul((src).s.chars, NULL, 0))
+#define SAVE_INT(dst, src, type) SAVE(dst, src, (type) strtol((src).s.chars, NULL, 0))
 
-    if (layout->child_gap.s.length)
-        ret.childGap = (uint16_t) strtoul(layout->child_gap.s.chars, NULL, 0);
-    ret.childAlignment.x = layout->child_alignment_x;
-    ret.childAlignment.y = layout->child_alignment_y;
+static void save_layout(Clay_LayoutConfig* dst, layout_properties_t* layout)
+{
+    dst->sizing.width.type = layout->sizing_width_type;
+    SAVE_FLOAT(dst->sizing.width.size.percent, layout->sizing_width);
+    dst->sizing.height.type = layout->sizing_height_type;
+    SAVE_FLOAT(dst->sizing.height.size.percent, layout->sizing_height);
 
-    ret.layoutDirection = layout->layout_direction;
-    return ret;
+    SAVE_UINT(dst->padding.top, layout->padding_top, uint16_t);
+    SAVE_UINT(dst->padding.bottom, layout->padding_bottom, uint16_t);
+    SAVE_UINT(dst->padding.right, layout->padding_right, uint16_t);
+    SAVE_UINT(dst->padding.left, layout->padding_left, uint16_t);
+
+    SAVE_UINT(dst->childGap, layout->child_gap, uint16_t);
+    dst->childAlignment.x = layout->child_alignment_x;
+    dst->childAlignment.y = layout->child_alignment_y;
+
+    dst->layoutDirection = layout->layout_direction;
 }
 
 #define LOAD(dst, src, format)                                                                     \
@@ -465,6 +473,7 @@ static Clay_LayoutConfig save_layout(layout_properties_t* layout)
             (dst).s.chars = tmp;                                                                   \
         }                                                                                          \
         (dst).s.length = sprintf((char*) (dst).s.chars, format, (src));                            \
+        (dst).edited = false;                                                                      \
     } while (0)
 
 #define LOAD_FLOAT(dst, src) LOAD(dst, src, "%3.1f")
@@ -530,91 +539,85 @@ static void load_on_hover(on_hover_properties_t* dst, const on_hover_config_t* s
         dynamic_string_copy(&dst->callback, src->callback);
 }
 
-static Clay_TextElementConfig save_text_config(const text_properties_t* src)
+// Swaps the reference to `font_id` for one to the font named in `src` at `font_size`
+static uint16_t save_font(const text_properties_t* src, uint16_t font_id, uint16_t font_size)
 {
-    Clay_TextElementConfig ret = { 0 };
-    if (src->font_size.s.length)
-        ret.fontSize = (uint16_t) strtoul(src->font_size.s.chars, NULL, 0);
-    for (size_t i = 0; i < fonts.count; ++i) {
-        if (fonts.info[i].size == ret.fontSize &&
-            strcmp(fonts.info[i].id.chars, src->font_name.s.chars) == 0) {
-            ret.fontId = (uint16_t) i;
-            break;
+    Clay_String name = font_cache_name(font_id);
+    if (font_size == 0
+        || (font_cache_has_size(font_id, font_size) && name.length == src->font_name.s.length
+            && memcmp(name.chars, src->font_name.s.chars, (size_t) name.length) == 0)) {
+        return font_id;
+    }
+    for (size_t i = 0; i < font_selection_menu.count; ++i) {
+        Clay_String option = font_selection_menu.options[i];
+        if (option.length == src->font_name.s.length
+            && memcmp(option.chars, src->font_name.s.chars, (size_t) option.length) == 0) {
+            uint16_t new_id = font_cache_acquire(font_files.paths[i], font_size);
+            font_cache_release(font_id);
+            return new_id;
         }
     }
-    if (src->letter_spacing.s.length)
-        ret.letterSpacing = (uint16_t) strtoul(src->letter_spacing.s.chars, NULL, 0);
-    if (src->line_height.s.length)
-        ret.lineHeight = (uint16_t) strtoul(src->line_height.s.chars, NULL, 0);
-    ret.textColor = cc_parse_color(&src->text_color);
-    ret.wrapMode = src->wrap_mode;
-    ret.textAlignment = src->text_alignment;
-    ret.hashStringContents = src->hash_string_contents;
-    return ret;
-}
-
-static Clay_CornerRadius save_corner_radius(const general_properties_t* src)
-{
-    Clay_CornerRadius ret = { 0 };
-    if (src->corner_radius_top_left.s.length)
-        ret.topLeft = strtof(src->corner_radius_top_left.s.chars, NULL);
-    if (src->corner_radius_top_right.s.length)
-        ret.topRight = strtof(src->corner_radius_top_right.s.chars, NULL);
-    if (src->corner_radius_bottom_left.s.length)
-        ret.bottomLeft = strtof(src->corner_radius_bottom_left.s.chars, NULL);
-    if (src->corner_radius_bottom_right.s.length)
-        ret.bottomRight = strtof(src->corner_radius_bottom_right.s.chars, NULL);
-    return ret;
-}
-
-static Clay_FloatingElementConfig save_floating(const floating_properties_t* src)
-{
-    Clay_FloatingElementConfig ret = { 0 };
-    if (src->offset_x.s.length)
-        ret.offset.x = strtof(src->offset_x.s.chars, NULL);
-    if (src->offset_y.s.length)
-        ret.offset.y = strtof(src->offset_y.s.chars, NULL);
-    if (src->expand_width.s.length)
-        ret.expand.width = strtof(src->expand_width.s.chars, NULL);
-    if (src->expand_height.s.length)
-        ret.expand.height = strtof(src->expand_height.s.chars, NULL);
-    // if (src->parent_id.s.length) TODO
-    //     ret.parentId
-    if (src->z_index.s.length)
-        ret.zIndex = (int16_t) strtol(src->z_index.s.chars, NULL, 0);
-    ret.attachPoints.element = src->element_attach_type;
-    ret.attachPoints.parent = src->parent_attach_type;
-    ret.pointerCaptureMode = src->pointer_capture_mode;
-    ret.attachTo = src->attach_to;
-    return ret;
-}
-
-static Clay_BorderElementConfig save_border(const border_properties_t* src)
-{
-    Clay_BorderElementConfig ret = { 0 };
-    ret.color = cc_parse_color(&src->color);
-    if (src->left.s.length)
-        ret.width.left = (uint16_t) strtoul(src->left.s.chars, NULL, 0);
-    if (src->right.s.length)
-        ret.width.right = (uint16_t) strtoul(src->right.s.chars, NULL, 0);
-    if (src->top.s.length)
-        ret.width.top = (uint16_t) strtoul(src->top.s.chars, NULL, 0);
-    if (src->bottom.s.length)
-        ret.width.bottom = (uint16_t) strtoul(src->bottom.s.chars, NULL, 0);
-    if (src->between_children.s.length)
-        ret.width.betweenChildren = (uint16_t) strtoul(src->between_children.s.chars, NULL, 0);
-
-    return ret;
-}
-
-static void save_on_hover(on_hover_config_t* dst, const on_hover_properties_t* src)
-{
-    clay_string_copy(&dst->callback, src->callback);
+    return font_id;
+}
+
+static void save_text_config(Clay_TextElementConfig* dst, text_properties_t* src)
+{
+    if (take_edit(&src->font_size)) {
+        dst->fontSize = src->font_size.s.length
+            ? (uint16_t) strtoul(src->font_size.s.chars, NULL, 0) : 0;
+        dst->fontId = save_font(src, dst->fontId, dst->fontSize);
+    }
+    SAVE_UINT(dst->letterSpacing, src->letter_spacing, uint16_t);
+    SAVE_UINT(dst->lineHeight, src->line_height, uint16_t);
+    cc_apply_color_edits(&dst->textColor, &src->text_color);
+    dst->wrapMode = src->wrap_mode;
+    dst->textAlignment = src->text_alignment;
+    dst->hashStringContents = src->hash_string_contents;
+}
+
+static void save_corner_radius(Clay_CornerRadius* dst, general_properties_t* src)
+{
+    SAVE_FLOAT(dst->topLeft, src->corner_radius_top_left);
+    SAVE_FLOAT(dst->topRight, src->corner_radius_top_right);
+    SAVE_FLOAT(dst->bottomLeft, src->corner_radius_bottom_left);
+    SAVE_FLOAT(dst->bottomRight, src->corner_radius_bottom_right);
+}
+
+static void save_floating(Clay_FloatingElementConfig* dst, floating_properties_t* src)
+{
+    SAVE_FLOAT(dst->offset.x, src->offset_x);
+    SAVE_FLOAT(dst->offset.y, src->offset_y);
+    SAVE_FLOAT(dst->expand.width, src->expand_width);
+    SAVE_FLOAT(dst->expand.height, src->expand_height);
+    // parent_id TODO
+    SAVE_INT(dst->zIndex, src->z_index, int16_t);
+    dst->attachPoints.element = src->element_attach_type;
+    dst->attachPoints.parent = src->parent_attach_type;
+    dst->pointerCaptureMode = src->pointer_capture_mode;
+    dst->attachTo = src->attach_to;
+}
+
+static void save_border(Clay_BorderElementConfig* dst, border_properties_t* src)
+{
+    cc_apply_color_edits(&dst->color, &src->color);
+    SAVE_UINT(dst->width.left, src->left, uint16_t);
+    SAVE_UINT(dst->width.right, src->right, uint16_t);
+    SAVE_UINT(dst->width.top, src->top, uint16_t);
+    SAVE_UINT(dst->width.bottom, src->bottom, uint16_t);
+    SAVE_UINT(dst->width.betweenChildren, src->between_children, uint16_t);
+}
+
+static void save_on_hover(on_hover_config_t* dst, on_hover_properties_t* src)
+{
+    if (take_edit(&src->callback)) {
+        clay_string_copy(&dst->callback, src->callback);
+    }
     dst->enabled = src->enable;
 }
 
 static void save_properties(void)
 {
+    history_edit_begin(selected_ui_element);
     if (selected_ui_element->type == UI_ELEMENT_DECLARATION) {
         Clay_ElementDeclaration* element;
         if (selected_ui_element->on_hover.ptr && selected_d_properties.on_hover.editing)
@@ -622,29 +625,41 @@ static void save_properties(void)
         else
             element = selected_ui_element->ptr;
 
-        static int previous_length = 0;
-        if (selected_d_properties.general.id.s.length
-            && previous_length != selected_d_properties.general.id.s.length) {
+        dstring_t* id = &selected_d_properties.general.id;
+        if (take_edit(id) && id->s.length) {
             char* before = (char*) element->id.stringId.chars;
-            element->id = Clay__HashString(selected_d_properties.general.id.s, 0, 0);
+            element->id = Clay__HashString(id->s, 0, 0);
             void* tmp = realloc(before, (size_t) element->id.stringId.length);
             assert(tmp);
             element->id.stringId.chars = tmp;
-            memcpy((char*) element->id.stringId.chars, selected_d_properties.general.id.s.chars,
+            memcpy((char*) element->id.stringId.chars, id->s.chars,
                 (size_t) element->id.stringId.length);
-            previous_length = selected_d_properties.general.id.s.length;
+            // The hover declaration's ID usually shares its string with the element's, and must
+            // keep pointing to it
+            Clay_ElementDeclaration* other = element == selected_ui_element->ptr
+                ? selected_ui_element->on_hover.ptr : selected_ui_element->ptr;
+            if (other && before && other->id.stringId.chars == before) {
+                other->id = element->id;
+            }
         }
-        element->layout = save_layout(&selected_d_properties.layout);
-        element->backgroundColor = cc_parse_color(&selected_d_properties.general.background_color);
-        element->cornerRadius = save_corner_radius(&selected_d_properties.general);
-        element->floating = save_floating(&selected_d_properties.floating);
+        save_layout(&element->layout, &selected_d_properties.layout);
+        cc_apply_color_edits(
+            &element->backgroundColor, &selected_d_properties.general.background_color);
+        save_corner_radius(&element->cornerRadius, &selected_d_properties.general);
+        save_floating(&element->floating, &selected_d_properties.floating);
         element->scroll.horizontal = selected_d_properties.general.scroll_horizontal;
         element->scroll.vertical = selected_d_properties.general.scroll_vertical;
-        element->border = save_border(&selected_d_properties.border);
+        save_border(&element->border, &selected_d_properties.border);
         save_on_hover(&selected_ui_element->on_hover, &selected_d_properties.on_hover);
     } else if (selected_ui_element->type == UI_ELEMENT_TEXT) {
-        dynamic_string_copy(&selected_ui_element->text, selected_t_properties.text.s);
-        *selected_ui_element->text_config = save_text_config(&selected_t_properties);
+        if (take_edit(&selected_t_properties.text)) {
+            dynamic_string_copy(&selected_ui_element->text, selected_t_properties.text.s);
+        }
+        save_text_config(selected_ui_element->text_config, &selected_t_properties);
+    }
+    if (history_edit_end()) {
+        ui_element_mark_dirty(selected_ui_element);
+        journal_set(selected_ui_element);
     }
 }
 
@@ -678,7 +693,7 @@ static void load_properties(void)
         Clay_TextElementConfig* src = selected_ui_element->text_config;
         dynamic_string_copy(&selected_t_properties.text, selected_ui_element->text.s);
         load_color(&selected_t_properties.text_color, src->textColor);
-        dynamic_string_copy(&selected_t_properties.font_name, fonts.info[src->fontId].id);
+        dynamic_string_copy(&selected_t_properties.font_name, font_cache_name(src->fontId));
         LOAD_UINT(selected_t_properties.font_size, src->fontSize);
         LOAD_UINT(selected_t_properties.letter_spacing, src->letterSpacing);
         LOAD_UINT(selected_t_properties.line_height, src->lineHeight);
@@ -936,13 +951,13 @@ static void show_children(ui_element_t* e)
             child_selection_menu.options[i].chars = tmp;
         }
         child_selection_menu.cbs[i] = select_child_callback;
-        child_selection_menu.user_data[i] = (intptr_t) e->children[i];
+        child_selection_menu.user_data[i] = (intptr_t) ui_element_child_at(e, i);
     }
     for (size_t i = 0; i < e->num_children; ++i) {
         // assumes 2 types of elements
         child_selection_menu.options[i].length
             = snprintf((char*) child_selection_menu.options[i].chars, 64, "Child %zu, %s", i,
-                e->children[i]->type ? "Text" : "Element");
+                ui_element_child_at(e, i)->type ? "Text" : "Element");
     }
     child_selection_menu.count = e->num_children;
     cc_selection_menu(&child_selection_menu);
@@ -959,6 +974,8 @@ static void add_element_callback(Clay_ElementId id, Clay_PointerData data, intpt
         } else {
             selected_ui_element = ui_element_insert_after((ui_element_t*) user_data, dropdown_parent, UI_ELEMENT_DECLARATION);
         }
+        journal_insert(selected_ui_element);
+        history_inserted(selected_ui_element);
         load_properties();
         dropdown_parent = NULL;
     }
@@ -969,6 +986,8 @@ static void insert_before_callback(Clay_ElementId id, Clay_PointerData data, int
     (void) id;
     if (data.state == CLAY_POINTER_DATA_PRESSED_THIS_FRAME) {
         selected_ui_element = ui_element_insert_before((ui_element_t*) user_data, dropdown_parent, UI_ELEMENT_DECLARATION);
+        journal_insert(selected_ui_element);
+        history_inserted(selected_ui_element);
         load_properties();
         dropdown_parent = NULL;
     }
@@ -979,11 +998,114 @@ static void add_text_callback(Clay_ElementId id, Clay_PointerData data, intptr_t
     (void) id;
     if (data.state == CLAY_POINTER_DATA_PRESSED_THIS_FRAME) {
         selected_ui_element = ui_element_insert_after((ui_element_t*) user_data, NULL, UI_ELEMENT_TEXT);
+        font_cache_retain(selected_ui_element->text_config->fontId);
+        journal_insert(selected_ui_element);
+        history_inserted(selected_ui_element);
         load_properties();
         dropdown_parent = NULL;
     }
 }
 
+// Clears the selection if it's `me` or anything under it, before `me` leaves the tree
+static void deselect_within(ui_element_t* me)
+{
+    for (ui_element_t* e = selected_ui_element; e; e = e->parent) {
+        if (e == me) {
+            selected_ui_element = NULL;
+            return;
+        }
+    }
+}
+
+// Every text element in the tree holds a reference to its font
+static void retain_fonts(ui_element_t* me)
+{
+    if (me->type == UI_ELEMENT_TEXT) {
+        // Font IDs in imported files needn't match any font loaded here
+        if (!font_cache_retain(me->text_config->fontId)) {
+            me->text_config->fontId = BODY_TEXT->fontId;
+            font_cache_retain(me->text_config->fontId);
+        }
+        return;
+    }
+    for (ui_element_t* child = me->first_child; child; child = child->next) {
+        retain_fonts(child);
+    }
+}
+
+static void release_fonts(ui_element_t* me)
+{
+    if (me->type == UI_ELEMENT_TEXT) {
+        font_cache_release(me->text_config->fontId);
+        return;
+    }
+    for (ui_element_t* child = me->first_child; child; child = child->next) {
+        release_fonts(child);
+    }
+}
+
+// Sessions and the autosave journal store fonts by file and size, as font IDs are only good for
+// this run. A text element decoded from them holds a reference to its font, as retain_fonts()
+// would give it.
+static bool describe_font(uint16_t id, snapshot_font_t* font, void* user_data)
+{
+    (void) user_data;
+    return font_cache_lookup(id, &font->path, &font->size);
+}
+
+static uint16_t resolve_font(snapshot_font_t font, void* user_data)
+{
+    (void) user_data;
+    if (font.path == NULL) {
+        font_cache_retain(BODY_TEXT->fontId);
+        return BODY_TEXT->fontId;
+    }
+    return font_cache_acquire(font.path, font.size);
+}
+
+static const snapshot_fonts_t session_fonts = { .describe = describe_font,
+                                                .resolve = resolve_font };
+
+// Undo and redo keep the fonts and the journal in step with the tree, the same as the editing
+// callbacks do
+static uint16_t changing_font_id;
+
+static void history_attached(ui_element_t* me)
+{
+    retain_fonts(me);
+    journal_insert(me);
+}
+
+static void history_detaching(ui_element_t* me)
+{
+    deselect_within(me);
+    dropdown_parent = NULL;
+    journal_remove(me);
+    release_fonts(me);
+}
+
+static void history_retain_font(uint16_t font_id)
+{
+    font_cache_retain(font_id);
+}
+
+static void history_changing(ui_element_t* me)
+{
+    if (me->type == UI_ELEMENT_TEXT) {
+        changing_font_id = me->text_config->fontId;
+    }
+}
+
+static void history_changed(ui_element_t* me)
+{
+    // Retained before the old font is released, which could drop it
+    if (me->type == UI_ELEMENT_TEXT) {
+        retain_fonts(me);
+        font_cache_release(changing_font_id);
+    }
+    journal_set(me);
+}
+
 static void import_element_callback(Clay_ElementId id, Clay_PointerData data, intptr_t user_data)
 {
     (void) id;
@@ -991,11 +1113,10 @@ static void import_element_callback(Clay_ElementId id, Clay_PointerData data, in
     dstring_t* path = (dstring_t*) user_data;
     ui_element_t* tmp = import_layout(path->s.chars);
     if (tmp) {
-        ui_element_t* parent = dropdown_parent;
-        parent->num_children++;
-        REALLOC_ASSERT(parent->children, sizeof(*parent->children) * parent->num_children);
-        parent->children[parent->num_children - 1] = tmp;
-        tmp->parent = parent;
+        retain_fonts(tmp);
+        ui_element_append_child(dropdown_parent, tmp);
+        journal_insert(tmp);
+        history_inserted(tmp);
         selected_ui_element = tmp;
         load_properties();
         file_selection_visible = FSV_NONE;
@@ -1008,11 +1129,12 @@ static void remove_element_callback(Clay_ElementId id, Clay_PointerData data, in
     (void) id;
     if (data.state == CLAY_POINTER_DATA_PRESSED_THIS_FRAME) {
         ui_element_t* node = (ui_element_t*) user_data;
-        if (selected_ui_element == node) {
-            selected_ui_element = NULL;
+        if (node != root) {
+            deselect_within(node);
+            journal_remove(node);
+            history_remove(node);
+            release_fonts(node);
         }
-        if (node != root)
-            ui_element_remove(node);
         dropdown_parent = NULL;
     }
 }
@@ -1038,6 +1160,34 @@ static void dump_callback(Clay_ElementId id, Clay_PointerData data, intptr_t use
     }
 }
 
+static void save_session_callback(Clay_ElementId id, Clay_PointerData data, intptr_t user_data)
+{
+    (void) id;
+    dstring_t* path = (dstring_t*) user_data;
+    if (data.state == CLAY_POINTER_DATA_PRESSED_THIS_FRAME) {
+        snapshot_save(path->s.chars, root, &session_fonts);
+        dropdown_parent = NULL;
+        file_selection_visible = FSV_NONE;
+    }
+}
+
+static void open_session_callback(Clay_ElementId id, Clay_PointerData data, intptr_t user_data)
+{
+    (void) id;
+    if (data.state != CLAY_POINTER_DATA_PRESSED_THIS_FRAME) return;
+    dstring_t* path = (dstring_t*) user_data;
+    ui_element_t* tmp = snapshot_load(path->s.chars, &session_fonts);
+    if (tmp) {
+        if (opened_root) {
+            release_fonts(opened_root);
+            ui_element_remove(opened_root);
+        }
+        opened_root = tmp;
+        file_selection_visible = FSV_NONE;
+        dropdown_parent = NULL;
+    }
+}
+
 static void open_file_selection(Clay_ElementId id, Clay_PointerData data, intptr_t user_data)
 {
     (void) id;
@@ -1105,6 +1255,8 @@ static void dropdown(ui_element_t* parent)
         cc_button(CLAY_STRING("Remove element"), remove_element_callback, (intptr_t) parent);
         cc_button(CLAY_STRING("Properties"), properties_callback, (intptr_t) parent);
         cc_button(CLAY_STRING("Export layout"), open_file_selection, (intptr_t) FSV_EXPORT);
+        cc_button(CLAY_STRING("Save session"), open_file_selection, (intptr_t) FSV_SAVE);
+        cc_button(CLAY_STRING("Open session"), open_file_selection, (intptr_t) FSV_OPEN);
     }
 }
 
@@ -1118,7 +1270,7 @@ static void configure_element(ui_element_t* me)
         Clay_ElementDeclaration* declaration;
         if (me->on_hover.enabled && Clay_Hovered()) {
             if (me->on_hover.ptr == NULL) {
-                me->on_hover.ptr = malloc_assert(sizeof(*me->on_hover.ptr));
+                me->on_hover.ptr = ui_element_alloc_declaration();
                 memcpy(me->on_hover.ptr, me->ptr, sizeof(*me->on_hover.ptr));
             }
             declaration = me->on_hover.ptr;
@@ -1133,8 +1285,8 @@ static void configure_element(ui_element_t* me)
         if (selection_box_parent == me) {
             selection_box();
         }
-        for (size_t i = 0; i < me->num_children; ++i) {
-            configure_element(me->children[i]);
+        for (ui_element_t* child = me->first_child; child; child = child->next) {
+            configure_element(child);
         }
         Clay__CloseElement();
     } else if (me->type == UI_ELEMENT_TEXT) {
@@ -1146,10 +1298,6 @@ static void init_fonts(void)
 {
     font_files = LoadDirectoryFiles("resources");
     const char* default_font = "Roboto-Regular";
-    fonts.capacity = theme->text_types_count;
-    fonts.count = theme->text_types_count;
-    fonts.fonts = (Font*) malloc(sizeof(*fonts.fonts) * fonts.capacity);
-    fonts.info = (font_info_t*) malloc(sizeof(*fonts.info) * fonts.capacity);
     for (size_t i = 0; i < font_files.count;) {
         if (strcmp(GetFileExtension(font_files.paths[i]), ".ttf")) {
             font_files.count--;
@@ -1160,15 +1308,10 @@ static void init_fonts(void)
         }
         const char* filename = GetFileNameWithoutExt(font_files.paths[i]);
         if (!strcmp(filename, default_font)) {
-            size_t filename_len = strlen(filename);
-            // this memory is leaked, but that's fine, it's only allocated at init
-            char* allocated_filename = malloc(filename_len + 1);
-            assert(allocated_filename);
-            strcpy(allocated_filename, filename);
+            // the theme holds these for the whole session
             for (size_t j = 0; j < theme->text_types_count; ++j) {
-                fonts.fonts[j] = LoadFontEx(font_files.paths[i], theme->text_types[j].fontSize, NULL, 400);
-                fonts.info[j].id = (Clay_String) { filename_len, allocated_filename };
-                fonts.info[j].size = theme->text_types[j].fontSize;
+                theme->text_types[j].fontId
+                    = font_cache_acquire(font_files.paths[i], theme->text_types[j].fontSize);
             }
         }
         ++i;
@@ -1188,7 +1331,7 @@ static void init_fonts(void)
         font_selection_menu.user_data[i] =  (intptr_t) i;
     }
 
-    Clay_SetMeasureTextFunction(Raylib_MeasureText, fonts.fonts);
+    Clay_SetMeasureTextFunction(font_cache_measure_text, NULL);
 }
 
 static void init_dropdown(void)
@@ -1206,8 +1349,21 @@ static void init_dropdown(void)
     dropdown_menu.border.width = (Clay_BorderWidth) CLAY_BORDER_OUTSIDE(1);
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
+    if (argc > 1 && !strcmp(argv[1], "--batch")) {
+        return batch_main(argc - 2, argv + 2);
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--sdf")) {
+            font_cache_set_sdf(true);
+        } else if (!strcmp(argv[i], "--undo-memory") && i + 1 < argc) {
+            history_set_limit((size_t) strtoull(argv[++i], NULL, 10) << 20);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
     SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_WINDOW_HIGHDPI /*| FLAG_MSAA_4X_HINT*/);
     InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Clayouter");
     SetTargetFPS(60);
@@ -1221,12 +1377,22 @@ int main(void)
     theme = cc_get_theme();
     init_fonts();
 
-    root = ui_element_insert_after(NULL, NULL, UI_ELEMENT_DECLARATION);
-    root->ptr->layout.sizing = (Clay_Sizing) { .width = CLAY_SIZING_GROW(0), .height = CLAY_SIZING_GROW(0) };
-    root->ptr->id.stringId.chars = malloc(sizeof("root"));
-    assert(root->ptr->id.stringId.chars);
-    strcpy((char*) root->ptr->id.stringId.chars, "root");
-    root->ptr->id.stringId.length = sizeof("root") - 1;
+    root = journal_recover(AUTOSAVE_PATH, &session_fonts);
+    if (root == NULL) {
+        root = ui_element_insert_after(NULL, NULL, UI_ELEMENT_DECLARATION);
+        root->ptr->layout.sizing = (Clay_Sizing) { .width = CLAY_SIZING_GROW(0), .height = CLAY_SIZING_GROW(0) };
+        root->ptr->id.stringId.chars = malloc(sizeof("root"));
+        assert(root->ptr->id.stringId.chars);
+        strcpy((char*) root->ptr->id.stringId.chars, "root");
+        root->ptr->id.stringId.length = sizeof("root") - 1;
+    }
+    journal_open(AUTOSAVE_PATH, root, &session_fonts);
+    history_set_callbacks((history_callbacks_t) { .attached = history_attached,
+                                                  .detaching = history_detaching,
+                                                  .changing = history_changing,
+                                                  .changed = history_changed,
+                                                  .retain_font = history_retain_font,
+                                                  .release_font = font_cache_release });
 
     init_dropdown();
 
@@ -1235,25 +1401,69 @@ int main(void)
     color_picker_im.sourceDimensions.width = (float) color_picker_texture.width;
     color_picker_im.sourceDimensions.height = (float) color_picker_texture.height;
 
+    Clay_RenderCommandArray render_commands = { 0 };
+    Vector2 previous_mouse = { 0 };
+    int idle_frames = 0;
     while (!WindowShouldClose()) {
-        selection_box_parent = NULL;
-
         bool left_mouse = IsMouseButtonDown(0);
         bool right_mouse = IsMouseButtonDown(1);
+        Vector2 mouse = GetMousePosition();
+        Vector2 wheel = GetMouseWheelMoveV();
+        int key = GetKeyPressed();
+        if (font_cache_update()) {
+            ui_element_mark_dirty(root);
+        }
+        if (opened_root) {
+            release_fonts(root);
+            ui_element_remove(root);
+            root = opened_root;
+            opened_root = NULL;
+            selected_ui_element = NULL;
+            journal_reset(root);
+            history_clear();
+        }
+        // Each click starts a new edit, so a drag or the typing after a click is undone at once
+        if (IsMouseButtonPressed(0)) {
+            history_seal();
+        }
+        bool control = IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL);
+        if (control && (key == KEY_Z || key == KEY_Y)) {
+            bool shift = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+            bool changed = key == KEY_Z && !shift ? history_undo() : history_redo();
+            if (changed && selected_ui_element) {
+                load_properties();
+            }
+            key = 0;
+        }
+        journal_flush();
+
+        bool active = left_mouse || right_mouse || key || wheel.x != 0 || wheel.y != 0
+            || mouse.x != previous_mouse.x || mouse.y != previous_mouse.y || IsWindowResized()
+            || Clay_Raylib_ScrollInProgress() || font_cache_loading() || journal_busy();
+        previous_mouse = mouse;
+        idle_frames = active ? 0 : idle_frames + 1;
+        // Nothing changed, the previous frame's render commands are still in Clay's arena. Sleep
+        // in EndDrawing() until the next input event instead of redrawing them every frame.
+        if (idle_frames > SETTLE_FRAMES && !root->dirty) {
+            EnableEventWaiting();
+            BeginDrawing();
+            Clay_Raylib_RenderDamaged(render_commands, font_cache_fonts(), BLACK);
+            EndDrawing();
+            continue;
+        }
+
+        DisableEventWaiting();
+        selection_box_parent = NULL;
         Clay_SetLayoutDimensions((Clay_Dimensions) { (float) GetScreenWidth(),
                                                      (float) GetScreenHeight() });
-        Clay_SetPointerStateEx(RAYLIB_VECTOR_TO_CLAY_VECTOR(GetMousePosition()),
-                               left_mouse,
-                               right_mouse);
-        Clay_UpdateScrollContainers(true,
-                                    RAYLIB_VECTOR_TO_CLAY_VECTOR(GetMouseWheelMoveV()),
-                                    GetFrameTime());
+        Clay_SetPointerStateEx(RAYLIB_VECTOR_TO_CLAY_VECTOR(mouse), left_mouse, right_mouse);
+        Clay_UpdateScrollContainers(true, RAYLIB_VECTOR_TO_CLAY_VECTOR(wheel), GetFrameTime());
 
-        int key = GetKeyPressed();
         if (key && cc_get_selected_text_box()) {
             if (key == KEY_TAB) {
                 cc_text_box_advance();
-            } else if (key != KEY_LEFT_SHIFT && key != KEY_RIGHT_SHIFT) {
+            } else if (key != KEY_LEFT_SHIFT && key != KEY_RIGHT_SHIFT
+                && key != KEY_LEFT_CONTROL && key != KEY_RIGHT_CONTROL) {
                 cc_text_box_append(cc_get_selected_text_box(), get_char_from_key(key));
             }
         }
@@ -1274,22 +1484,30 @@ int main(void)
             file_selection(import_element_callback, CLAY_STRING("Import"));
         } else if (file_selection_visible == FSV_EXPORT) {
             file_selection(dump_callback, CLAY_STRING("Export"));
+        } else if (file_selection_visible == FSV_SAVE) {
+            file_selection(save_session_callback, CLAY_STRING("Save"));
+        } else if (file_selection_visible == FSV_OPEN) {
+            file_selection(open_session_callback, CLAY_STRING("Open"));
         }
 
+        render_commands = Clay_EndLayout();
+        ui_element_clear_dirty(root);
+
         BeginDrawing();
-        ClearBackground(BLACK);
-        Clay_Raylib_Render(Clay_EndLayout(), fonts.fonts);
+        Clay_Raylib_RenderDamaged(render_commands, font_cache_fonts(), BLACK);
         EndDrawing();
     }
 
+    journal_close(true);
     UnloadDirectoryFiles(font_files);
     cc_free();
+    history_clear();
     ui_element_remove(root);
-    for (size_t i = 0; i < fonts.count; ++i) {
-        UnloadFont(fonts.fonts[i]);
-    }
-    free(fonts.fonts);
-    free(fonts.info);
+    ui_element_remove(opened_root);
+    free_clay_h_macros();
+    Clay_Raylib_FreeDamageTracking();
+    font_cache_free();
+    task_queue_shutdown();
     CloseWindow();
     free(clay_memory);
 }
@@ -0,0 +1,121 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "concurrency.h"
+#include "task_queue.h"
+#include "utilities.h"
+
+struct task_s {
+    task_func_t func;
+    void* arg;
+    bool done;
+    struct task_s* next;
+};
+
+static struct {
+    mutex_t lock;
+    // Signalled when a task is queued or the queue is shutting down
+    cond_t queued;
+    // Broadcast whenever a task finishes
+    cond_t finished;
+    task_t* head;
+    task_t* tail;
+    thread_t thread;
+    bool running;
+    bool stopping;
+} queue = {
+    .lock = MUTEX_INITIALIZER,
+    .queued = COND_INITIALIZER,
+    .finished = COND_INITIALIZER,
+};
+
+static void task_queue_worker(void* arg)
+{
+    (void) arg;
+    mutex_lock(&queue.lock);
+    for (;;) {
+        while (queue.head == NULL && !queue.stopping) {
+            cond_wait(&queue.queued, &queue.lock);
+        }
+        task_t* task = queue.head;
+        if (task == NULL) break;
+        queue.head = task->next;
+        if (queue.head == NULL) queue.tail = NULL;
+        mutex_unlock(&queue.lock);
+
+        task->func(task->arg);
+
+        mutex_lock(&queue.lock);
+        task->done = true;
+        cond_broadcast(&queue.finished);
+    }
+    mutex_unlock(&queue.lock);
+}
+
+task_t* task_submit(task_func_t func, void* arg)
+{
+    task_t* task = (task_t*) malloc_assert(sizeof(*task));
+    task->func = func;
+    task->arg = arg;
+    task->done = false;
+    task->next = NULL;
+
+    mutex_lock(&queue.lock);
+    if (!queue.running) {
+        queue.running = thread_create(&queue.thread, task_queue_worker, NULL);
+    }
+    if (!queue.running) {
+        // No thread, so run it here rather than never
+        mutex_unlock(&queue.lock);
+        func(arg);
+        task->done = true;
+        return task;
+    }
+    if (queue.tail) {
+        queue.tail->next = task;
+    } else {
+        queue.head = task;
+    }
+    queue.tail = task;
+    cond_signal(&queue.queued);
+    mutex_unlock(&queue.lock);
+    return task;
+}
+
+bool task_done(task_t* task)
+{
+    mutex_lock(&queue.lock);
+    bool done = task->done;
+    mutex_unlock(&queue.lock);
+    return done;
+}
+
+void task_wait(task_t* task)
+{
+    mutex_lock(&queue.lock);
+    while (!task->done) {
+        cond_wait(&queue.finished, &queue.lock);
+    }
+    mutex_unlock(&queue.lock);
+}
+
+void task_free(task_t* task)
+{
+    free(task);
+}
+
+void task_queue_shutdown(void)
+{
+    mutex_lock(&queue.lock);
+    if (!queue.running) {
+        mutex_unlock(&queue.lock);
+        return;
+    }
+    queue.stopping = true;
+    cond_signal(&queue.queued);
+    mutex_unlock(&queue.lock);
+
+    thread_join(queue.thread);
+    queue.running = false;
+    queue.stopping = false;
+}
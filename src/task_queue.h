@@ -0,0 +1,39 @@
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <stdbool.h>
+
+// Runs tasks one at a time, in order, on a background thread started by the first submit.
+// Doesn't include concurrency.h, so it can be used next to raylib.
+
+typedef void (*task_func_t)(void* arg);
+typedef struct task_s task_t;
+
+/**
+ * @brief Queues `func(arg)` to run on the background thread
+ *
+ * @return `task_t*` Handle to check the task with, free it with task_free()
+ */
+task_t* task_submit(task_func_t func, void* arg);
+
+/**
+ * @brief Checks whether a task has finished running, without waiting
+ */
+bool task_done(task_t* task);
+
+/**
+ * @brief Waits for a task to finish running
+ */
+void task_wait(task_t* task);
+
+/**
+ * @brief Frees a finished task
+ */
+void task_free(task_t* task);
+
+/**
+ * @brief Runs the tasks still queued and stops the background thread
+ */
+void task_queue_shutdown(void);
+
+#endif // TASK_QUEUE_H
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+
+#include "concurrency.h"
+#include "tiled_render.h"
+#include "utilities.h"
+
+typedef struct {
+    Clay_Software_Canvas* canvas;
+    Clay_RenderCommandArray commands;
+    const Clay_Software_Resources* resources;
+    Clay_Color background;
+    int columns;
+    size_t n;
+    size_t next;
+    mutex_t lock;
+} tile_jobs_t;
+
+static void tile_worker(void* arg)
+{
+    tile_jobs_t* jobs = (tile_jobs_t*) arg;
+    for (;;) {
+        mutex_lock(&jobs->lock);
+        size_t i = jobs->next++;
+        mutex_unlock(&jobs->lock);
+        if (i >= jobs->n) return;
+        Clay_Software_Rect tile = {
+            (int) (i % (size_t) jobs->columns) * TILED_RENDER_TILE_SIZE,
+            (int) (i / (size_t) jobs->columns) * TILED_RENDER_TILE_SIZE,
+            TILED_RENDER_TILE_SIZE,
+            TILED_RENDER_TILE_SIZE,
+        };
+        Clay_Software_Clear(jobs->canvas, tile, jobs->background);
+        Clay_Software_RenderTile(jobs->canvas, jobs->commands, jobs->resources, tile);
+    }
+}
+
+void tiled_render(Clay_Software_Canvas* canvas,
+                  Clay_RenderCommandArray commands,
+                  const Clay_Software_Resources* resources,
+                  Clay_Color background,
+                  size_t num_threads)
+{
+    Clay_Software_PrepareGlyphs(commands, resources);
+    int columns = (canvas->width + TILED_RENDER_TILE_SIZE - 1) / TILED_RENDER_TILE_SIZE;
+    int rows = (canvas->height + TILED_RENDER_TILE_SIZE - 1) / TILED_RENDER_TILE_SIZE;
+    tile_jobs_t jobs = {
+        .canvas = canvas,
+        .commands = commands,
+        .resources = resources,
+        .background = background,
+        .columns = columns,
+        .n = (size_t) columns * (size_t) rows,
+        .next = 0,
+    };
+    mutex_init(&jobs.lock);
+    if (num_threads == 0) {
+        num_threads = processor_count();
+    }
+    if (num_threads > jobs.n) {
+        num_threads = jobs.n;
+    }
+    // The calling thread draws too, so one fewer thread is started
+    thread_t* threads = NULL;
+    size_t started = 0;
+    if (num_threads > 1) {
+        threads = (thread_t*) malloc_assert(sizeof(*threads) * (num_threads - 1));
+        while (started < num_threads - 1 && thread_create(&threads[started], tile_worker, &jobs)) {
+            ++started;
+        }
+    }
+    tile_worker(&jobs);
+    for (size_t i = 0; i < started; ++i) {
+        thread_join(threads[i]);
+    }
+    free(threads);
+    mutex_destroy(&jobs.lock);
+}
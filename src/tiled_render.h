@@ -0,0 +1,26 @@
+#ifndef TILED_RENDER_H
+#define TILED_RENDER_H
+
+#include <stddef.h>
+
+#include "clay.h"
+#include "clay_renderer_software.h"
+
+// Tiles are square, small enough to share out evenly and for a tile's rows to stay in cache
+#define TILED_RENDER_TILE_SIZE (64)
+
+/**
+ * @brief Clears a canvas to `background` and draws render commands into it on several threads
+ *
+ * Each thread takes the next tile to draw until none are left. Glyphs are looked up on the calling
+ * thread first, see Clay_Software_PrepareGlyphs().
+ *
+ * @param num_threads Threads to draw on, including the calling one, 0 for one per processor
+ */
+void tiled_render(Clay_Software_Canvas* canvas,
+                  Clay_RenderCommandArray commands,
+                  const Clay_Software_Resources* resources,
+                  Clay_Color background,
+                  size_t num_threads);
+
+#endif // TILED_RENDER_H
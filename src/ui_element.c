@@ -6,23 +6,287 @@
 
 #include "clay_enum_names.h"
 #include "clay_struct_names.h"
+#include "concurrency.h"
 #include "ui_element.h"
 #include "utilities.h"
 
-static ui_element_t* ui_element_add(ui_element_t* parent, ui_element_type_t type)
+#define POOL_SLAB_COUNT (128)
+
+// Elements and their configs are allocated from fixed size pools, which grow a slab of
+// POOL_SLAB_COUNT objects at a time and are never returned to the system. Freed objects are
+// kept on a list threaded through the objects themselves.
+typedef union pool_slab_u {
+    union pool_slab_u* next;
+    // keeps the objects following the header aligned
+    double d;
+    long long ll;
+} pool_slab_t;
+
+typedef struct {
+    size_t size;
+    // index into each thread's caches
+    size_t index;
+    void* free_list;
+    pool_slab_t* slabs;
+} pool_t;
+
+// Each thread keeps its own free list per pool, and moves objects to and from the shared one a
+// batch at a time, so threads importing layouts side by side rarely take pool_lock
+typedef struct {
+    void* free_list;
+    // last object on the list, so it can be handed back without walking to its end
+    void* tail;
+    size_t count;
+} pool_cache_t;
+
+#define POOL_OBJECT_SIZE(type)                                                                     \
+    ((sizeof(type) + sizeof(pool_slab_t) - 1) & ~(sizeof(pool_slab_t) - 1))
+
+static pool_t element_pool = { .size = POOL_OBJECT_SIZE(ui_element_t), .index = 0 };
+static pool_t declaration_pool = { .size = POOL_OBJECT_SIZE(Clay_ElementDeclaration), .index = 1 };
+static pool_t text_config_pool = { .size = POOL_OBJECT_SIZE(Clay_TextElementConfig), .index = 2 };
+#define POOL_COUNT (3)
+// Guards the shared free lists and slabs, but not the per thread caches
+static mutex_t pool_lock = MUTEX_INITIALIZER;
+static THREAD_LOCAL pool_cache_t pool_caches[POOL_COUNT];
+
+// Fills an empty cache with up to POOL_SLAB_COUNT objects from the shared list, or a new slab
+static void pool_refill(pool_t* pool, pool_cache_t* cache)
+{
+    mutex_lock(&pool_lock);
+    void** object = (void**) pool->free_list;
+    if (object == NULL) {
+        pool_slab_t* slab
+            = (pool_slab_t*) malloc_assert(sizeof(*slab) + pool->size * POOL_SLAB_COUNT);
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        mutex_unlock(&pool_lock);
+        char* objects = (char*) (slab + 1);
+        cache->tail = objects + (POOL_SLAB_COUNT - 1) * pool->size;
+        for (size_t i = POOL_SLAB_COUNT; i-- > 0;) {
+            object = (void**) (objects + i * pool->size);
+            *object = cache->free_list;
+            cache->free_list = object;
+        }
+        cache->count = POOL_SLAB_COUNT;
+        return;
+    }
+    size_t count = 1;
+    while (count < POOL_SLAB_COUNT && *object) {
+        object = (void**) *object;
+        count++;
+    }
+    cache->free_list = pool->free_list;
+    cache->tail = object;
+    cache->count = count;
+    pool->free_list = *object;
+    *object = NULL;
+    mutex_unlock(&pool_lock);
+}
+
+static void* pool_alloc(pool_t* pool)
 {
-    ui_element_t* me = (ui_element_t*) malloc_assert(sizeof(ui_element_t));
+    pool_cache_t* cache = &pool_caches[pool->index];
+    if (cache->free_list == NULL) pool_refill(pool, cache);
+    void** object = (void**) cache->free_list;
+    cache->free_list = *object;
+    if (--cache->count == 0) cache->tail = NULL;
+    return object;
+}
+
+static void pool_free(pool_t* pool, void* object)
+{
+    if (object == NULL) return;
+    pool_cache_t* cache = &pool_caches[pool->index];
+    *(void**) object = cache->free_list;
+    cache->free_list = object;
+    if (cache->count++ == 0) cache->tail = object;
+}
+
+// Hands all but `keep` of a cache's objects back to the shared list in one go
+static void pool_give_back(pool_t* pool, size_t keep)
+{
+    pool_cache_t* cache = &pool_caches[pool->index];
+    if (cache->count <= keep) return;
+    void** last_kept = NULL;
+    void* first = cache->free_list;
+    for (size_t i = 0; i < keep; i++) {
+        last_kept = (void**) (last_kept ? *last_kept : cache->free_list);
+    }
+    if (last_kept) {
+        first = *last_kept;
+        *last_kept = NULL;
+    }
+    void** tail = (void**) cache->tail;
+    mutex_lock(&pool_lock);
+    *tail = pool->free_list;
+    pool->free_list = first;
+    mutex_unlock(&pool_lock);
+    cache->free_list = last_kept ? cache->free_list : NULL;
+    cache->tail = last_kept;
+    cache->count = keep;
+}
+
+// Caches can grow to two batches before going back down to one, so creating and removing an
+// element over and over at a batch boundary doesn't go to the shared list every time
+static void pool_trim(pool_t* pool)
+{
+    if (pool_caches[pool->index].count > 2 * POOL_SLAB_COUNT) {
+        pool_give_back(pool, POOL_SLAB_COUNT);
+    }
+}
+
+void ui_element_release_thread_cache(void)
+{
+    pool_give_back(&element_pool, 0);
+    pool_give_back(&declaration_pool, 0);
+    pool_give_back(&text_config_pool, 0);
+}
+
+ui_element_t* ui_element_create(ui_element_type_t type)
+{
+    ui_element_t* me = (ui_element_t*) pool_alloc(&element_pool);
     memset(me, 0, sizeof *me);
     me->type = type;
+    me->dirty = true;
     if (type == UI_ELEMENT_DECLARATION) {
-        me->ptr = (Clay_ElementDeclaration*) malloc_assert(sizeof(Clay_ElementDeclaration));
+        me->ptr = (Clay_ElementDeclaration*) pool_alloc(&declaration_pool);
         memset(me->ptr, 0, sizeof(Clay_ElementDeclaration));
-        me->ptr->backgroundColor.a = 255.0f;
-        me->children = NULL;
-        me->num_children = 0;
     } else {
-        me->text_config = (Clay_TextElementConfig*) malloc_assert(sizeof(Clay_TextElementConfig));
+        me->text_config = (Clay_TextElementConfig*) pool_alloc(&text_config_pool);
         memset(me->text_config, 0, sizeof(Clay_TextElementConfig));
+    }
+    return me;
+}
+
+Clay_ElementDeclaration* ui_element_alloc_declaration(void)
+{
+    Clay_ElementDeclaration* declaration = (Clay_ElementDeclaration*) pool_alloc(&declaration_pool);
+    memset(declaration, 0, sizeof(*declaration));
+    return declaration;
+}
+
+void ui_element_free_declaration(Clay_ElementDeclaration* declaration)
+{
+    pool_free(&declaration_pool, declaration);
+    pool_trim(&declaration_pool);
+}
+
+// Links `child` into `parent`'s children between `prev` and `next`, either of which can be NULL
+static void ui_element_link(ui_element_t* parent, ui_element_t* child, ui_element_t* prev, ui_element_t* next)
+{
+    child->parent = parent;
+    child->prev = prev;
+    child->next = next;
+    if (prev) {
+        prev->next = child;
+    } else {
+        parent->first_child = child;
+    }
+    if (next) {
+        next->prev = child;
+    } else {
+        parent->last_child = child;
+    }
+    parent->num_children++;
+    parent->cached_child = NULL;
+    ui_element_mark_dirty(parent);
+}
+
+static void ui_element_unlink(ui_element_t* me)
+{
+    ui_element_t* parent = me->parent;
+    if (me->prev) {
+        me->prev->next = me->next;
+    } else {
+        parent->first_child = me->next;
+    }
+    if (me->next) {
+        me->next->prev = me->prev;
+    } else {
+        parent->last_child = me->prev;
+    }
+    parent->num_children--;
+    parent->cached_child = NULL;
+    ui_element_mark_dirty(parent);
+    me->parent = me->prev = me->next = NULL;
+}
+
+void ui_element_mark_dirty(ui_element_t* me)
+{
+    for (; me && !me->dirty; me = me->parent) {
+        me->dirty = true;
+    }
+}
+
+void ui_element_clear_dirty(ui_element_t* me)
+{
+    if (!me->dirty) return;
+    me->dirty = false;
+    if (me->type == UI_ELEMENT_DECLARATION) {
+        for (ui_element_t* child = me->first_child; child; child = child->next) {
+            ui_element_clear_dirty(child);
+        }
+    }
+}
+
+void ui_element_append_child(ui_element_t* parent, ui_element_t* child)
+{
+    ui_element_link(parent, child, parent->last_child, NULL);
+}
+
+void ui_element_insert_child_before(ui_element_t* parent, ui_element_t* pos, ui_element_t* child)
+{
+    if (pos == NULL) {
+        ui_element_link(parent, child, parent->last_child, NULL);
+    } else {
+        ui_element_link(parent, child, pos->prev, pos);
+    }
+}
+
+size_t ui_element_index(ui_element_t* me)
+{
+    size_t index = 0;
+    for (ui_element_t* sibling = me->prev; sibling; sibling = sibling->prev) {
+        ++index;
+    }
+    return index;
+}
+
+ui_element_t* ui_element_child_at(ui_element_t* parent, size_t index)
+{
+    assert(index < parent->num_children);
+    ui_element_t* child;
+    size_t i;
+    if (index < parent->num_children - 1 - index) {
+        child = parent->first_child;
+        i = 0;
+    } else {
+        child = parent->last_child;
+        i = parent->num_children - 1;
+    }
+    if (parent->cached_child) {
+        size_t cached_distance = parent->cached_index > index ? parent->cached_index - index
+                                                              : index - parent->cached_index;
+        size_t distance = i > index ? i - index : index - i;
+        if (cached_distance < distance) {
+            child = parent->cached_child;
+            i = parent->cached_index;
+        }
+    }
+    for (; i < index; ++i) child = child->next;
+    for (; i > index; --i) child = child->prev;
+    parent->cached_child = child;
+    parent->cached_index = index;
+    return child;
+}
+
+static ui_element_t* ui_element_add(ui_element_t* parent, ui_element_type_t type)
+{
+    ui_element_t* me = ui_element_create(type);
+    if (type == UI_ELEMENT_DECLARATION) {
+        me->ptr->backgroundColor.a = 255.0f;
+    } else {
         me->text_config->textColor.a = 255.0f;
     }
     me->parent = parent;
@@ -33,16 +297,10 @@ ui_element_t* ui_element_insert_before(ui_element_t* parent, ui_element_t* pos,
 {
     ui_element_t* me = ui_element_add(parent, type);
     if (parent) {
-        parent->num_children++;
-        REALLOC_ASSERT(parent->children, sizeof(ui_element_t*) * parent->num_children);
         if (pos == NULL) {
-            parent->children[parent->num_children - 1] = me;
-        } else for (int i = (int) parent->num_children - 2; i >= 0; --i) {
-            parent->children[i + 1] = parent->children[i];
-            if (parent->children[i] == pos) {
-                parent->children[i] = me;
-                break;
-            }
+            ui_element_link(parent, me, parent->last_child, NULL);
+        } else {
+            ui_element_link(parent, me, pos->prev, pos);
         }
     }
     return me;
@@ -52,51 +310,52 @@ ui_element_t* ui_element_insert_after(ui_element_t* parent, ui_element_t* pos, u
 {
     ui_element_t* me = ui_element_add(parent, type);
     if (parent) {
-        parent->num_children++;
-        REALLOC_ASSERT(parent->children, sizeof(ui_element_t*) * parent->num_children);
-        int i;
-        for (i = (int) parent->num_children - 2; i >= 0; --i) {
-            if (parent->children[i] == pos) {
-                break;
-            }
-            parent->children[i + 1] = parent->children[i];
+        if (pos == NULL) {
+            ui_element_link(parent, me, NULL, parent->first_child);
+        } else {
+            ui_element_link(parent, me, pos, pos->next);
         }
-        parent->children[i + 1] = me;
     }
     return me;
 }
 
-void ui_element_remove(ui_element_t* me)
+// Frees into this thread's caches, which are trimmed once the whole subtree is released.
+// Children are released along with their parent, so they are never unlinked from their siblings.
+static void ui_element_release_r(ui_element_t* me)
 {
-    if (me == NULL) return;
     if (me->type == UI_ELEMENT_DECLARATION) {
-        free((char*) me->ptr->id.stringId.chars);
-        free(me->ptr);
+        const char* id = me->ptr->id.stringId.chars;
+        free((char*) id);
+        pool_free(&declaration_pool, me->ptr);
         free((char*) me->on_hover.callback.chars);
-        free(me->on_hover.ptr);
-        size_t num_children = me->num_children;
-        for (size_t i = 0; i < num_children; ++i) {
-            // Child will shift other children back when
-            // deleting self, so always remove head
-            ui_element_remove(me->children[0]);
+        if (me->on_hover.ptr && me->on_hover.ptr->id.stringId.chars != id) {
+            free((char*) me->on_hover.ptr->id.stringId.chars);
+        }
+        pool_free(&declaration_pool, me->on_hover.ptr);
+        ui_element_t* child = me->first_child;
+        while (child) {
+            ui_element_t* next = child->next;
+            ui_element_release_r(child);
+            child = next;
         }
-        assert(me->num_children == 0);
-        free(me->children);
     } else if (me->type == UI_ELEMENT_TEXT) {
         free((char*) me->text.s.chars);
-        free(me->text_config);
-    }
-    if (me->parent) {
-        for (size_t i = 0; i < me->parent->num_children; ++i) {
-            if (me->parent->children[i] == me) {
-                for (size_t j = i + 1; j < me->parent->num_children; ++j) {
-                    me->parent->children[j - 1] = me->parent->children[j];
-                }
-                break;
-            }
-        }
-        me->parent->num_children--;
+        pool_free(&text_config_pool, me->text_config);
     }
-    free(me);
+    pool_free(&element_pool, me);
+}
+
+void ui_element_detach(ui_element_t* me)
+{
+    if (me->parent) ui_element_unlink(me);
 }
 
+void ui_element_remove(ui_element_t* me)
+{
+    if (me == NULL) return;
+    if (me->parent) ui_element_unlink(me);
+    ui_element_release_r(me);
+    pool_trim(&element_pool);
+    pool_trim(&declaration_pool);
+    pool_trim(&text_config_pool);
+}
@@ -20,11 +20,18 @@ typedef struct {
 
 typedef struct ui_element_s {
     struct ui_element_s* parent;
+    // siblings under `parent`, in order
+    struct ui_element_s* prev;
+    struct ui_element_s* next;
     union {
         struct {
             Clay_ElementDeclaration* ptr;
-            struct ui_element_s** children;
+            struct ui_element_s* first_child;
+            struct ui_element_s* last_child;
             size_t num_children;
+            // last child looked up by ui_element_child_at(), cleared whenever children change
+            struct ui_element_s* cached_child;
+            size_t cached_index;
             on_hover_config_t on_hover;
         };
         struct {
@@ -33,8 +40,84 @@ typedef struct ui_element_s {
         };
     };
     ui_element_type_t type;
+    // changed since the last ui_element_clear_dirty(), set on every ancestor of a changed element
+    bool dirty;
 } ui_element_t;
 
+/**
+ * @brief Allocates a UI element that isn't part of any tree
+ *
+ * The element and its declaration or text config are zeroed, and the element is marked dirty. Free
+ * it with ui_element_remove().
+ *
+ * @param type Type of new element, declaration or text
+ * @return `ui_element_t*` Pointer to new element
+ */
+ui_element_t* ui_element_create(ui_element_type_t type);
+
+/**
+ * @brief Allocates a zeroed declaration, for `on_hover.ptr`
+ *
+ * ui_element_remove() frees `on_hover.ptr`, otherwise free it with ui_element_free_declaration().
+ * Its ID string is freed along with it by ui_element_remove(), unless it's the element's own.
+ */
+Clay_ElementDeclaration* ui_element_alloc_declaration(void);
+void ui_element_free_declaration(Clay_ElementDeclaration* declaration);
+
+/**
+ * @brief Hands the calling thread's cached free elements and configs back to the shared pools
+ *
+ * Each thread keeps some freed objects for its next allocations. Call this before a thread that
+ * created or removed elements exits, or they can't be reused.
+ */
+void ui_element_release_thread_cache(void);
+
+/**
+ * @brief Adds a UI element as the last child of `parent`
+ *
+ * @param parent Parent element, must be a declaration
+ * @param child Element to add, must not have a parent already
+ */
+void ui_element_append_child(ui_element_t* parent, ui_element_t* child);
+
+/**
+ * @brief Adds a UI element to `parent` before `pos`
+ *
+ * @param parent Parent element, must be a declaration
+ * @param pos Child of `parent` to place `child` before, `NULL` would add it as the last child
+ * @param child Element to add, must not have a parent already
+ */
+void ui_element_insert_child_before(ui_element_t* parent, ui_element_t* pos, ui_element_t* child);
+
+/**
+ * @brief Gets the position of a UI element among its siblings
+ */
+size_t ui_element_index(ui_element_t* me);
+
+/**
+ * @brief Marks a UI element and its ancestors as changed
+ */
+void ui_element_mark_dirty(ui_element_t* me);
+
+/**
+ * @brief Clears the dirty flag of `me` and every element under it
+ *
+ * Only visits dirty elements, as a dirty element always has dirty ancestors.
+ */
+void ui_element_clear_dirty(ui_element_t* me);
+
+/**
+ * @brief Gets the child at `index`
+ *
+ * Walks from the closest of the first, last or last looked up child, so visiting the children in
+ * order by index is linear overall.
+ *
+ * @param parent Parent element, must be a declaration
+ * @param index Index of child, must be less than `parent->num_children`
+ * @return `ui_element_t*` Child element
+ */
+ui_element_t* ui_element_child_at(ui_element_t* parent, size_t index);
+
 /**
  * @brief Inserts a UI element into tree before `pos`
  * 
@@ -54,6 +137,17 @@ ui_element_t* ui_element_insert_before(ui_element_t* parent, ui_element_t* pos,
  * @return `ui_element_t*` Pointer to inserted element
  */
 ui_element_t* ui_element_insert_after(ui_element_t* parent, ui_element_t* pos, ui_element_type_t type);
+
+/**
+ * @brief Takes a UI element and everything under it out of its parent without freeing them
+ *
+ * The element can be added back to a tree, or freed with ui_element_remove().
+ */
+void ui_element_detach(ui_element_t* me);
+
+/**
+ * @brief Removes a UI element from its parent and frees it along with all its children
+ */
 void ui_element_remove(ui_element_t* me);
 
 #endif // UI_ELEMENT_H